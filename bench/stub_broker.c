@@ -0,0 +1,55 @@
+/*
+ * Stub MQTT sink for tic_bench: counts publishes instead of sending them.
+ */
+
+#include <string.h>
+
+#include "broker_helper.h"
+
+unsigned long stub_publishes = 0;
+unsigned long stub_bytes = 0;
+
+/**
+ * @brief Count a message instead of publishing it.
+ * @param mosq Unused.
+ * @param topic_prefix Topic prefix. May be NULL.
+ * @param topic_suffix Topic suffix. May be NULL.
+ * @param payload Payload.
+ * @param len Length of payload.
+ * @param qos Unused.
+ * @param props Unused.
+ * @return 0.
+ */
+
+int broker_publish_props(struct mosquitto *mosq, const char *topic_prefix, const char *topic_suffix, const void *payload, int len, int qos,
+                         const struct broker_msg_props *props)
+{
+    stub_publishes++;
+    if (topic_prefix != NULL)
+        stub_bytes += strlen(topic_prefix);
+    if (topic_suffix != NULL)
+        stub_bytes += strlen(topic_suffix);
+    stub_bytes += len;
+
+    return 0;
+}
+
+/**
+ * @brief Count a message instead of publishing it.
+ * @param mosq Unused.
+ * @param topic Topic.
+ * @param payload Payload.
+ * @param len Length of payload.
+ * @param qos Unused.
+ * @param props Unused.
+ * @return 0.
+ */
+
+int broker_publish_topic(struct mosquitto *mosq, const char *topic, const void *payload, int len, int qos,
+                         const struct broker_msg_props *props)
+{
+    stub_publishes++;
+    stub_bytes += strlen(topic) + len;
+
+    return 0;
+}
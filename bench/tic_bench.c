@@ -0,0 +1,472 @@
+/*
+ * Micro-benchmark of the TIC parse and publish path over captured frames.
+ *
+ * Usage: tic_bench [-n iterations] corpus...
+ *
+ * Each corpus file holds raw bytes as read from the TIC line. Publishing goes
+ * to a stub sink (stub_broker.c) and allocations are counted by wrapping
+ * malloc/calloc/realloc at link time.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <syslog.h>
+#include <time.h>
+
+#include "tic2mqtt.h"
+#include "tic_cbor.h"
+#include "tic_frame.h"
+#include "tic_meter.h"
+#include "tic_publish.h"
+#include "tic_reader.h"
+#include "tic_scan.h"
+#include "tic_tags.h"
+
+#define DEFAULT_ITERATIONS 200
+#define CORPUS_FRAMES_MAX 4096
+
+extern unsigned long stub_publishes;
+extern unsigned long stub_bytes;
+
+/* Frames of current corpus. */
+
+struct corpus {
+    int count;                     // Number of frames.
+    char *frames[CORPUS_FRAMES_MAX]; // Frames, as delivered by the frame decoder.
+    int lens[CORPUS_FRAMES_MAX];   // Frame lengths.
+};
+
+static unsigned long allocs = 0;
+static const struct tic_input bench_input = { .type = TIC_INPUT_TTY, .fd = -1, .slave_fd = -1, .name = "bench" };
+static struct tic_meter *bench_meter; // Meter whose tag states the publish path updates.
+static unsigned long cbor_text_bytes; // Bytes of all values of CBOR snapshots, if published as text.
+
+void *__real_malloc(size_t size);
+void *__real_calloc(size_t nmemb, size_t size);
+void *__real_realloc(void *ptr, size_t size);
+
+void *__wrap_malloc(size_t size)
+{
+    allocs++;
+    return __real_malloc(size);
+}
+
+void *__wrap_calloc(size_t nmemb, size_t size)
+{
+    allocs++;
+    return __real_calloc(nmemb, size);
+}
+
+void *__wrap_realloc(void *ptr, size_t size)
+{
+    allocs++;
+    return __real_realloc(ptr, size);
+}
+
+/**
+ * @brief Get monotonic time.
+ * @return Nanoseconds elapsed since an unspecified point.
+ */
+
+static double now_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+/**
+ * @brief Store frame delivered by the frame decoder.
+ * @param frame TIC frame.
+ * @param len Length of frame.
+ * @param userdata Corpus.
+ */
+
+static void corpus_add(char *frame, int len, void *userdata)
+{
+    struct corpus *corpus = userdata;
+
+    if (corpus->count >= CORPUS_FRAMES_MAX)
+        return;
+
+    corpus->frames[corpus->count] = __real_malloc(len);
+    memcpy(corpus->frames[corpus->count], frame, len);
+    corpus->lens[corpus->count] = len;
+    corpus->count++;
+}
+
+/**
+ * @brief Load corpus file through the frame decoder.
+ * @param path Corpus file.
+ * @param corpus Corpus to fill.
+ * @param reader Frame decoder, for drop/resync counters.
+ * @return 0 on success, -1 on failure.
+ */
+
+static int corpus_load(const char *path, struct corpus *corpus, struct tic_reader *reader)
+{
+    char buf[4096];
+    FILE *fp;
+    size_t n;
+
+    fp = fopen(path, "rb");
+    if (fp == NULL) {
+        perror(path);
+        return -1;
+    }
+
+    corpus->count = 0;
+    tic_reader_init(reader, corpus_add, corpus);
+
+    while ((n = fread(buf, 1, sizeof(buf), fp)) > 0)
+        tic_reader_feed(reader, buf, n);
+
+    fclose(fp);
+    return 0;
+}
+
+/**
+ * @brief Free corpus frames.
+ * @param corpus Corpus.
+ */
+
+static void corpus_free(struct corpus *corpus)
+{
+    int i;
+
+    for (i = 0; i < corpus->count; i++)
+        free(corpus->frames[i]);
+    corpus->count = 0;
+}
+
+/**
+ * @brief Publish group of bench meter to stub sink.
+ * @param ptag_desc Tag description.
+ * @param data Data.
+ * @param len Length of data.
+ * @param userdata Simulated reception time of frame (time_t *).
+ */
+
+static void bench_group(struct tag_desc *ptag_desc, const char *data, int len, void *userdata)
+{
+    tic_publish_group(NULL, bench_meter, ptag_desc, data, len, *(time_t *) userdata);
+}
+
+/**
+ * @brief Detect mode of corpus the same way tic2mqtt does.
+ * @param corpus Corpus.
+ * @return TIC_MODE_LEGACY or TIC_MODE_STANDARD.
+ */
+
+static int bench_mode(const struct corpus *corpus)
+{
+    char frame[TIC_FRAME_MAX];
+    struct tic_frame_info info;
+    int ok[2] = { 0, 0 };
+    int i;
+
+    for (i = 0; i < corpus->count; i++) {
+        memcpy(frame, corpus->frames[i], corpus->lens[i]);
+        tic_process_frame(frame, corpus->lens[i], TIC_MODE_AUTO, NULL, NULL, &info);
+        ok[0] += info.groups_ok[0];
+        ok[1] += info.groups_ok[1];
+    }
+
+    return ok[1] > ok[0] ? TIC_MODE_STANDARD : TIC_MODE_LEGACY;
+}
+
+/**
+ * @brief Benchmark full frame processing: parse, checksum, lookup, publish.
+ * @param corpus Corpus.
+ * @param mode TIC mode.
+ * @param iterations Number of passes over the corpus.
+ */
+
+static void bench_frames(const struct corpus *corpus, int mode, int iterations)
+{
+    char frame[TIC_FRAME_MAX];
+    struct tic_frame_info info;
+    unsigned long groups = 0;
+    unsigned long errors = 0;
+    unsigned long publishes = stub_publishes;
+    unsigned long bytes = stub_bytes;
+    unsigned long allocs_start = allocs;
+    unsigned long frames = (unsigned long) corpus->count * iterations;
+    double start;
+    double elapsed;
+    time_t now = 0;
+    int iter;
+    int i;
+
+    start = now_ns();
+    for (iter = 0; iter < iterations; iter++) {
+        for (i = 0; i < corpus->count; i++, now++) {
+            memcpy(frame, corpus->frames[i], corpus->lens[i]);
+            bench_meter->seq++;
+            tic_process_frame(frame, corpus->lens[i], mode, bench_group, &now, &info);
+            groups += info.groups;
+            errors += info.errors;
+        }
+    }
+    elapsed = now_ns() - start;
+
+    printf("  frames:     %10.0f frames/s %8.0f ns/frame %6.1f ns/group\n",
+           frames / (elapsed / 1e9), elapsed / frames, groups ? elapsed / groups : 0.0);
+    printf("              %10.2f groups/frame %6.2f errors/frame %6.2f allocs/frame\n",
+           (double) groups / frames, (double) errors / frames, (double) (allocs - allocs_start) / frames);
+    printf("              %10.2f publishes/frame %6.1f bytes/frame\n",
+           (double) (stub_publishes - publishes) / frames, (double) (stub_bytes - bytes) / frames);
+}
+
+/**
+ * @brief Add group to CBOR snapshot and count its size if published to its own topic.
+ * @param ptag_desc Tag description.
+ * @param data Data.
+ * @param len Length of data.
+ * @param userdata CBOR snapshot.
+ */
+
+static void bench_cbor_group(struct tag_desc *ptag_desc, const char *data, int len, void *userdata)
+{
+    tic_cbor_add(userdata, ptag_desc, data);
+    cbor_text_bytes += strlen(bench_meter->node_topic) + strlen(ptag_desc->attrs.prop_id) + len;
+}
+
+/**
+ * @brief Benchmark CBOR snapshots of all values of each frame, published as one message,
+ *        against publishing each value as text to its own topic.
+ * @param corpus Corpus.
+ * @param mode TIC mode.
+ * @param iterations Number of passes over the corpus.
+ */
+
+static void bench_cbor(const struct corpus *corpus, int mode, int iterations)
+{
+    static struct tic_cbor cbor;
+    char frame[TIC_FRAME_MAX];
+    struct tic_frame_info info;
+    size_t topic_len = strlen(bench_meter->node_topic) + strlen("frame-cbor");
+    unsigned long bytes = 0;
+    unsigned long frames = (unsigned long) corpus->count * iterations;
+    double start;
+    double elapsed;
+    int iter;
+    int i;
+
+    cbor_text_bytes = 0;
+    start = now_ns();
+    for (iter = 0; iter < iterations; iter++) {
+        for (i = 0; i < corpus->count; i++) {
+            memcpy(frame, corpus->frames[i], corpus->lens[i]);
+            tic_cbor_begin(&cbor, i, 1700000000000LL + i * 1000LL);
+            tic_process_frame(frame, corpus->lens[i], mode, bench_cbor_group, &cbor, &info);
+            if (tic_cbor_end(&cbor) > 0)
+                bytes += topic_len + cbor.len;
+        }
+    }
+    elapsed = now_ns() - start;
+
+    printf("  cbor:       %10.0f ns/frame %6.1f bytes/frame (text: %.1f bytes/frame)\n",
+           elapsed / frames, (double) bytes / frames, (double) cbor_text_bytes / frames);
+}
+
+/**
+ * @brief Benchmark group splitting and summing of every frame of the corpus.
+ * @param corpus Corpus.
+ * @param iterations Number of passes over the corpus.
+ */
+
+static void bench_scan(const struct corpus *corpus, int iterations)
+{
+    struct tic_group groups[TIC_GROUPS_MAX];
+    unsigned long groups_found = 0;
+    unsigned long bytes = 0;
+    double start;
+    double elapsed;
+    int iter;
+    int i;
+
+    start = now_ns();
+    for (iter = 0; iter < iterations; iter++) {
+        for (i = 0; i < corpus->count; i++) {
+            groups_found += tic_scan_frame(corpus->frames[i], corpus->lens[i] - 1, groups, TIC_GROUPS_MAX, NULL);
+            bytes += corpus->lens[i];
+        }
+    }
+    elapsed = now_ns() - start;
+
+    printf("  scan:       %10.1f ns/group %6.2f ns/byte\n",
+           groups_found ? elapsed / groups_found : 0.0, bytes ? elapsed / bytes : 0.0);
+}
+
+/**
+ * @brief Benchmark checksum of every group of the corpus.
+ * @param corpus Corpus.
+ * @param iterations Number of passes over the corpus.
+ */
+
+static void bench_checksum(const struct corpus *corpus, int iterations)
+{
+    unsigned long groups = 0;
+    volatile int ok = 0;
+    double start;
+    double elapsed;
+    int iter;
+    int i;
+
+    start = now_ns();
+    for (iter = 0; iter < iterations; iter++) {
+        for (i = 0; i < corpus->count; i++) {
+            const char *p = corpus->frames[i];
+            const char *end = p + corpus->lens[i];
+            const char *lf;
+            const char *cr;
+
+            while ((lf = memchr(p, '\n', end - p)) != NULL && (cr = memchr(lf, '\r', end - lf)) != NULL) {
+                if (cr - lf >= 4)
+                    ok += tic_is_checksum_ok(lf + 1, cr - (cr[-2] == '\t' ? 2 : 3), cr[-1]);
+                groups++;
+                p = cr + 1;
+            }
+        }
+    }
+    elapsed = now_ns() - start;
+
+    printf("  checksum:   %10.1f ns/group (%lu groups)\n", groups ? elapsed / groups : 0.0, groups);
+}
+
+/**
+ * @brief Benchmark tag lookup of known and unknown tags.
+ * @param iterations Number of passes over the tag table.
+ */
+
+static void bench_lookup(int iterations)
+{
+    static const char * const unknown[] = { "XXXX", "ADC0", "PAPP1", "EASF11", "IINST2", "", NULL };
+    const struct tag_desc *ptag_desc;
+    const char * const *label;
+    unsigned long lookups = 0;
+    volatile int found = 0;
+    double start;
+    double elapsed;
+    int iter;
+
+    start = now_ns();
+    for (iter = 0; iter < iterations * 100; iter++) {
+        for (ptag_desc = tag_descs; ptag_desc->tag != NULL; ptag_desc++, lookups++)
+            found += tic_tag_lookup(ptag_desc->tag, strlen(ptag_desc->tag)) != NULL;
+        for (label = unknown; *label != NULL; label++, lookups++)
+            found += tic_tag_lookup(*label, strlen(*label)) != NULL;
+    }
+    elapsed = now_ns() - start;
+
+    printf("lookup:       %10.1f ns/lookup\n", elapsed / lookups);
+}
+
+/**
+ * @brief Benchmark publish path (change detection, topic building, stub sink).
+ * @param iterations Number of passes over the tag table.
+ */
+
+static void bench_publish(int iterations)
+{
+    static const char * const values[] = { "000123456", "000123457" };
+    int len = strlen(values[0]);
+    struct tag_desc *ptag_desc;
+    unsigned long publishes = 0;
+    unsigned long allocs_start;
+    double start;
+    double elapsed;
+    int iter;
+
+    allocs_start = allocs;
+    start = now_ns();
+    for (iter = 0; iter < iterations * 100; iter++) {
+        bench_meter->seq++;
+        for (ptag_desc = tag_descs; ptag_desc->tag != NULL; ptag_desc++, publishes++)
+            tic_publish_group(NULL, bench_meter, ptag_desc, values[iter & 1], len, iter);
+    }
+    elapsed = now_ns() - start;
+
+    printf("publish:      %10.1f ns/publish %6.3f allocs/publish\n",
+           elapsed / publishes, (double) (allocs - allocs_start) / publishes);
+}
+
+/**
+ * @brief Print usage.
+ * @param progname Program name.
+ */
+
+static void usage(const char *progname)
+{
+    fprintf(stderr, "Usage: %s [-n iterations] corpus...\n", progname);
+}
+
+/**
+ * @brief Program entry point.
+ * @param argc Argument count.
+ * @param argv Argument vector.
+ * @return If successful, EXIT_SUCCESS is returned.
+ * @return If not, EXIT_FAILURE is returned.
+ */
+
+int main(int argc, char *argv[])
+{
+    static struct corpus corpus;
+    struct tic_reader reader;
+    int iterations = DEFAULT_ITERATIONS;
+    int opt;
+    int i;
+
+    while ((opt = getopt(argc, argv, "n:")) != -1) {
+        switch (opt) {
+        case 'n':
+            iterations = atoi(optarg);
+            break;
+
+        default:
+            usage(argv[0]);
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    if (optind >= argc || iterations <= 0) {
+        usage(argv[0]);
+        exit(EXIT_FAILURE);
+    }
+
+    /* Parse errors are logged through syslog(): keep the mask check only. */
+    setlogmask(LOG_UPTO(LOG_CRIT));
+
+    bench_meter = tic_meter_new(&bench_input);
+    if (bench_meter == NULL)
+        exit(EXIT_FAILURE);
+    tic_meter_set_device_id(bench_meter, HOMIE_DEVICE_ID);
+
+    for (i = optind; i < argc; i++) {
+        int mode;
+
+        if (corpus_load(argv[i], &corpus, &reader) < 0)
+            exit(EXIT_FAILURE);
+
+        mode = bench_mode(&corpus);
+        printf("%s: %d frames (%s), %lu dropped, %lu resynced\n", argv[i], corpus.count,
+               mode == TIC_MODE_STANDARD ? "standard" : "legacy", reader.dropped, reader.resynced);
+
+        bench_frames(&corpus, mode, iterations);
+        bench_cbor(&corpus, mode, iterations);
+        bench_scan(&corpus, iterations);
+        bench_checksum(&corpus, iterations);
+
+        corpus_free(&corpus);
+    }
+
+    bench_lookup(iterations);
+    bench_publish(iterations);
+
+    return EXIT_SUCCESS;
+}
@@ -1,13 +1,57 @@
 #define _GNU_SOURCE
 #include <errno.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
+#include <time.h>
 
 #include <syslog.h>
+#include <unistd.h>
 
 #include <mosquitto.h>
 
 #include "broker_helper.h"
+#include "event_loop.h"
+#include "journal.h"
+
+#define BROKER_FLUSH_MAX 100   /* Max write attempts when closing. */
+#define BROKER_REPLAY_BATCH 64 /* Max journal messages replayed at once. */
+#define BROKER_BACKOFF_MIN 4   /* s */
+#define BROKER_BACKOFF_MAX 300 /* s */
+#define BROKER_ALIASES_MAX 128 /* Max topic aliases used, whatever the broker grants. */
+
+/* Connection states. */
+
+enum {
+    BROKER_WAITING,    // Waiting for next connection attempt.
+    BROKER_CONNECTING, // Waiting for connection acknowledgement.
+    BROKER_CONNECTED   // Connection acknowledged by broker.
+};
+
+/* Topic alias (MQTT v5). */
+
+struct broker_alias {
+    uint64_t hash;           // Hash of topic, 0 if unassigned.
+    unsigned long last_used; // Value of broker_alias_clock when last used.
+};
+
+static struct event_loop *broker_loop = NULL;
+static struct event_source broker_src = { .fd = -1 };
+static struct journal *broker_journal = NULL;
+static int broker_state = BROKER_WAITING;
+static int broker_backoff = BROKER_BACKOFF_MIN; // Upper bound of next reconnection delay (s).
+static time_t broker_retry_at = 0;              // Time of next reconnection attempt (monotonic s).
+static broker_connect_cb broker_on_connect = NULL;
+static void *broker_on_connect_userdata = NULL;
+static unsigned long broker_failures = 0;       // Number of messages not handed to libmosquitto or journal.
+static int broker_mqtt5 = 0;                    // Set to connect with MQTT v5.
+static int broker_alias_max = 0;                // Topic aliases granted by the broker on this connection.
+static int broker_alias_count = 0;              // Topic aliases assigned on this connection.
+static struct broker_alias broker_aliases[BROKER_ALIASES_MAX]; // Topic aliases, indexed by alias minus 1.
+static unsigned long broker_alias_clock = 0;    // Number of messages sent through aliases.
+static broker_publish_cb broker_on_publish = NULL;
+static void *broker_on_publish_userdata = NULL;
+static int broker_last_mid = 0;                 // Message id of last message handed to libmosquitto.
 
 /**
  * @brief Log callback for MQTT.
@@ -47,12 +91,271 @@ static void mosq_log_callback(struct mosquitto *mosq, void *userdata, int level,
     }
 }
 
+/**
+ * @brief Get monotonic time.
+ * @return Seconds elapsed since an unspecified point.
+ */
+
+static time_t broker_now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec;
+}
+
+/**
+ * @brief Schedule next reconnection attempt.
+ * @note The delay is drawn at random up to the backoff, which doubles after
+ *       each failure, so that clients do not reconnect all at once when a
+ *       broker comes back.
+ */
+
+static void broker_schedule_retry(void)
+{
+    int delay = random() % (broker_backoff + 1);
+
+    broker_state = BROKER_WAITING;
+    broker_retry_at = broker_now() + delay;
+    syslog(LOG_INFO, "Reconnecting to MQTT broker in %d s", delay);
+
+    broker_backoff *= 2;
+    if (broker_backoff > BROKER_BACKOFF_MAX)
+        broker_backoff = BROKER_BACKOFF_MAX;
+}
+
+/**
+ * @brief Replay a batch of journal messages.
+ * @param mosq Mosquitto instance.
+ * @note The next batch is replayed once libmosquitto has written this one.
+ *       Messages rejected for good (e.g. invalid topic or payload too large)
+ *       are dropped.
+ */
+
+static void broker_replay(struct mosquitto *mosq)
+{
+    struct journal_msg msg;
+    int res;
+    int i;
+
+    if (broker_journal == NULL || broker_state != BROKER_CONNECTED)
+        return;
+
+    for (i = 0; i < BROKER_REPLAY_BATCH && journal_peek(broker_journal, &msg) == 0; i++) {
+        res = mosquitto_publish(mosq, NULL, msg.topic, msg.payload_len, msg.payload, msg.qos, 1);
+        if (res == MOSQ_ERR_NO_CONN || res == MOSQ_ERR_CONN_LOST || res == MOSQ_ERR_NOMEM || res == MOSQ_ERR_OVERSIZE_PACKET) {
+            // Transient: retry with the next batch.
+            syslog(LOG_ERR, "Cannot replay topic %s: %s", msg.topic, mosquitto_strerror(res));
+            return;
+        }
+        if (res != MOSQ_ERR_SUCCESS) {
+            // The message can never be sent: do not let it block the journal.
+            syslog(LOG_ERR, "Dropping journaled topic %s: %s", msg.topic, mosquitto_strerror(res));
+            journal_drop(broker_journal);
+            continue;
+        }
+        journal_pop(broker_journal);
+    }
+
+    if (i > 0 && broker_journal->count == 0)
+        syslog(LOG_INFO, "MQTT journal replayed");
+}
+
+/**
+ * @brief Update events watched on broker socket.
+ * @param mosq Mosquitto instance.
+ * @note EPOLLOUT is only watched while libmosquitto has packets to write.
+ */
+
+static void broker_update_events(struct mosquitto *mosq)
+{
+    uint32_t events = EPOLLIN;
+
+    if (broker_loop == NULL || broker_src.fd < 0)
+        return;
+
+    if (mosquitto_want_write(mosq))
+        events |= EPOLLOUT;
+
+    event_loop_mod(broker_loop, &broker_src, events);
+}
+
+/**
+ * @brief Watch broker socket in event loop.
+ * @param mosq Mosquitto instance.
+ */
+
+static void broker_watch(struct mosquitto *mosq)
+{
+    int fd = mosquitto_socket(mosq);
+
+    if (fd == broker_src.fd)
+        return;
+
+    if (broker_src.fd >= 0)
+        event_loop_del(broker_loop, &broker_src);
+    broker_src.fd = -1;
+
+    if (fd < 0)
+        return;
+
+    broker_src.fd = fd;
+    broker_src.events = EPOLLIN;
+    if (event_loop_add(broker_loop, &broker_src) < 0) {
+        broker_src.fd = -1;
+        return;
+    }
+
+    broker_update_events(mosq);
+}
+
+/**
+ * @brief Lose connection to broker.
+ * @param mosq Mosquitto instance.
+ * @param res Error code.
+ * @note Nothing is done if the loss is already known.
+ */
+
+static void broker_lost(struct mosquitto *mosq, int res)
+{
+    if (broker_state != BROKER_WAITING) {
+        syslog(LOG_WARNING, "MQTT connection lost: %s", mosquitto_strerror(res));
+        broker_schedule_retry();
+    }
+
+    broker_watch(mosq);
+}
+
+/**
+ * @brief Connect callback for MQTT.
+ * @param mosq Mosquitto instance making the callback.
+ * @param userdata User data provided in mosquitto_new.
+ * @param rc Return code of the connection response.
+ */
+
+static void mosq_connect_callback(struct mosquitto *mosq, void *userdata, int rc)
+{
+    if (rc != 0) {
+        syslog(LOG_ERR, "MQTT connection refused: %s", mosquitto_strerror(rc));
+        return;
+    }
+
+    syslog(LOG_INFO, "Connected to MQTT broker");
+    broker_state = BROKER_CONNECTED;
+    broker_backoff = BROKER_BACKOFF_MIN;
+    broker_replay(mosq);
+
+    if (broker_on_connect != NULL)
+        broker_on_connect(mosq, broker_on_connect_userdata);
+}
+
+/**
+ * @brief Connect callback for MQTT v5.
+ * @param mosq Mosquitto instance making the callback.
+ * @param userdata User data provided in mosquitto_new.
+ * @param rc Return code of the connection response.
+ * @param flags Connect flags.
+ * @param props Properties of the connection response.
+ * @note Topic aliases only live as long as the network connection.
+ */
+
+static void mosq_connect_v5_callback(struct mosquitto *mosq, void *userdata, int rc, int flags, const mosquitto_property *props)
+{
+    uint16_t alias_max = 0;
+
+    mosquitto_property_read_int16(props, MQTT_PROP_TOPIC_ALIAS_MAXIMUM, &alias_max, false);
+    broker_alias_max = alias_max < BROKER_ALIASES_MAX ? alias_max : BROKER_ALIASES_MAX;
+    broker_alias_count = 0;
+
+    mosq_connect_callback(mosq, userdata, rc);
+}
+
+/**
+ * @brief Publish callback for MQTT.
+ * @param mosq Mosquitto instance making the callback.
+ * @param userdata User data provided in mosquitto_new.
+ * @param mid Message id of the message acknowledged (QoS 1 or 2) or written (QoS 0).
+ */
+
+static void mosq_publish_callback(struct mosquitto *mosq, void *userdata, int mid)
+{
+    if (broker_on_publish != NULL)
+        broker_on_publish(mosq, mid, broker_on_publish_userdata);
+}
+
+/**
+ * @brief Disconnect callback for MQTT.
+ * @param mosq Mosquitto instance making the callback.
+ * @param userdata User data provided in mosquitto_new.
+ * @param rc Reason of disconnection, 0 if requested by client.
+ */
+
+static void mosq_disconnect_callback(struct mosquitto *mosq, void *userdata, int rc)
+{
+    if (rc != 0)
+        broker_lost(mosq, MOSQ_ERR_CONN_LOST);
+}
+
+/**
+ * @brief Start reconnecting to broker, once the backoff delay is over.
+ * @param mosq Mosquitto instance.
+ * @note The connection completes in the event loop, without blocking.
+ */
+
+static void broker_reconnect(struct mosquitto *mosq)
+{
+    int res;
+
+    if (broker_state != BROKER_WAITING || broker_now() < broker_retry_at)
+        return;
+
+    broker_state = BROKER_CONNECTING;
+    res = mosquitto_reconnect_async(mosq);
+    if (res != MOSQ_ERR_SUCCESS) {
+        syslog(LOG_ERR, "Unable to reconnect to MQTT broker: %s", mosquitto_strerror(res));
+        broker_schedule_retry();
+    }
+
+    broker_watch(mosq);
+}
+
+/**
+ * @brief Handle events on broker socket.
+ * @param src Event source.
+ * @param events Events.
+ */
+
+static void broker_handler(struct event_source *src, uint32_t events)
+{
+    struct mosquitto *mosq = src->userdata;
+    int res = MOSQ_ERR_SUCCESS;
+
+    if (events & (EPOLLIN | EPOLLERR | EPOLLHUP))
+        res = mosquitto_loop_read(mosq, 1);
+
+    if (res == MOSQ_ERR_SUCCESS && (events & EPOLLOUT))
+        res = mosquitto_loop_write(mosq, 1);
+
+    if (res != MOSQ_ERR_SUCCESS) {
+        broker_lost(mosq, res);
+        return;
+    }
+
+    if (!mosquitto_want_write(mosq))
+        broker_replay(mosq);
+
+    broker_update_events(mosq);
+}
+
 /**
  * @brief Open connection to MQTT broker.
  * @brief host The hostname or ip address of the broker to connect to.
  * @brief port The network port to connect to.
  * @brief keepalive The number of seconds after which the broker should send a PING message to the client if no other messages have been exchanged in that time.
  * @return Pointer to a struct mosquitto on success. NULL on failure.
+ * @note The network loop is driven by the caller's event loop (see broker_attach()).
+ * @note The connection completes asynchronously. If it fails, broker_misc()
+ *       retries with an exponential backoff.
  */
 
 struct mosquitto *broker_open(const char *host, int port, int keepalive)
@@ -61,6 +364,7 @@ struct mosquitto *broker_open(const char *host, int port, int keepalive)
     int res;
 
     mosquitto_lib_init();
+    srandom(getpid() ^ time(NULL));
 
     /* Create MQTT client. */
     mosq = mosquitto_new(NULL, 1, NULL);
@@ -70,58 +374,301 @@ struct mosquitto *broker_open(const char *host, int port, int keepalive)
     }
 
     mosquitto_log_callback_set(mosq, mosq_log_callback);
+    if (broker_mqtt5) {
+        mosquitto_int_option(mosq, MOSQ_OPT_PROTOCOL_VERSION, MQTT_PROTOCOL_V5);
+        mosquitto_connect_v5_callback_set(mosq, mosq_connect_v5_callback);
+    } else {
+        mosquitto_connect_callback_set(mosq, mosq_connect_callback);
+    }
+    mosquitto_disconnect_callback_set(mosq, mosq_disconnect_callback);
+    mosquitto_publish_callback_set(mosq, mosq_publish_callback);
 
     /* Connect to broker. */
-    res = mosquitto_connect(mosq, host, port, keepalive);
+    broker_state = BROKER_CONNECTING;
+    res = mosquitto_connect_async(mosq, host, port, keepalive);
     if (res != MOSQ_ERR_SUCCESS) {
         syslog(LOG_ERR, "Unable to connect to MQTT broker %s:%d: %s", host, port, mosquitto_strerror(res));
-        return NULL;
+        broker_schedule_retry();
     }
 
-    /* Start network loop. */
-    res = mosquitto_loop_start(mosq);
-    if (res != MOSQ_ERR_SUCCESS) {
-        syslog(LOG_ERR, "Unable to start loop: %s", mosquitto_strerror(res));
-        return NULL;
+    return mosq;
+}
+
+/**
+ * @brief Keep messages in a journal while the broker is unreachable.
+ * @param journal Opened journal. Messages left from a previous run are replayed after connection.
+ * @note Must be called before broker_open().
+ */
+
+void broker_set_journal(struct journal *journal)
+{
+    broker_journal = journal;
+}
+
+/**
+ * @brief Connect with MQTT v5 instead of MQTT 3.1.1, to use message properties.
+ * @param enable Set to use MQTT v5.
+ * @note Must be called before broker_open().
+ */
+
+void broker_set_mqtt5(int enable)
+{
+    broker_mqtt5 = enable;
+}
+
+/**
+ * @brief Set function called each time the broker acknowledges the connection.
+ * @param cb Callback, e.g. to publish the current state again.
+ * @param userdata User data passed to callback.
+ */
+
+void broker_set_connect_cb(broker_connect_cb cb, void *userdata)
+{
+    broker_on_connect = cb;
+    broker_on_connect_userdata = userdata;
+}
+
+/**
+ * @brief Set function called each time a message is acknowledged (QoS 1 or 2) or written (QoS 0).
+ * @param cb Callback, e.g. to trace publication latency.
+ * @param userdata User data passed to callback.
+ */
+
+void broker_set_publish_cb(broker_publish_cb cb, void *userdata)
+{
+    broker_on_publish = cb;
+    broker_on_publish_userdata = userdata;
+}
+
+/**
+ * @brief Get message id of last message handed to libmosquitto by broker_publish().
+ * @return Message id, 0 if none.
+ */
+
+int broker_get_last_mid(void)
+{
+    return broker_last_mid;
+}
+
+/**
+ * @brief Drive MQTT network traffic from an event loop.
+ * @param mosq Mosquitto instance.
+ * @param loop Event loop.
+ * @note broker_misc() must be called about once per second.
+ */
+
+void broker_attach(struct mosquitto *mosq, struct event_loop *loop)
+{
+    broker_loop = loop;
+    broker_src.handler = broker_handler;
+    broker_src.userdata = mosq;
+
+    broker_watch(mosq);
+}
+
+/**
+ * @brief Handle MQTT keepalive and reconnection.
+ * @param mosq Mosquitto instance.
+ */
+
+void broker_misc(struct mosquitto *mosq)
+{
+    int res;
+
+    if (broker_journal != NULL)
+        journal_sync(broker_journal);
+
+    res = mosquitto_loop_misc(mosq);
+    if (res == MOSQ_ERR_NO_CONN || broker_src.fd < 0) {
+        broker_lost(mosq, MOSQ_ERR_CONN_LOST);
+        broker_reconnect(mosq);
+        return;
     }
 
-    return mosq;
+    broker_replay(mosq);
+    broker_update_events(mosq);
 }
 
 /**
  * @brief Close connection to MQTT broker.
  * @param mosq Mosquitto instance.
+ * @note Pending packets are flushed before disconnecting.
  */
 
 void broker_close(struct mosquitto *mosq)
 {
-    /* Stop network loop. */
-    mosquitto_loop_stop(mosq, 1);
+    int i;
+
+    if (broker_loop != NULL && broker_src.fd >= 0)
+        event_loop_del(broker_loop, &broker_src);
+    broker_src.fd = -1;
+    broker_loop = NULL;
+
+    /* Flush pending packets. */
+    for (i = 0; i < BROKER_FLUSH_MAX && mosquitto_want_write(mosq); i++) {
+        if (mosquitto_loop_write(mosq, 1) != MOSQ_ERR_SUCCESS)
+            break;
+    }
 
     /* Disconnect from broker. */
     mosquitto_disconnect(mosq);
 
-    /* Create MQTT client. */
+    /* Destroy MQTT client. */
     mosquitto_destroy(mosq);
 
     mosquitto_lib_cleanup();
 }
 
 /**
- * @brief Publish a message to MQTT broker.
+ * @brief Get topic alias of a topic, assigning one if needed.
+ * @param topic Topic.
+ * @param known Set if the broker already knows the alias.
+ * @return Alias, 0 if the broker grants none.
+ * @note Once all aliases granted by the broker are assigned, the least recently
+ *       used one is assigned again, so that frequent topics keep theirs.
+ */
+
+static int broker_alias(const char *topic, int *known)
+{
+    struct broker_alias *alias = NULL;
+    uint64_t hash = 0xcbf29ce484222325ULL;
+    int i;
+
+    for (; *topic != '\0'; topic++) {
+        hash ^= (unsigned char) *topic;
+        hash *= 0x100000001b3ULL;
+    }
+
+    *known = 0;
+    for (i = 0; i < broker_alias_count; i++) {
+        if (broker_aliases[i].hash == hash) {
+            *known = 1;
+            alias = &broker_aliases[i];
+            break;
+        }
+        if (alias == NULL || broker_aliases[i].last_used < alias->last_used)
+            alias = &broker_aliases[i];
+    }
+
+    if (!*known && broker_alias_count < broker_alias_max)
+        alias = &broker_aliases[broker_alias_count++];
+    if (alias == NULL)
+        return 0;
+
+    alias->hash = hash;
+    alias->last_used = ++broker_alias_clock;
+    return alias - broker_aliases + 1;
+}
+
+/**
+ * @brief Hand a message to libmosquitto, with its MQTT v5 properties if any.
+ * @param mosq Mosquitto instance.
+ * @param mid Filled with message id.
+ * @param topic Topic.
+ * @param payload Payload.
+ * @param len Length of payload.
+ * @param qos QOS.
+ * @param props Properties. May be NULL.
+ * @return MOSQ_ERR_SUCCESS on success, a mosquitto error else.
+ * @note Once the broker knows the alias of a topic, the topic is not sent again.
+ *       Only messages of QoS 0 use aliases, as libmosquitto may send the others
+ *       again on a new connection, where aliases are unknown.
+ */
+
+static int broker_send(struct mosquitto *mosq, int *mid, const char *topic, const void *payload, int len, int qos,
+                       const struct broker_msg_props *props)
+{
+    mosquitto_property *proplist = NULL;
+    const char *sent_topic = topic;
+    int known = 0;
+    int alias = 0;
+    int res;
+
+    if (!broker_mqtt5 || props == NULL)
+        return mosquitto_publish(mosq, mid, topic, len, payload, qos, 1);
+
+    if (props->alias && qos == 0 && (alias = broker_alias(topic, &known)) > 0) {
+        mosquitto_property_add_int16(&proplist, MQTT_PROP_TOPIC_ALIAS, alias);
+        if (known)
+            sent_topic = NULL;
+    }
+    if (props->expiry > 0)
+        mosquitto_property_add_int32(&proplist, MQTT_PROP_MESSAGE_EXPIRY_INTERVAL, props->expiry);
+    if (props->timestamp != NULL)
+        mosquitto_property_add_string_pair(&proplist, MQTT_PROP_USER_PROPERTY, "ts", props->timestamp);
+
+    res = mosquitto_publish_v5(mosq, mid, sent_topic, len, payload, qos, 1, proplist);
+    mosquitto_property_free_all(&proplist);
+
+    // The broker only learns the topic of an alias with the message that carries it.
+    if (res != MOSQ_ERR_SUCCESS && alias > 0 && !known)
+        broker_aliases[alias - 1].hash = 0;
+
+    return res;
+}
+
+/**
+ * @brief Publish a binary message with MQTT v5 properties to MQTT broker, on a complete topic.
+ * @param mosq Mosquitto instance.
+ * @param topic Topic, e.g. built once for each property.
+ * @param payload Payload. Need not be NUL terminated.
+ * @param len Length of payload.
+ * @param qos QOS.
+ * @param props MQTT v5 properties. May be NULL.
+ * @return 0 on success, -1 on failure.
+ * @note With a journal, the message is journaled if it cannot be sent, or if
+ *       older messages are still waiting, to keep publication order. Without
+ *       a journal, messages are dropped until the broker acknowledges the
+ *       connection. Properties of journaled messages are lost.
+ */
+
+int broker_publish_topic(struct mosquitto *mosq, const char *topic, const void *payload, int len, int qos,
+                         const struct broker_msg_props *props)
+{
+    int mid;
+    int res;
+
+    if (broker_journal != NULL && (broker_state != BROKER_CONNECTED || broker_journal->count > 0)) {
+        res = journal_append(broker_journal, topic, payload, len, qos);
+    } else if (broker_state != BROKER_CONNECTED) {
+        res = -1;
+    } else {
+        res = broker_send(mosq, &mid, topic, payload, len, qos, props);
+        if (res == 0) {
+            broker_last_mid = mid;
+        } else {
+            syslog(LOG_ERR, "Cannot publish topic %s: %s\n", topic, mosquitto_strerror(res));
+            if (broker_journal != NULL)
+                res = journal_append(broker_journal, topic, payload, len, qos);
+        }
+    }
+
+    if (res != 0)
+        broker_failures++;
+
+    broker_update_events(mosq);
+
+    return res;
+}
+
+/**
+ * @brief Publish a binary message with MQTT v5 properties to MQTT broker.
  * @param mosq Mosquitto instance.
  * @param topic_prefix Topic prefix. May be NULL.
  * @param topic_suffix Topic suffix. May be NULL.
  * @param payload Payload.
+ * @param len Length of payload.
  * @param qos QOS.
+ * @param props MQTT v5 properties. May be NULL.
  * @return 0 on success, -1 on failure.
  * @note topic_prefix and topic_suffix cannot be both NULL.
+ * @note See broker_publish_topic().
  */
 
-int broker_publish(struct mosquitto *mosq, const char *topic_prefix, const char *topic_suffix, const void *payload, int qos)
+int broker_publish_props(struct mosquitto *mosq, const char *topic_prefix, const char *topic_suffix, const void *payload, int len, int qos,
+                         const struct broker_msg_props *props)
 {
     char topic[TOPIC_MAXLEN + 1];
-    int res;
 
     if (topic_prefix != NULL) {
         if (topic_suffix != NULL) {
@@ -137,9 +684,51 @@ int broker_publish(struct mosquitto *mosq, const char *topic_prefix, const char
         }
     }
 
-    res = mosquitto_publish(mosq, NULL, topic, strlen(payload), payload, qos, 1);
-    if (res != 0)
-        syslog(LOG_ERR, "Cannot publish topic %s: %s\n", topic, mosquitto_strerror(res));
+    return broker_publish_topic(mosq, topic, payload, len, qos, props);
+}
 
-    return res;
+/**
+ * @brief Publish a binary message to MQTT broker.
+ * @param mosq Mosquitto instance.
+ * @param topic_prefix Topic prefix. May be NULL.
+ * @param topic_suffix Topic suffix. May be NULL.
+ * @param payload Payload.
+ * @param len Length of payload.
+ * @param qos QOS.
+ * @return 0 on success, -1 on failure.
+ * @note See broker_publish_props().
+ */
+
+int broker_publish_len(struct mosquitto *mosq, const char *topic_prefix, const char *topic_suffix, const void *payload, int len, int qos)
+{
+    return broker_publish_props(mosq, topic_prefix, topic_suffix, payload, len, qos, NULL);
+}
+
+/**
+ * @brief Publish a message to MQTT broker.
+ * @param mosq Mosquitto instance.
+ * @param topic_prefix Topic prefix. May be NULL.
+ * @param topic_suffix Topic suffix. May be NULL.
+ * @param payload Payload, NUL terminated.
+ * @param qos QOS.
+ * @return 0 on success, -1 on failure.
+ * @note See broker_publish_props().
+ */
+
+int broker_publish(struct mosquitto *mosq, const char *topic_prefix, const char *topic_suffix, const void *payload, int qos)
+{
+    return broker_publish_len(mosq, topic_prefix, topic_suffix, payload, strlen(payload), qos);
+}
+
+/**
+ * @brief Get publication statistics.
+ * @param mosq Mosquitto instance.
+ * @param stats Filled with statistics.
+ */
+
+void broker_get_stats(struct mosquitto *mosq, struct broker_stats *stats)
+{
+    stats->failures = broker_failures;
+    stats->queued = broker_journal != NULL ? broker_journal->count : 0;
+    stats->want_write = mosq != NULL && mosquitto_want_write(mosq);
 }
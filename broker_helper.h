@@ -3,8 +3,49 @@
 
 #define TOPIC_MAXLEN 255
 
+struct event_loop;
+struct journal;
+struct mosquitto;
+
+/* Called each time the broker acknowledges the connection. */
+
+typedef void (*broker_connect_cb)(struct mosquitto *mosq, void *userdata);
+
+/* Called each time a message is acknowledged (QoS 1 or 2) or written (QoS 0). */
+
+typedef void (*broker_publish_cb)(struct mosquitto *mosq, int mid, void *userdata);
+
+/* MQTT v5 properties of a message, ignored with MQTT 3.1.1. */
+
+struct broker_msg_props {
+    int alias;             // Publish through a topic alias, if the broker grants enough of them.
+    unsigned int expiry;   // Message expiry interval (s), 0 for none.
+    const char *timestamp; // Value of user property "ts", NULL for none.
+};
+
+/* Publication statistics. */
+
+struct broker_stats {
+    unsigned long failures; // Messages that could not be sent nor journaled.
+    unsigned long queued;   // Messages waiting in journal.
+    int want_write;         // Set while libmosquitto has packets to write.
+};
+
 extern struct mosquitto *broker_open(const char *host, int port, int keepalive);
+extern void broker_set_journal(struct journal *journal);
+extern void broker_set_mqtt5(int enable);
+extern void broker_set_connect_cb(broker_connect_cb cb, void *userdata);
+extern void broker_set_publish_cb(broker_publish_cb cb, void *userdata);
+extern int broker_get_last_mid(void);
+extern void broker_attach(struct mosquitto *mosq, struct event_loop *loop);
+extern void broker_misc(struct mosquitto *mosq);
 extern void broker_close(struct mosquitto *mosq);
+extern void broker_get_stats(struct mosquitto *mosq, struct broker_stats *stats);
 extern int broker_publish(struct mosquitto *mosq, const char *topic_prefix, const char *topic_suffix, const void *payload, int qos);
+extern int broker_publish_len(struct mosquitto *mosq, const char *topic_prefix, const char *topic_suffix, const void *payload, int len, int qos);
+extern int broker_publish_topic(struct mosquitto *mosq, const char *topic, const void *payload, int len, int qos,
+                                const struct broker_msg_props *props);
+extern int broker_publish_props(struct mosquitto *mosq, const char *topic_prefix, const char *topic_suffix, const void *payload, int len, int qos,
+                                const struct broker_msg_props *props);
 
 #endif /* __BROKER_HELPER_H__ */
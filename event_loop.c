@@ -0,0 +1,233 @@
+#include <errno.h>
+#include <signal.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <syslog.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/signalfd.h>
+#include <sys/timerfd.h>
+
+#include "event_loop.h"
+
+/**
+ * @brief Create event loop.
+ * @param loop Event loop.
+ * @return 0 on success, -1 on failure.
+ */
+
+int event_loop_init(struct event_loop *loop)
+{
+    loop->running = 0;
+    loop->npending = 0;
+
+    loop->epfd = epoll_create1(EPOLL_CLOEXEC);
+    if (loop->epfd < 0) {
+        syslog(LOG_ERR, "Cannot create epoll instance: %s", strerror(errno));
+        return -1;
+    }
+
+    return 0;
+}
+
+/**
+ * @brief Destroy event loop.
+ * @param loop Event loop.
+ */
+
+void event_loop_close(struct event_loop *loop)
+{
+    if (loop->epfd >= 0)
+        close(loop->epfd);
+    loop->epfd = -1;
+}
+
+/**
+ * @brief Watch a file descriptor.
+ * @param loop Event loop.
+ * @param src Event source. fd, events and handler must be set.
+ * @return 0 on success, -1 on failure.
+ */
+
+int event_loop_add(struct event_loop *loop, struct event_source *src)
+{
+    struct epoll_event ev = { .events = src->events, .data.ptr = src };
+
+    if (epoll_ctl(loop->epfd, EPOLL_CTL_ADD, src->fd, &ev) < 0) {
+        syslog(LOG_ERR, "Cannot watch fd %d: %s", src->fd, strerror(errno));
+        return -1;
+    }
+
+    return 0;
+}
+
+/**
+ * @brief Change watched events of a file descriptor.
+ * @param loop Event loop.
+ * @param src Event source.
+ * @param events New events.
+ * @return 0 on success, -1 on failure.
+ * @note No system call is made if events do not change.
+ */
+
+int event_loop_mod(struct event_loop *loop, struct event_source *src, uint32_t events)
+{
+    struct epoll_event ev = { .events = events, .data.ptr = src };
+
+    if (events == src->events)
+        return 0;
+
+    if (epoll_ctl(loop->epfd, EPOLL_CTL_MOD, src->fd, &ev) < 0) {
+        syslog(LOG_ERR, "Cannot modify fd %d: %s", src->fd, strerror(errno));
+        return -1;
+    }
+
+    src->events = events;
+    return 0;
+}
+
+/**
+ * @brief Stop watching a file descriptor.
+ * @param loop Event loop.
+ * @param src Event source.
+ * @return 0 on success, -1 on failure.
+ * @note Events of src not dispatched yet are dropped, so that src may be freed by a handler.
+ */
+
+int event_loop_del(struct event_loop *loop, struct event_source *src)
+{
+    int i;
+
+    for (i = 0; i < loop->npending; i++) {
+        if (loop->pending[i].data.ptr == src)
+            loop->pending[i].data.ptr = NULL;
+    }
+
+    if (epoll_ctl(loop->epfd, EPOLL_CTL_DEL, src->fd, NULL) < 0 && errno != EBADF) {
+        syslog(LOG_ERR, "Cannot unwatch fd %d: %s", src->fd, strerror(errno));
+        return -1;
+    }
+
+    return 0;
+}
+
+/**
+ * @brief Dispatch events until event_loop_stop() is called.
+ * @param loop Event loop.
+ * @return 0 on success, -1 on failure.
+ */
+
+int event_loop_run(struct event_loop *loop)
+{
+    loop->running = 1;
+
+    while (loop->running) {
+        int n;
+        int i;
+
+        n = epoll_wait(loop->epfd, loop->pending, EVENT_LOOP_MAX_EVENTS, -1);
+        if (n < 0) {
+            if (errno == EINTR)
+                continue;
+            syslog(LOG_ERR, "Cannot wait for events: %s", strerror(errno));
+            return -1;
+        }
+
+        loop->npending = n;
+        for (i = 0; i < n && loop->running; i++) {
+            struct event_source *src = loop->pending[i].data.ptr;
+
+            if (src != NULL)
+                src->handler(src, loop->pending[i].events);
+        }
+        loop->npending = 0;
+    }
+
+    return 0;
+}
+
+/**
+ * @brief Leave event_loop_run() after the current dispatch.
+ * @param loop Event loop.
+ */
+
+void event_loop_stop(struct event_loop *loop)
+{
+    loop->running = 0;
+}
+
+/**
+ * @brief Create a periodic timer.
+ * @param period_ms Period in milliseconds.
+ * @return File descriptor of timer, -1 on failure.
+ */
+
+int event_timer_open(unsigned int period_ms)
+{
+    struct itimerspec its;
+    int fd;
+
+    fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    if (fd < 0) {
+        syslog(LOG_ERR, "Cannot create timer: %s", strerror(errno));
+        return -1;
+    }
+
+    its.it_interval.tv_sec = period_ms / 1000;
+    its.it_interval.tv_nsec = (period_ms % 1000) * 1000000L;
+    its.it_value = its.it_interval;
+
+    if (timerfd_settime(fd, 0, &its, NULL) < 0) {
+        syslog(LOG_ERR, "Cannot arm timer: %s", strerror(errno));
+        close(fd);
+        return -1;
+    }
+
+    return fd;
+}
+
+/**
+ * @brief Acknowledge timer expirations.
+ * @param fd File descriptor of timer.
+ * @return Number of expirations since last call.
+ */
+
+int event_timer_ack(int fd)
+{
+    uint64_t expirations;
+
+    if (read(fd, &expirations, sizeof(expirations)) != sizeof(expirations))
+        return 0;
+
+    return expirations;
+}
+
+/**
+ * @brief Block signals and create a file descriptor to receive them.
+ * @param signums Signals to receive, terminated by 0.
+ * @return File descriptor of signalfd, -1 on failure.
+ */
+
+int event_signal_open(const int *signums)
+{
+    sigset_t mask;
+    int fd;
+
+    sigemptyset(&mask);
+    for (; *signums != 0; signums++)
+        sigaddset(&mask, *signums);
+
+    if (sigprocmask(SIG_BLOCK, &mask, NULL) < 0) {
+        syslog(LOG_ERR, "Cannot block signals: %s", strerror(errno));
+        return -1;
+    }
+
+    fd = signalfd(-1, &mask, SFD_NONBLOCK | SFD_CLOEXEC);
+    if (fd < 0) {
+        syslog(LOG_ERR, "Cannot create signalfd: %s", strerror(errno));
+        return -1;
+    }
+
+    return fd;
+}
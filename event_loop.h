@@ -0,0 +1,44 @@
+#ifndef __EVENT_LOOP_H__
+#define __EVENT_LOOP_H__ 1
+
+#include <stdint.h>
+
+#include <sys/epoll.h>
+
+#define EVENT_LOOP_MAX_EVENTS 8
+
+struct event_source;
+
+typedef void (*event_handler)(struct event_source *src, uint32_t events);
+
+/* File descriptor watched by the event loop. */
+
+struct event_source {
+    int fd;                // File descriptor.
+    uint32_t events;       // Watched events (EPOLLxxx).
+    event_handler handler; // Called when fd is ready.
+    void *userdata;        // User data for handler.
+};
+
+/* Single-threaded epoll event loop. */
+
+struct event_loop {
+    int epfd;                                          // epoll file descriptor.
+    int running;                                       // Cleared to leave event_loop_run().
+    struct epoll_event pending[EVENT_LOOP_MAX_EVENTS]; // Events being dispatched.
+    int npending;                                      // Number of events being dispatched.
+};
+
+extern int event_loop_init(struct event_loop *loop);
+extern void event_loop_close(struct event_loop *loop);
+extern int event_loop_add(struct event_loop *loop, struct event_source *src);
+extern int event_loop_mod(struct event_loop *loop, struct event_source *src, uint32_t events);
+extern int event_loop_del(struct event_loop *loop, struct event_source *src);
+extern int event_loop_run(struct event_loop *loop);
+extern void event_loop_stop(struct event_loop *loop);
+
+extern int event_timer_open(unsigned int period_ms);
+extern int event_timer_ack(int fd);
+extern int event_signal_open(const int *signums);
+
+#endif /* __EVENT_LOOP_H__ */
@@ -1,10 +1,36 @@
+#include <errno.h>
+#include <stdint.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 
+#include <mosquitto.h>
+#include <syslog.h>
+
 #include "broker_helper.h"
 #include "homie_helper.h"
 #include "tic2mqtt.h"
 
+#define HOMIE_DIGESTS_MAGIC 0x32534448 /* "HDS2" */
+
+/* Digest of the retained payload of a topic. */
+
+struct homie_digest {
+    uint64_t topic;   // Hash of topic.
+    uint64_t payload; // Hash of payload.
+};
+
+/* Set of digests of retained attributes, sorted by topic. */
+
+struct homie_digests {
+    struct homie_digest *digests; // Digests.
+    size_t count;                 // Number of digests.
+    size_t size;                  // Allocated number of digests.
+};
+
+static const char *homie_digests_path = NULL;
+static struct homie_digests homie_published; // Attributes known to be retained by broker, all devices.
+
 static const char * const homie_datatypes[] = {
     "integer",
     "float",
@@ -26,98 +52,291 @@ static const char *homie_get_datatype(int datatype)
 }
 
 /**
- * @brief Set Last Will and Testament.
+ * @brief Hash strings.
+ * @param parts Strings.
+ * @param count Number of strings.
+ * @return 64-bit FNV-1a hash of strings.
+ */
+
+static uint64_t homie_hash(const char * const *parts, int count)
+{
+    uint64_t hash = 0xcbf29ce484222325ULL;
+    const unsigned char *p;
+    int i;
+
+    for (i = 0; i < count; i++) {
+        // Include terminating NUL so that "ab" + "c" differs from "a" + "bc".
+        p = (const unsigned char *) parts[i];
+        do {
+            hash ^= *p;
+            hash *= 0x100000001b3ULL;
+        } while (*p++ != '\0');
+    }
+
+    return hash;
+}
+
+/**
+ * @brief Compare digests by topic, for qsort() and bsearch().
+ * @param a First digest.
+ * @param b Second digest.
+ * @return -1, 0 or 1.
+ */
+
+static int homie_digest_cmp(const void *a, const void *b)
+{
+    uint64_t ta = ((const struct homie_digest *) a)->topic;
+    uint64_t tb = ((const struct homie_digest *) b)->topic;
+
+    return (ta > tb) - (ta < tb);
+}
+
+/**
+ * @brief Add or replace the digest of a topic, keeping the set sorted.
+ * @param digest Digest.
+ * @return 0 on success, -1 on allocation failure.
+ */
+
+static int homie_digests_set(const struct homie_digest *digest)
+{
+    struct homie_digests *set = &homie_published;
+    struct homie_digest *digests;
+    size_t lo = 0;
+    size_t hi = set->count;
+    size_t mid;
+
+    while (lo < hi) {
+        mid = (lo + hi) / 2;
+        if (set->digests[mid].topic < digest->topic)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+
+    if (lo < set->count && set->digests[lo].topic == digest->topic) {
+        set->digests[lo].payload = digest->payload;
+        return 0;
+    }
+
+    if (set->count == set->size) {
+        digests = realloc(set->digests, (set->size ? set->size * 2 : 256) * sizeof(*digests));
+        if (digests == NULL)
+            return -1;
+        set->digests = digests;
+        set->size = set->size ? set->size * 2 : 256;
+    }
+
+    memmove(&set->digests[lo + 1], &set->digests[lo], (set->count - lo) * sizeof(*digests));
+    set->digests[lo] = *digest;
+    set->count++;
+    return 0;
+}
+
+/**
+ * @brief Save digests of retained attributes.
+ * @note The file is replaced atomically.
+ */
+
+static void homie_save_digests(void)
+{
+    uint32_t header[2] = { HOMIE_DIGESTS_MAGIC, homie_published.count };
+    char tmp[256];
+    FILE *fp;
+
+    snprintf(tmp, sizeof(tmp), "%s.tmp", homie_digests_path);
+    fp = fopen(tmp, "w");
+    if (fp == NULL ||
+        fwrite(header, sizeof(header), 1, fp) != 1 ||
+        fwrite(homie_published.digests, sizeof(struct homie_digest), homie_published.count, fp) != homie_published.count ||
+        fclose(fp) != 0 || rename(tmp, homie_digests_path) < 0) {
+        syslog(LOG_ERR, "Cannot save Homie digests to %s: %s", homie_digests_path, strerror(errno));
+    }
+}
+
+/**
+ * @brief Load digests of attributes retained by broker during a previous run.
+ * @param path Path of digests file. It is created or updated by homie_init().
+ * @note The broker is expected to keep retained messages across its restarts.
+ */
+
+void homie_load_digests(const char *path)
+{
+    uint32_t header[2] = { 0, 0 };
+    struct homie_digest digest;
+    FILE *fp;
+
+    homie_digests_path = path;
+    homie_published.count = 0;
+
+    fp = fopen(path, "r");
+    if (fp == NULL)
+        return;
+
+    if (fread(header, sizeof(header), 1, fp) == 1 && header[0] == HOMIE_DIGESTS_MAGIC) {
+        while (homie_published.count < header[1] && fread(&digest, sizeof(digest), 1, fp) == 1) {
+            if (homie_digests_set(&digest) < 0)
+                break;
+        }
+    }
+    if (homie_published.count != header[1])
+        homie_published.count = 0;
+
+    fclose(fp);
+}
+
+/**
+ * @brief Forget which attributes are retained by broker, so that homie_init() publishes all of them.
+ * @note To be called when the broker may have lost its retained messages, e.g. after a reconnection.
+ */
+
+void homie_forget(void)
+{
+    homie_published.count = 0;
+}
+
+/**
+ * @brief Publish an attribute, unless the broker already retains it.
+ * @param mosq Mosquitto instance.
+ * @param topic_prefix Topic prefix.
+ * @param topic_suffix Topic suffix.
+ * @param payload Payload.
+ * @return 1 if published, 0 if skipped or failed.
+ */
+
+static int homie_publish(struct mosquitto *mosq, const char *topic_prefix, const char *topic_suffix, const char *payload)
+{
+    const char * const topic[] = { topic_prefix, topic_suffix };
+    struct homie_digest digest = { homie_hash(topic, 2), homie_hash(&payload, 1) };
+    const struct homie_digest *known;
+
+    known = bsearch(&digest, homie_published.digests, homie_published.count, sizeof(digest), homie_digest_cmp);
+    if (known != NULL && known->payload == digest.payload)
+        return 0;
+
+    if (broker_publish(mosq, topic_prefix, topic_suffix, payload, tic_qos) != 0)
+        return 0;
+
+    homie_digests_set(&digest);
+    return 1;
+}
+
+/**
+ * @brief Set Last Will and Testament of a device.
  * @param mosq Mosquitto instance.
+ * @param device_id Device id.
+ * @note The broker connection has a single will, so only one device can be reported lost.
  */
 
-static void homie_set_will(struct mosquitto *mosq)
+void homie_set_will(struct mosquitto *mosq, const char *device_id)
 {
     char topic[TOPIC_MAXLEN + 1];
 
-    sprintf(topic, "%s%s/$state", HOMIE_BASE_TOPIC, HOMIE_DEVICE_ID);
+    sprintf(topic, "%s%s/$state", HOMIE_BASE_TOPIC, device_id);
     mosquitto_will_set(mosq, topic, strlen("lost"), "lost", 2, 1);
 }
 
 /**
- * @brief Initialize connection to broker using Homie convention.
+ * @brief Publish a device using Homie convention.
  * @param mosq Mosquitto instance.
- * @param attrs Property attributes for 'tic' node.
+ * @param device_id Device id.
+ * @param attrs Property attributes for 'tic' node, terminated by NULL.
  */
 
-void homie_init(struct mosquitto *mosq, const struct homie_prop_attrs *attrs)
+void homie_init(struct mosquitto *mosq, const char *device_id, const struct homie_prop_attrs * const *attrs)
 {
     char topic_prefix[TOPIC_MAXLEN + 1];
+    const struct homie_prop_attrs * const *ppattrs;
     const struct homie_prop_attrs *pattrs;
-    char payload[1024 + 1];
+    const char * const *value;
+    char *payload;
+    size_t size = 1;
+    int count = 0;
 
-    homie_set_will(mosq);
+    // Comma separated lists are built in a buffer large enough for all of them.
+    for (ppattrs = attrs; *ppattrs != NULL; ppattrs++) {
+        size += strlen((*ppattrs)->prop_id) + 1;
+        if ((*ppattrs)->datatype == HOMIE_ENUM) {
+            for (value = (*ppattrs)->values; *value != NULL; value++)
+                size += strlen(*value) + 1;
+        }
+    }
+    payload = malloc(size);
+    if (payload == NULL) {
+        syslog(LOG_ERR, "Cannot publish Homie device %s: %s", device_id, strerror(errno));
+        return;
+    }
 
     // -- Device part.
 
-    sprintf(topic_prefix, "%s%s/", HOMIE_BASE_TOPIC, HOMIE_DEVICE_ID);
+    sprintf(topic_prefix, "%s%s/", HOMIE_BASE_TOPIC, device_id);
 
-    // Mandatory device attributes.
-    broker_publish(mosq, topic_prefix, "$homie", HOMIE_DEVICE_CONVENTION_VERSION, TIC_QOS);
-    broker_publish(mosq, topic_prefix, "$name", HOMIE_DEVICE_NAME, TIC_QOS);
-    broker_publish(mosq, topic_prefix, "$state", "ready", TIC_QOS);
-    broker_publish(mosq, topic_prefix, "$nodes", HOMIE_DEVICE_ID, TIC_QOS);
-    broker_publish(mosq, topic_prefix, "$extensions", HOMIE_DEVICE_EXTENSIONS, TIC_QOS);
+    // Mandatory device attributes. $state is always published, as the will changes it.
+    count += homie_publish(mosq, topic_prefix, "$homie", HOMIE_DEVICE_CONVENTION_VERSION);
+    count += homie_publish(mosq, topic_prefix, "$name", HOMIE_DEVICE_NAME);
+    broker_publish(mosq, topic_prefix, "$state", "ready", tic_qos);
+    count += homie_publish(mosq, topic_prefix, "$nodes", HOMIE_DEVICE_NODES);
+    count += homie_publish(mosq, topic_prefix, "$extensions", HOMIE_DEVICE_EXTENSIONS);
 
     // Optional device attributes.
-    broker_publish(mosq, topic_prefix, "$implementation", HOMIE_DEVICE_IMPLEMENTATION, TIC_QOS);
+    count += homie_publish(mosq, topic_prefix, "$implementation", HOMIE_DEVICE_IMPLEMENTATION);
 
     // -- Node part.
 
-    sprintf(topic_prefix, "%s%s/%s/", HOMIE_BASE_TOPIC, HOMIE_DEVICE_ID, HOMIE_NODE_ID);
+    sprintf(topic_prefix, "%s%s/%s/", HOMIE_BASE_TOPIC, device_id, HOMIE_NODE_ID);
 
     // Mandatory node attributes.
-    broker_publish(mosq, topic_prefix, "$name", HOMIE_NODE_NAME, TIC_QOS);
-    broker_publish(mosq, topic_prefix, "$type", HOMIE_NODE_TYPE, TIC_QOS);
+    count += homie_publish(mosq, topic_prefix, "$name", HOMIE_NODE_NAME);
+    count += homie_publish(mosq, topic_prefix, "$type", HOMIE_NODE_TYPE);
 
-    for (pattrs = attrs, payload[0] = '\0'; pattrs->prop_id != NULL; pattrs++) {
-        if (pattrs > attrs)
+    for (ppattrs = attrs, payload[0] = '\0'; *ppattrs != NULL; ppattrs++) {
+        if (ppattrs > attrs)
             strcat(payload, ",");
-        strcat(payload, pattrs->prop_id);
+        strcat(payload, (*ppattrs)->prop_id);
     }
 
-    broker_publish(mosq, topic_prefix, "$properties", payload, TIC_QOS);
+    count += homie_publish(mosq, topic_prefix, "$properties", payload);
 
     // -- Properties part.
 
-    for (pattrs = attrs; pattrs->prop_id != NULL; pattrs++) {
-        sprintf(topic_prefix, "%s%s/%s/%s/", HOMIE_BASE_TOPIC, HOMIE_DEVICE_ID, HOMIE_NODE_ID, pattrs->prop_id);
+    for (ppattrs = attrs; *ppattrs != NULL; ppattrs++) {
+        pattrs = *ppattrs;
+        sprintf(topic_prefix, "%s%s/%s/%s/", HOMIE_BASE_TOPIC, device_id, HOMIE_NODE_ID, pattrs->prop_id);
 
         // Mandatory property attributes.
-        broker_publish(mosq, topic_prefix, "$name", pattrs->name, TIC_QOS);
-        broker_publish(mosq, topic_prefix, "$datatype", homie_get_datatype(pattrs->datatype), TIC_QOS);
+        count += homie_publish(mosq, topic_prefix, "$name", pattrs->name);
+        count += homie_publish(mosq, topic_prefix, "$datatype", homie_get_datatype(pattrs->datatype));
 
         // Optional property attributes.
-        broker_publish(mosq, topic_prefix, "$unit", pattrs->unit, TIC_QOS);
+        count += homie_publish(mosq, topic_prefix, "$unit", pattrs->unit);
 
         if (pattrs->datatype == HOMIE_ENUM) {
-            const char * const *value;
-
             for (value = pattrs->values, payload[0] = '\0'; *value != NULL; value++) {
                 if (value > pattrs->values)
                     strcat(payload, ",");
                 strcat(payload, *value);
             }
 
-            broker_publish(mosq, topic_prefix, "$format", payload, TIC_QOS);
+            count += homie_publish(mosq, topic_prefix, "$format", payload);
         }
     }
+
+    free(payload);
+
+    if (homie_digests_path != NULL && count > 0)
+        homie_save_digests();
 }
 
 /**
- * @brief Close connection to broker using Homie convention.
+ * @brief Report a device disconnected using Homie convention.
  * @param mosq Mosquitto instance.
+ * @param device_id Device id.
  */
 
-void homie_close(struct mosquitto *mosq)
+void homie_close(struct mosquitto *mosq, const char *device_id)
 {
     char topic_prefix[TOPIC_MAXLEN + 1];
 
-    sprintf(topic_prefix, "%s%s/", HOMIE_BASE_TOPIC, HOMIE_DEVICE_ID);
+    sprintf(topic_prefix, "%s%s/", HOMIE_BASE_TOPIC, device_id);
 
-    broker_publish(mosq, topic_prefix, "$state", "disconnected", TIC_QOS);
+    broker_publish(mosq, topic_prefix, "$state", "disconnected", tic_qos);
 }
@@ -1,11 +1,11 @@
 #ifndef __HOMIE_HELPER_H__
 #define __HOMIE_HELPER_H__ 1
 
-#include <mosquitto.h>
+struct mosquitto;
 
 #define HOMIE_BASE_TOPIC "homie/"
 
-#define HOMIE_DEVICE_ID                 "linky"
+#define HOMIE_DEVICE_ID                 "linky" /* Default device id, prefix of ids derived from meter serial number. */
 #define HOMIE_DEVICE_CONVENTION_VERSION "3.0.0"
 #define HOMIE_DEVICE_NAME               "Linky"
 #define HOMIE_DEVICE_EXTENSIONS         ""
@@ -35,7 +35,10 @@ struct homie_prop_attrs {
     const char * const *values; // Enumeration of all valid payloads (datatype == HOMIE_ENUM).
 };
 
-extern void homie_init(struct mosquitto *mosq, const struct homie_prop_attrs *attrs);
-extern void homie_close(struct mosquitto *mosq);
+extern void homie_load_digests(const char *path);
+extern void homie_forget(void);
+extern void homie_set_will(struct mosquitto *mosq, const char *device_id);
+extern void homie_init(struct mosquitto *mosq, const char *device_id, const struct homie_prop_attrs * const *attrs);
+extern void homie_close(struct mosquitto *mosq, const char *device_id);
 
 #endif /* __HOMIE_HELPER_H__ */
@@ -0,0 +1,426 @@
+#include <errno.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <fcntl.h>
+#include <syslog.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "journal.h"
+
+#define JOURNAL_MAGIC   0x4c4e524a /* "JRNL" */
+#define JOURNAL_VERSION 1
+
+#define JOURNAL_ALIGN(n) (((n) + 7) & ~(size_t) 7)
+
+/*
+ * Positions pack the sequence number of a message with its offset in the
+ * data area, so that both are updated by a single 64-bit store.
+ */
+
+#define JOURNAL_POS(seq, offset) (((uint64_t) (seq) << 32) | (uint32_t) (offset))
+#define JOURNAL_SEQ(pos)         ((uint32_t) ((pos) >> 32))
+#define JOURNAL_OFFSET(pos)      ((uint32_t) (pos))
+
+/* Header at the start of the journal file. */
+
+struct journal_header {
+    uint32_t magic;   // JOURNAL_MAGIC.
+    uint32_t version; // JOURNAL_VERSION.
+    uint64_t size;    // Size of data area.
+    uint64_t head;    // Position of oldest message.
+    uint64_t tail;    // Position of next message.
+    uint64_t dropped; // Number of messages dropped because journal was full.
+    uint64_t reserved[3];
+};
+
+/* Message record in data area, followed by topic and payload, both NUL terminated. */
+
+struct journal_record {
+    uint32_t len;         // Length of record, multiple of 8. 0 marks a wrap to the start of data area.
+    uint32_t seq;         // Sequence number.
+    uint32_t crc;         // CRC-32 of record, computed with crc set to 0.
+    uint16_t topic_len;   // Length of topic.
+    uint8_t qos;          // QOS.
+    uint8_t reserved;
+    uint32_t payload_len; // Length of payload.
+    uint32_t reserved2;
+};
+
+/**
+ * @brief Compute CRC-32 (IEEE 802.3) of a buffer.
+ * @param buf Buffer.
+ * @param len Length of buffer.
+ * @return CRC-32.
+ */
+
+static uint32_t journal_crc32(const unsigned char *buf, size_t len)
+{
+    uint32_t crc = 0xffffffff;
+    int bit;
+
+    while (len-- > 0) {
+        crc ^= *buf++;
+        for (bit = 0; bit < 8; bit++)
+            crc = (crc >> 1) ^ (0xedb88320 & -(crc & 1));
+    }
+
+    return ~crc;
+}
+
+/**
+ * @brief Compute CRC-32 of a record.
+ * @param rec Record.
+ * @return CRC-32.
+ */
+
+static uint32_t journal_record_crc(const struct journal_record *rec)
+{
+    struct journal_record tmp = *rec;
+    uint32_t crc;
+
+    tmp.crc = 0;
+    crc = journal_crc32((const unsigned char *) &tmp, sizeof(tmp));
+    return crc ^ journal_crc32((const unsigned char *) (rec + 1), rec->len - sizeof(*rec));
+}
+
+/**
+ * @brief Skip wrap marker.
+ * @param journal Journal.
+ * @param offset Offset in data area.
+ * @return Offset of the record following offset.
+ */
+
+static uint32_t journal_skip_wrap(const struct journal *journal, uint32_t offset)
+{
+    const struct journal_record *rec = (const struct journal_record *) (journal->data + offset);
+
+    if (offset >= journal->size || rec->len == 0)
+        return 0;
+
+    return offset;
+}
+
+/**
+ * @brief Get a valid record.
+ * @param journal Journal.
+ * @param offset Offset in data area.
+ * @param seq Expected sequence number.
+ * @return Record, NULL if there is no valid record with this sequence number at offset.
+ */
+
+static const struct journal_record *journal_record_at(const struct journal *journal, uint32_t offset, uint32_t seq)
+{
+    const struct journal_record *rec = (const struct journal_record *) (journal->data + offset);
+
+    if (journal->size - offset < sizeof(*rec))
+        return NULL;
+    if (rec->len < sizeof(*rec) || rec->len > journal->size - offset || (rec->len & 7) != 0)
+        return NULL;
+    if (rec->seq != seq || sizeof(*rec) + rec->topic_len + 1 + rec->payload_len + 1 > rec->len)
+        return NULL;
+    if (journal_record_crc(rec) != rec->crc)
+        return NULL;
+
+    return rec;
+}
+
+/**
+ * @brief Find messages in journal after opening it.
+ * @param journal Journal.
+ * @note The tail is found again by following records from the head, so that a
+ *       message written just before a crash is kept, and a torn one is dropped.
+ */
+
+static void journal_recover(struct journal *journal)
+{
+    struct journal_header *header = journal->header;
+    const struct journal_record *rec;
+    uint32_t offset = JOURNAL_OFFSET(header->head);
+    uint32_t seq = JOURNAL_SEQ(header->head);
+
+    journal->count = 0;
+
+    for (;;) {
+        rec = journal_record_at(journal, offset, seq);
+        if (rec == NULL && journal->count > 0 && offset != 0) {
+            // The next message may follow a wrap marker.
+            rec = journal_record_at(journal, 0, seq);
+            if (rec != NULL)
+                offset = 0;
+        }
+        if (rec == NULL)
+            break;
+
+        journal->count++;
+        seq++;
+        offset += rec->len;
+        if (offset == journal->size)
+            offset = 0;
+    }
+
+    header->tail = JOURNAL_POS(seq, offset);
+}
+
+/**
+ * @brief Open journal, creating it if needed.
+ * @param journal Journal.
+ * @param path Path of journal file.
+ * @param size Size of data area, in bytes.
+ * @return 0 on success, -1 on failure.
+ * @note Messages left in an existing journal of the same size are kept.
+ */
+
+int journal_open(struct journal *journal, const char *path, size_t size)
+{
+    struct journal_header *header;
+    struct stat st;
+    size_t file_size;
+    void *map;
+
+    size = JOURNAL_ALIGN(size < JOURNAL_SIZE_MIN ? JOURNAL_SIZE_MIN : size);
+    if (size > UINT32_MAX)
+        size = UINT32_MAX & ~(size_t) 7;
+    file_size = sizeof(*header) + size;
+
+    journal->fd = open(path, O_RDWR | O_CREAT | O_CLOEXEC, 0600);
+    if (journal->fd < 0) {
+        syslog(LOG_ERR, "Cannot open journal %s: %s", path, strerror(errno));
+        return -1;
+    }
+
+    if (fstat(journal->fd, &st) < 0 || (st.st_size != file_size && ftruncate(journal->fd, file_size) < 0)) {
+        syslog(LOG_ERR, "Cannot size journal %s: %s", path, strerror(errno));
+        close(journal->fd);
+        return -1;
+    }
+
+    map = mmap(NULL, file_size, PROT_READ | PROT_WRITE, MAP_SHARED, journal->fd, 0);
+    if (map == MAP_FAILED) {
+        syslog(LOG_ERR, "Cannot map journal %s: %s", path, strerror(errno));
+        close(journal->fd);
+        return -1;
+    }
+
+    journal->header = header = map;
+    journal->data = (unsigned char *) map + sizeof(*header);
+    journal->size = size;
+
+    if (header->magic != JOURNAL_MAGIC || header->version != JOURNAL_VERSION || header->size != size ||
+        JOURNAL_OFFSET(header->head) >= size) {
+        if (header->magic != 0)
+            syslog(LOG_WARNING, "Journal %s is invalid or resized: reset", path);
+        memset(header, 0, sizeof(*header));
+        header->version = JOURNAL_VERSION;
+        header->size = size;
+        header->magic = JOURNAL_MAGIC;
+    }
+
+    journal_recover(journal);
+    if (journal->count > 0)
+        syslog(LOG_INFO, "Journal %s holds %lu messages", path, journal->count);
+
+    return 0;
+}
+
+/**
+ * @brief Close journal.
+ * @param journal Journal.
+ */
+
+void journal_close(struct journal *journal)
+{
+    if (journal->header == NULL)
+        return;
+
+    msync(journal->header, sizeof(*journal->header) + journal->size, MS_SYNC);
+    munmap(journal->header, sizeof(*journal->header) + journal->size);
+    close(journal->fd);
+    journal->header = NULL;
+}
+
+/**
+ * @brief Find room for a record at tail.
+ * @param journal Journal.
+ * @param len Length of record.
+ * @param offset Set to offset of record.
+ * @return 1 if there is room, 0 if the oldest message must be dropped.
+ */
+
+static int journal_find_room(struct journal *journal, uint32_t len, uint32_t *offset)
+{
+    uint32_t head = JOURNAL_OFFSET(journal->header->head);
+    uint32_t tail = JOURNAL_OFFSET(journal->header->tail);
+
+    if (journal->count > 0 && tail <= head) {
+        // Used area wraps: free area is between tail and head.
+        *offset = tail;
+        return head - tail >= len;
+    }
+
+    if (journal->size - tail >= len) {
+        *offset = tail;
+        return 1;
+    }
+
+    // Wrap to the start of data area.
+    *offset = 0;
+    return journal->count == 0 || head >= len;
+}
+
+/**
+ * @brief Append a message to journal.
+ * @param journal Journal.
+ * @param topic Topic.
+ * @param payload Payload.
+ * @param payload_len Length of payload.
+ * @param qos QOS.
+ * @return 0 on success, -1 if message is too large.
+ * @note The oldest messages are dropped when the journal is full.
+ */
+
+int journal_append(struct journal *journal, const char *topic, const void *payload, int payload_len, int qos)
+{
+    struct journal_header *header = journal->header;
+    struct journal_record *rec;
+    size_t topic_len = strlen(topic);
+    size_t len = JOURNAL_ALIGN(sizeof(*rec) + topic_len + 1 + payload_len + 1);
+    uint32_t seq = JOURNAL_SEQ(header->tail);
+    uint32_t tail = JOURNAL_OFFSET(header->tail);
+    uint32_t offset;
+    char *p;
+
+    if (len > journal->size || topic_len > UINT16_MAX) {
+        syslog(LOG_ERR, "Message too large for journal: %s", topic);
+        return -1;
+    }
+
+    if (journal->count == 0) {
+        // Restart from the start of data area.
+        header->head = header->tail = JOURNAL_POS(seq, 0);
+        tail = 0;
+    }
+
+    while (!journal_find_room(journal, len, &offset)) {
+        journal_drop(journal);
+        if (journal->count == 0) {
+            // Emptied: restart from the start of data area, as a wrap marker would be read as a record.
+            header->head = header->tail = JOURNAL_POS(seq, 0);
+            tail = 0;
+        }
+    }
+
+    if (offset != tail)
+        ((struct journal_record *) (journal->data + tail))->len = 0;
+
+    rec = (struct journal_record *) (journal->data + offset);
+    memset(rec, 0, len);
+    rec->len = len;
+    rec->seq = seq;
+    rec->topic_len = topic_len;
+    rec->qos = qos;
+    rec->payload_len = payload_len;
+    p = (char *) (rec + 1);
+    memcpy(p, topic, topic_len + 1);
+    memcpy(p + topic_len + 1, payload, payload_len);
+    rec->crc = journal_record_crc(rec);
+
+    // Commit message.
+    offset += len;
+    if (offset == journal->size)
+        offset = 0;
+    header->tail = JOURNAL_POS(seq + 1, offset);
+    journal->count++;
+
+    return 0;
+}
+
+/**
+ * @brief Get oldest message of journal.
+ * @param journal Journal.
+ * @param msg Filled with message.
+ * @return 0 on success, -1 if journal is empty.
+ */
+
+int journal_peek(struct journal *journal, struct journal_msg *msg)
+{
+    const struct journal_record *rec;
+    const char *p;
+
+    if (journal->count == 0)
+        return -1;
+
+    rec = (const struct journal_record *) (journal->data + JOURNAL_OFFSET(journal->header->head));
+    p = (const char *) (rec + 1);
+
+    msg->topic = p;
+    msg->payload = p + rec->topic_len + 1;
+    msg->payload_len = rec->payload_len;
+    msg->qos = rec->qos;
+
+    return 0;
+}
+
+/**
+ * @brief Remove oldest message of journal.
+ * @param journal Journal.
+ */
+
+void journal_pop(struct journal *journal)
+{
+    struct journal_header *header = journal->header;
+    const struct journal_record *rec;
+    uint32_t offset = JOURNAL_OFFSET(header->head);
+
+    if (journal->count == 0)
+        return;
+
+    rec = (const struct journal_record *) (journal->data + offset);
+    offset += rec->len;
+    if (offset == journal->size)
+        offset = 0;
+
+    journal->count--;
+    if (journal->count > 0)
+        offset = journal_skip_wrap(journal, offset);
+
+    header->head = JOURNAL_POS(JOURNAL_SEQ(header->head) + 1, offset);
+}
+
+/**
+ * @brief Remove oldest message of journal and count it as dropped.
+ * @param journal Journal.
+ */
+
+void journal_drop(struct journal *journal)
+{
+    if (journal->count == 0)
+        return;
+
+    journal_pop(journal);
+    journal->header->dropped++;
+}
+
+/**
+ * @brief Schedule write back of journal to disk.
+ * @param journal Journal.
+ */
+
+void journal_sync(struct journal *journal)
+{
+    if (journal->header != NULL)
+        msync(journal->header, sizeof(*journal->header) + journal->size, MS_ASYNC);
+}
+
+/**
+ * @brief Get number of messages dropped because journal was full or they could not be sent.
+ * @param journal Journal.
+ * @return Number of messages dropped since journal was created.
+ */
+
+unsigned long journal_dropped(const struct journal *journal)
+{
+    return journal->header->dropped;
+}
@@ -0,0 +1,39 @@
+#ifndef __JOURNAL_H__
+#define __JOURNAL_H__ 1
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define JOURNAL_SIZE_MIN 4096
+
+struct journal_header;
+
+/* Persistent ring of messages waiting for the broker, mapped from a file. */
+
+struct journal {
+    int fd;                        // Journal file.
+    size_t size;                   // Size of data area.
+    struct journal_header *header; // Mapped file: header, then data area.
+    unsigned char *data;           // Data area.
+    unsigned long count;           // Number of messages in journal.
+};
+
+/* Message read from journal. Pointers are valid until the message is popped. */
+
+struct journal_msg {
+    const char *topic;   // Topic, NUL terminated.
+    const void *payload; // Payload, NUL terminated.
+    int payload_len;     // Length of payload.
+    int qos;             // QOS.
+};
+
+extern int journal_open(struct journal *journal, const char *path, size_t size);
+extern void journal_close(struct journal *journal);
+extern int journal_append(struct journal *journal, const char *topic, const void *payload, int payload_len, int qos);
+extern int journal_peek(struct journal *journal, struct journal_msg *msg);
+extern void journal_pop(struct journal *journal);
+extern void journal_drop(struct journal *journal);
+extern void journal_sync(struct journal *journal);
+extern unsigned long journal_dropped(const struct journal *journal);
+
+#endif /* __JOURNAL_H__ */
@@ -0,0 +1,100 @@
+/*
+ * Generate the perfect hash table of TIC tags described in tic_tags.def.
+ *
+ * Usage: mktagtab -h > tic_tagtab.h
+ *        mktagtab > tic_tagtab.c
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "tic_hash.h"
+
+#define TAGTAB_BITS 9
+#define TAGTAB_SIZE (1 << TAGTAB_BITS)
+#define SEED_MAX 10000000
+
+#define TIC_TAG(label, len, mode, prop_id, datatype, unit, values, filter, name) label,
+
+static const char * const labels[] = {
+#include "tic_tags.def"
+};
+
+#define LABEL_COUNT (sizeof(labels) / sizeof(labels[0]))
+
+/**
+ * @brief Try to place all labels with seed.
+ * @param seed Seed.
+ * @param slots Table to fill: label index + 1, 0 for empty slot.
+ * @return 1 if there is no collision, 0 else.
+ */
+
+static int try_seed(uint32_t seed, unsigned char *slots)
+{
+    size_t i;
+
+    memset(slots, 0, TAGTAB_SIZE);
+
+    for (i = 0; i < LABEL_COUNT; i++) {
+        uint32_t slot = tic_tag_hash(labels[i], strlen(labels[i]), seed) & (TAGTAB_SIZE - 1);
+
+        if (slots[slot] != 0)
+            return 0;
+        slots[slot] = i + 1;
+    }
+
+    return 1;
+}
+
+/**
+ * @brief Program entry point.
+ * @param argc Argument count.
+ * @param argv Argument vector.
+ * @return If successful, EXIT_SUCCESS is returned.
+ * @return If not, EXIT_FAILURE is returned.
+ */
+
+int main(int argc, char *argv[])
+{
+    unsigned char slots[TAGTAB_SIZE];
+    uint32_t seed;
+    int i;
+
+    if (LABEL_COUNT >= 255) {
+        fprintf(stderr, "mktagtab: too many tags\n");
+        return EXIT_FAILURE;
+    }
+
+    for (seed = 0; seed < SEED_MAX; seed++) {
+        if (try_seed(seed, slots))
+            break;
+    }
+
+    if (seed == SEED_MAX) {
+        fprintf(stderr, "mktagtab: no perfect hash found, increase TAGTAB_BITS\n");
+        return EXIT_FAILURE;
+    }
+
+    printf("/* Generated by mktagtab from tic_tags.def. Do not edit. */\n\n");
+
+    if (argc > 1 && strcmp(argv[1], "-h") == 0) {
+        printf("#ifndef __TIC_TAGTAB_H__\n");
+        printf("#define __TIC_TAGTAB_H__ 1\n\n");
+        printf("#define TIC_TAG_COUNT %zu\n", LABEL_COUNT);
+        printf("#define TIC_TAGTAB_BITS %d\n", TAGTAB_BITS);
+        printf("#define TIC_TAGTAB_SEED %uu\n\n", seed);
+        printf("extern const unsigned char tic_tagtab[%d];\n\n", TAGTAB_SIZE);
+        printf("#endif /* __TIC_TAGTAB_H__ */\n");
+        return EXIT_SUCCESS;
+    }
+
+    printf("#include \"tic_tagtab.h\"\n\n");
+    printf("/* Slot -> index in tag_descs[] + 1, 0 for empty slot. */\n\n");
+    printf("const unsigned char tic_tagtab[%d] = {", TAGTAB_SIZE);
+    for (i = 0; i < TAGTAB_SIZE; i++)
+        printf("%s%3d,", i % 16 == 0 ? "\n    " : " ", slots[i]);
+    printf("\n};\n");
+
+    return EXIT_SUCCESS;
+}
@@ -6,431 +6,1444 @@
 #include <string.h>
 
 #include <syslog.h>
-#include <termios.h>
+#include <time.h>
 #include <unistd.h>
-#include <sys/fcntl.h>
+#include <sys/signalfd.h>
 #include <sys/types.h>
 
 #include <mosquitto.h>
 /* See https://mosquitto.org/api/files/mosquitto-h.html for mosquitto library API reference. */
 
 #include "broker_helper.h"
+#include "event_loop.h"
+#include "tic_cache.h"
+#include "tic_cbor.h"
+#include "tic_config.h"
 #include "homie_helper.h"
+#include "journal.h"
 #include "tic2mqtt.h"
+#include "tic_energy.h"
+#include "tic_frame.h"
+#include "tic_influx.h"
+#include "tic_input.h"
+#include "tic_json.h"
+#include "tic_meter.h"
+#include "tic_metrics.h"
+#include "tic_pipeline.h"
+#include "tic_publish.h"
+#include "tic_reader.h"
+#include "tic_sink.h"
+#include "tic_stats.h"
+#include "tic_trace.h"
+#include "tic_tags.h"
+#include "tic_tagtab.h"
 
 #define TIC2MQTT_VERSION "1.0.1"
 
-#define STX 0x02
-#define ETX 0x03
-
 #define DEFAULT_TTY "/dev/ttyS0"
-#define TIC_BAUDRATE B1200
-#define TIC_FRAME_MAX 512
+#define TIC_INPUTS_MAX 64   /* Inputs given with -t. */
+#define TIC_METERS_MAX 1024 /* Meters, including connections accepted on listening sockets. */
+#define TIC_SINKS_MAX 8     /* Output sinks. */
+#define TIC_TIMEOUT 8 /* s */
+#define TIC_DETECT_TIMEOUT 5 /* s */
+#define TIC_RETRY_DELAY 10 /* s */
+
+#define TICK_PERIOD 1000 /* ms */
+#define METRICS_INTERVAL 60 /* s */
+#define SNAPSHOT_INTERVAL 300 /* s */
 
 #define DEFAULT_HOST      "localhost"
 #define DEFAULT_PORT      1883
 #define DEFAULT_KEEPALIVE 60
+#define DEFAULT_JOURNAL_SIZE 1024 /* KiB */
 
-/* Tags for 'compteur monophasé multitarif'. */
+/* JSON and CBOR snapshot modes. */
 
-static struct tag_desc tag_descs[] =
-{
-    { "ADCO",    12 },
-    { "OPTARIF",  4 },
-    { "ISOUSC",   2 },
+enum {
+    JSON_NONE,    // No snapshot.
+    JSON_ALL,     // All values of each frame.
+    JSON_CHANGED  // Changed values of each frame.
+};
 
-    { "BASE",     9 },
+/* Topic of the CBOR snapshot of each frame, under node 'tic'. Not a Homie property, as its payload is binary. */
 
-    { "HCHC",     9 },
-    { "HCHP",     9 },
+#define CBOR_PROP_ID "frame-cbor"
 
-    { "EJPHN",    9 },
-    { "EJPHPM",   9 },
+/* Homie property holding the JSON snapshot of each frame. */
 
-    { "BBRHCJB",  9 },
-    { "BBRHPJB",  9 },
-    { "BBRHCJW",  9 },
-    { "BBRHPJW",  9 },
-    { "BBRHCJR",  9 },
-    { "BBRHPJR",  9 },
+static const struct homie_prop_attrs frame_attrs = {
+    "frame", "Trame TIC (JSON)", HOMIE_STRING, "", NULL
+};
 
-    { "PEJP",     2 },
-    { "PTEC",     4 },
-    { "DEMAIN",   4 },
-    { "IINST",    3 },
-    { "ADPS",     3 },
-    { "IMAX",     3 },
-    { "PAPP",     5 },
-    { "HHPHC",    1 },
-    { "MOTDETAT", 6 },
+/* Frame being processed. */
 
-    { NULL, 0 } /* End of table marker. */
+struct frame_ctx {
+    struct tic_meter *meter; // Meter that sent the frame.
+    time_t now;              // Monotonic time of reception (s), for publish filters.
+    time_t wall;             // Wall clock time of reception (s since epoch), for aggregation windows.
 };
 
-/* Values for enum attributes of Homie property 'tic'. */
+/* Listening socket accepting connections of meters. */
 
-static const char * const values_optarif[] = {
-    "BASE", /* Option Base. */
-    "HC..", /* Option Heures Creuses. */
-    "EJP.", /* Option EJP. */
-    "BBRx", /* Option Tempo. */
-    NULL
+struct tic_listener {
+    struct tic_input input;  // Listening input, fd is -1 while closed.
+    struct event_source src; // Event source.
+    int configured;          // Set if the input is listed in the config file.
 };
 
-static const char * const values_ptec[] = {
-    "TH..", /* Toutes les Heures. */
-    "HC..", /* Heures Creuses. */
-    "HP..", /* Heures Pleines. */
-    "HN..", /* Heures Normales. */
-    "PM..", /* Heures de Pointe Mobile. */
-    "HCJB", /* Heures Creuses Jours Bleus. */
-    "HCJW", /* Heures Creuses Jours Blancs (White). */
-    "HCJR", /* Heures Creuses Jours Rouges. */
-    "HPJB", /* Heures Pleines Jours Bleus. */
-    "HPJW", /* Heures Pleines Jours Blancs (White). */
-    "HPJR", /* Heures Pleines Jours Rouges. */
-    NULL
-};
+/* State of a pass over the config file. */
 
-static const char * const values_demain[] = {
-    "----", /* Couleur du lendemain non connue. */
-    "BLEU", /* Le lendemain est jour BLEU. */
-    "BLAN", /* Le lendemain est jour BLANC. */
-    "ROUG", /* Le lendemain est jour ROUGE. */
-    NULL
+struct config_ctx {
+    int apply;       // Apply settings. Otherwise, only check them.
+    int reload;      // Set on SIGHUP: settings of the broker connection are kept.
+    int input_count; // Number of inputs seen.
+    int sink_count;  // Number of sinks seen.
 };
 
-/* Property attributes of Homie node 'tic'. */
+/* Homie properties of node 'tic' for a mode: tags, their statistics and the JSON snapshot. */
 
-static struct homie_prop_attrs tic_attrs[] = {
-    { "adco",     "Adresse du compteur", HOMIE_STRING, "", NULL },
-    { "optarif",  "Option tarifaire choisie", HOMIE_ENUM, "", values_optarif },
-    { "isousc",   "Intensité souscrite", HOMIE_INTEGER, "A", NULL },
+static const struct homie_prop_attrs *tic_attrs[TIC_TAG_COUNT * (1 + TIC_STATS_WINDOWS_MAX * TIC_STAT_COUNT + TIC_ENERGY_PERIOD_COUNT) +
+                                               TIC_ENERGY_PERIOD_COUNT + 3];
 
-    { "base",     "Index option base", HOMIE_INTEGER, "Wh", NULL },
+static struct tic_meter **meters = NULL;
+static int meter_count = 0;
+static int meter_size = 0;
+static struct tic_listener listeners[TIC_INPUTS_MAX];
+static int listener_count = 0; // Number of listener slots used, including closed ones.
+static int single_meter = 0; // Set for a lone meter on a local input, published as device_id_tic.
+static char device_id_tic[TIC_DEVICE_ID_MAX + 1] = HOMIE_DEVICE_ID; // Device id of a lone meter, prefix of derived ids.
+static int mode_tic = TIC_MODE_AUTO; // Mode given with -m.
+static int threaded_tic = 0; // Read inputs in dedicated threads.
+static struct mosquitto *mosq_tic = NULL;
+static struct journal journal_tic;
+static struct event_loop loop;
+static int verbose = 0;
+static int json_mode = JSON_NONE;
+static int publish_props = 1;
+static int publish_aggregated = 1; // Publish raw values of aggregated tags.
+static struct tic_json json_tic; // JSON snapshot of the frame being processed, any meter.
+static int cbor_mode = JSON_NONE;
+static struct tic_cbor cbor_tic; // CBOR snapshot of the frame being processed, any meter.
+static struct tic_sink sinks[TIC_SINKS_MAX]; // Output sinks, started once connected to the event loop.
+static int sink_count = 0;
+static int config_sink_count = 0; // Sinks listed in the config file.
+static struct tic_influx influx_tic; // Point of the frame being processed for sinks, begun on its first value.
+static const char *metrics_path = NULL;
+static int connected_tic = 0; // Set once connected to broker.
+static time_t metrics_last = 0;
+static time_t snapshot_last = 0;
+static const char *config_path = NULL;
+static struct tic_input config_inputs[TIC_INPUTS_MAX]; // Inputs listed in the config file.
+static int config_input_count = 0;
+static struct tic_filter default_filters[TIC_TAG_COUNT]; // Filters of tic_tags.def.
+static char host_tic[256] = DEFAULT_HOST;
+static int port_tic = DEFAULT_PORT;
+static int keepalive_tic = DEFAULT_KEEPALIVE;
+static int mqtt5_tic = 0; // Connect with MQTT v5.
+static char windows_tic[64] = ""; // Aggregation windows, empty if disabled.
 
-    { "hchc",     "Index option Heures Creuses: Heures Creuses", HOMIE_INTEGER, "Wh", NULL },
-    { "hchp",     "Index option Heures Creuses: Heures Pleines", HOMIE_INTEGER, "Wh", NULL },
+/**
+ * @brief Get monotonic time.
+ * @return Seconds elapsed since an unspecified point.
+ */
 
-    { "ejphn",    "Index option EJP: Heures Normales", HOMIE_INTEGER, "Wh", NULL },
-    { "ejphpm",   "Index option EJP: Heures de Pointe Mobile", HOMIE_INTEGER, "Wh", NULL },
+static time_t monotonic_now(void)
+{
+    struct timespec ts;
 
-    { "bbrhcjb",  "Index option Tempo: Heures Creuses Jours Bleus", HOMIE_INTEGER, "Wh", NULL },
-    { "bbrhpjb",  "Index option Tempo: Heures Pleines Jours Bleus", HOMIE_INTEGER, "Wh", NULL },
-    { "bbrhcjw",  "Index option Tempo: Heures Creuses Jours Blancs", HOMIE_INTEGER, "Wh", NULL },
-    { "bbrhpjw",  "Index option Tempo: Heures Pleines Jours Blancs", HOMIE_INTEGER, "Wh", NULL },
-    { "bbrhcjr",  "Index option Tempo: Heures Pleines Jours Rouges", HOMIE_INTEGER, "Wh", NULL },
-    { "bbrhpjr",  "Index option Tempo: Heures Creuses Jours Rouges", HOMIE_INTEGER, "Wh", NULL },
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec;
+}
 
-    { "pejp",     "Préavis Début EJP (30 min)", HOMIE_INTEGER, "min", NULL },
-    { "ptec",     "Période tarifaire en cours", HOMIE_ENUM, "", values_ptec },
-    { "demain",   "Couleur du lendemain", HOMIE_ENUM, "", values_demain },
-    { "iinst",    "Intensité instantanée", HOMIE_INTEGER, "A" },
-    { "adps",     "Avertissement de Dépassement de Puissance Souscrite", HOMIE_INTEGER, "A", NULL },
-    { "imax",     "Intensité maximale", HOMIE_INTEGER, "A", NULL },
-    { "papp",     "Puissance apparente", HOMIE_INTEGER, "VA", NULL },
-    { "hhphc",    "Horaire heures pleines / heures creuses", HOMIE_STRING, "", NULL },
-    { "motdetat", "Mot d’état du compteur", HOMIE_STRING, "", NULL },
+/**
+ * @brief Get monotonic time with sub-second resolution.
+ * @return Seconds elapsed since an unspecified point.
+ */
 
-    { NULL, NULL, 0, NULL } /* End of table marker. */
-};
+static double monotonic_seconds(void)
+{
+    struct timespec ts;
 
-static int fd_tic = -1;
-static struct mosquitto *mosq_tic = NULL;
-static int verbose = 0;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
 
 /**
- * @brief Open TIC TTY.
- * @param tty TTY name (/dev/ttyxx).
- * @return File descriptor to tty.
+ * @brief Tell whether a tag holds the serial number of the meter.
+ * @param ptag_desc Tag description.
+ * @return 1 for ADCO (legacy) and ADSC (standard), 0 else.
  */
 
-static int tic_open(const char *tty)
+static int tic_is_serial(const struct tag_desc *ptag_desc)
 {
-    int fd;
-    struct termios termios;
+    return strcmp(ptag_desc->tag, "ADCO") == 0 || strcmp(ptag_desc->tag, "ADSC") == 0;
+}
 
-    if ((fd = open(tty, O_RDWR | O_NOCTTY)) < 0) {
-        syslog(LOG_ERR, "Cannot open %s: %s", tty, strerror(errno));
-        return -1;
+/**
+ * @brief Select TIC mode of a meter and publish matching Homie properties, once its device id is known.
+ * @param meter Meter.
+ * @param mode TIC_MODE_LEGACY or TIC_MODE_STANDARD.
+ */
+
+static void tic_set_mode(struct tic_meter *meter, int mode)
+{
+    const struct tag_desc *ptag_desc;
+    const struct homie_prop_attrs *attrs;
+    int n = 0;
+    int window;
+    int stat;
+    int period;
+
+    meter->mode = mode;
+
+    if (meter->device_id[0] == '\0')
+        return;
+
+    for (ptag_desc = tag_descs; ptag_desc->tag != NULL; ptag_desc++) {
+        if (ptag_desc->mode != mode)
+            continue;
+
+        if (tic_stats_window_count() == 0 || !tic_stats_is_aggregated(ptag_desc)) {
+            tic_attrs[n++] = &ptag_desc->attrs;
+            continue;
+        }
+
+        if (publish_aggregated)
+            tic_attrs[n++] = &ptag_desc->attrs;
+        for (window = 0; window < tic_stats_window_count(); window++) {
+            for (stat = 0; stat < TIC_STAT_COUNT; stat++) {
+                attrs = tic_stats_prop_attrs(ptag_desc, window, stat);
+                if (attrs != NULL)
+                    tic_attrs[n++] = attrs;
+            }
+        }
     }
+    if (meter->energy != NULL) {
+        for (ptag_desc = tag_descs; ptag_desc->tag != NULL; ptag_desc++) {
+            if (ptag_desc->mode != mode || !tic_energy_is_counter(ptag_desc))
+                continue;
+            for (period = 0; period < TIC_ENERGY_PERIOD_COUNT; period++) {
+                attrs = tic_energy_prop_attrs(ptag_desc, period);
+                if (attrs != NULL)
+                    tic_attrs[n++] = attrs;
+            }
+        }
+        for (period = 0; period < TIC_ENERGY_PERIOD_COUNT; period++) {
+            attrs = tic_energy_prop_attrs(NULL, period);
+            if (attrs != NULL)
+                tic_attrs[n++] = attrs;
+        }
+        tic_attrs[n++] = &tic_energy_power_attrs;
+    }
+    if (json_mode != JSON_NONE)
+        tic_attrs[n++] = &frame_attrs;
+    tic_attrs[n] = NULL;
+
+    // The broker connection has a single will: it can only report a lone meter.
+    if (single_meter)
+        homie_set_will(mosq_tic, meter->device_id);
+    homie_init(mosq_tic, meter->device_id, tic_attrs);
+}
 
-    tcgetattr(fd, &termios);
+/**
+ * @brief Stop reading the input of a meter and close it.
+ * @param meter Meter.
+ */
 
-    /* Configure input and output speed. */
-    cfsetispeed(&termios, TIC_BAUDRATE);
-    cfsetospeed(&termios, TIC_BAUDRATE);
+static void tic_stop_meter(struct tic_meter *meter)
+{
+    if (meter->src.fd >= 0)
+        event_loop_del(&loop, &meter->src);
+    meter->src.fd = -1;
+
+    if (meter->pipeline != NULL)
+        tic_pipeline_stop(meter->pipeline);
 
-    /* Set input modes:
-     * - Disable XON/XOFF flow control on input.
-     * - Do not translate carriage return to newline on input.
-     * - Enable input parity checking.
-     * - Strip off eighth bit.
-     */
+    tic_input_close(&meter->input);
+}
 
-    termios.c_iflag &= ~(IXON | IXOFF | IXANY | ICRNL);
-    termios.c_iflag |= INPCK | ISTRIP;
+/**
+ * @brief Log counters of the frame decoder of a meter.
+ * @param meter Meter, stopped.
+ */
 
-    /* Set output modes:
-     * - Disable implementation-defined output processing (raw mode).
-     */
+static void tic_log_counters(const struct tic_meter *meter)
+{
+    const struct tic_reader *reader = meter->pipeline != NULL ? &meter->pipeline->reader : &meter->reader;
 
-    termios.c_oflag &= ~OPOST;
+    syslog(LOG_INFO, "%s: %lu frames received, %lu dropped, %lu resynced, %lu reads", meter->input.name,
+           reader->frames, reader->dropped, reader->resynced, reader->reads);
+    if (meter->pipeline != NULL)
+        syslog(LOG_INFO, "%s: %lu frames lost on pipeline overrun", meter->input.name, (unsigned long) meter->pipeline->overruns);
+}
 
-    /* Set control modes:
-     * - Enable receiver.
-     * - Ignore modem control lines.
-     * - 7 bit.
-     * - 1 stop bit.
-     * - Enable parity generation on output and parity checking for input.
-     * - Disable RTS/CTS (hardware) flow control.
-     */
+/**
+ * @brief Stop and free a meter, reporting its device disconnected unless another meter publishes it.
+ * @param meter Meter.
+ */
 
-    termios.c_cflag |= CLOCAL | CREAD;
-    termios.c_cflag &= ~(CSIZE | PARODD | CSTOPB);
-    termios.c_cflag |=   CS7   | PARENB;
-    termios.c_cflag &= ~CRTSCTS;
+static void tic_remove_meter(struct tic_meter *meter)
+{
+    int shared = 0;
+    int index = 0;
+    int i;
+
+    tic_stop_meter(meter);
+    tic_log_counters(meter);
+
+    for (i = 0; i < meter_count; i++) {
+        if (meters[i] == meter)
+            index = i;
+        else if (strcmp(meters[i]->device_id, meter->device_id) == 0)
+            shared = 1;
+    }
 
-    /* Set local modes:
-     * - Do bot generate signal when the characters INTR, QUIT, SUSP or DSUSP are received.
-     * - Disable canonical mode.
-     * - Do not echo input characters.
-     */
+    if (meter->device_id[0] != '\0' && !shared) {
+        if (tic_cache_is_enabled())
+            tic_cache_keep(meter);
+        if (mosq_tic != NULL)
+            homie_close(mosq_tic, meter->device_id);
+    }
 
-    termios.c_lflag &= ~(ISIG | ICANON | ECHO | ECHOE);
+    meters[index] = meters[--meter_count];
+    tic_meter_free(meter);
+}
 
-    /* Set special characters:
-     * - Timeout set to 8 s.
-     * - Minimum number of characters for noncanonical read set to 1.
-     */
+/**
+ * @brief Set Homie device id of a meter, fill its value cache from the snapshot and open the state file of its derived counters.
+ * @param meter Meter.
+ * @param device_id Device id.
+ */
 
-    termios.c_cc[VTIME] = 80;
-    termios.c_cc[VMIN]  = 0;
+static void tic_set_device_id(struct tic_meter *meter, const char *device_id)
+{
+    tic_meter_set_device_id(meter, device_id);
 
-    tcsetattr(fd, TCSANOW, &termios);
+    if (tic_cache_is_enabled())
+        tic_cache_seed(meter, monotonic_now());
 
-    tcflush(fd, TCIFLUSH);
-    return fd;
+    if (tic_energy_is_enabled() && meter->energy == NULL)
+        meter->energy = tic_energy_open(meter->device_id);
 }
 
 /**
- * @brief Read TIC frame on tty.
- * @param device File descriptor to tty.
- * @param frame TIC frame to be read.
- * @return 0 on success, -1 on failure.
+ * @brief Derive Homie device id of a meter from its serial number.
+ * @param meter Meter.
+ * @param serial Serial number (ADCO or ADSC).
+ * @note A meter that connects again to a listening socket replaces its previous connection.
  */
 
-static int tic_read_frame(int device, char *frame)
+static void tic_identify(struct tic_meter *meter, const char *serial)
 {
-    char *cp;
-    char c;
+    char device_id[2 * (TIC_DEVICE_ID_MAX + 1)]; // Prefix and serial number, truncated by tic_meter_set_device_id().
+    struct tic_meter *other;
+    int i;
+
+    snprintf(device_id, sizeof(device_id), "%s-%s", device_id_tic, serial);
+    tic_set_device_id(meter, device_id);
+    syslog(LOG_NOTICE, "Meter %s on %s published as %s\n", serial, meter->input.name, meter->device_id);
+
+    for (i = 0; i < meter_count; i++) {
+        other = meters[i];
+        if (other == meter || strcmp(other->device_id, meter->device_id) != 0)
+            continue;
+
+        syslog(LOG_WARNING, "Meter %s also received on %s\n", serial, other->input.name);
+        if (other->input.type == TIC_INPUT_ACCEPTED)
+            tic_remove_meter(other);
+        break;
+    }
+
+    tic_set_mode(meter, meter->mode);
+}
+
+/**
+ * @brief Begin the point of the frame being processed for sinks, on its first value.
+ * @param meter Meter that sent the frame. Its device id is known.
+ */
+
+static void tic_influx_start(struct tic_meter *meter)
+{
+    if (influx_tic.count == 0)
+        tic_influx_begin(&influx_tic, meter->device_id, meter->frame_ts);
+}
+
+/**
+ * @brief Publish group of current frame.
+ * @param ptag_desc Tag description.
+ * @param data Data, in place in the frame.
+ * @param len Length of data.
+ * @param userdata Frame being processed (struct frame_ctx *).
+ * @note Groups are ignored until the device id of the meter is known.
+ */
+
+static void tic_process_group(struct tag_desc *ptag_desc, const char *data, int len, void *userdata)
+{
+    const struct frame_ctx *ctx = userdata;
+    struct tic_meter *meter = ctx->meter;
+    int aggregated = tic_stats_window_count() > 0 && tic_stats_is_aggregated(ptag_desc);
+    uint64_t consumption[TIC_ENERGY_PERIOD_COUNT];
+    int changed;
+
+    if (meter->device_id[0] == '\0') {
+        if (!tic_is_serial(ptag_desc))
+            return;
+        tic_identify(meter, data);
+    }
+
+    if (aggregated) {
+        struct tic_stats closed;
+        int window;
+
+        for (window = 0; window < tic_stats_window_count(); window++) {
+            if (tic_stats_add(tic_meter_stats(meter, ptag_desc, window), window, data, ctx->wall, &closed))
+                tic_publish_stats(mosq_tic, meter, ptag_desc, window, &closed);
+        }
+    }
+
+    if (meter->energy != NULL && tic_energy_is_counter(ptag_desc) &&
+        tic_energy_add(meter->energy, ptag_desc, data, ctx->wall, consumption) && publish_props)
+        tic_publish_energy(mosq_tic, meter, ptag_desc, consumption);
+
+    changed = tic_update_value(meter, ptag_desc, data, len, ctx->now);
+
+    if (json_mode == JSON_ALL || (json_mode == JSON_CHANGED && changed))
+        tic_json_add(&json_tic, ptag_desc, data);
+    if (cbor_mode == JSON_ALL || (cbor_mode == JSON_CHANGED && changed))
+        tic_cbor_add(&cbor_tic, ptag_desc, data);
+
+    if (!changed)
+        return;
+
+    if (sink_count > 0) {
+        tic_influx_start(meter);
+        tic_influx_add(&influx_tic, ptag_desc, data);
+    }
+
+    if (verbose) {
+        if (!single_meter)
+            printf("%s: ", meter->device_id);
+        printf("%s=%s %s\n", ptag_desc->tag, data, ptag_desc->attrs.unit);
+    }
+
+    if (publish_props && (publish_aggregated || !aggregated))
+        tic_publish_value(mosq_tic, meter, ptag_desc, data, len);
+}
+
+/**
+ * @brief Publish Homie properties and latest values of a meter again.
+ * @param mosq Mosquitto instance.
+ * @param meter Meter.
+ * @param all Also publish values loaded from the snapshot and unchanged since.
+ */
+
+static void tic_republish_meter(struct mosquitto *mosq, struct tic_meter *meter, int all)
+{
+    const struct tag_desc *ptag_desc;
+    const struct tic_tag_state *state;
+    uint64_t consumption[TIC_ENERGY_PERIOD_COUNT];
+
+    if (meter->mode == TIC_MODE_AUTO || meter->device_id[0] == '\0')
+        return;
+
+    tic_set_mode(meter, meter->mode);
+
+    if (!publish_props)
+        return;
+
+    for (ptag_desc = tag_descs; ptag_desc->tag != NULL; ptag_desc++) {
+        state = tic_meter_tag(meter, ptag_desc);
+        if (ptag_desc->mode != meter->mode || !state->known)
+            continue;
+        if (meter->energy != NULL && tic_energy_is_counter(ptag_desc) &&
+            tic_energy_get(meter->energy, ptag_desc, consumption) == 0)
+            tic_publish_energy(mosq, meter, ptag_desc, consumption);
+        if (!publish_aggregated && tic_stats_window_count() > 0 && tic_stats_is_aggregated(ptag_desc))
+            continue;
+        if (state->cached && !all)
+            continue;
+        tic_publish_value(mosq, meter, ptag_desc, state->data, state->len);
+    }
+
+    if (meter->energy != NULL) {
+        if (tic_energy_get(meter->energy, NULL, consumption) == 0)
+            tic_publish_energy(mosq, meter, NULL, consumption);
+        if (tic_energy_get_power(meter->energy) >= 0)
+            tic_publish_power(mosq, meter, tic_energy_get_power(meter->energy));
+    }
+}
+
+/**
+ * @brief Publish Homie properties and latest values again, once connected to broker.
+ * @param mosq Mosquitto instance.
+ * @param userdata Unused.
+ * @note Values received while the broker was unreachable are only kept in the
+ *       tag states of each meter, so that only the latest state is published on
+ *       reconnection.
+ * @note On first connection, Homie attributes and values retained during the previous
+ *       run are not published again.
+ */
+
+static void tic_republish(struct mosquitto *mosq, void *userdata)
+{
+    int reconnected = connected_tic;
+    int i;
+
+    // The broker may have restarted and lost retained attributes and values.
+    if (reconnected)
+        homie_forget();
+    connected_tic = 1;
+
+    for (i = 0; i < meter_count; i++)
+        tic_republish_meter(mosq, meters[i], reconnected);
+}
+
+/**
+ * @brief Record acknowledgement of a message in trace.
+ * @param mosq Mosquitto instance.
+ * @param mid Message id.
+ * @param userdata Unused.
+ */
+
+static void tic_published(struct mosquitto *mosq, int mid, void *userdata)
+{
+    tic_trace_ack(mid);
+}
+
+/**
+ * @brief Process TIC frame.
+ * @param frame TIC frame.
+ * @param len Length of frame.
+ * @param times Reception times of frame.
+ * @param userdata Meter.
+ * @note In auto mode, the first frame with valid groups selects the mode, based on their separator.
+ */
+
+static void tic_frame_process(char *frame, int len, const struct tic_frame_times *times, void *userdata)
+{
+    struct tic_meter *meter = userdata;
+    struct tic_frame_info info;
+    struct frame_ctx ctx;
+    struct tic_trace_record trace;
+    double rx_mono = times->etx_mono.tv_sec + times->etx_mono.tv_nsec / 1e9;
+    struct timespec parsed;
+    double start;
+    int mid = broker_get_last_mid();
+    int i;
+    static const struct broker_msg_props snapshot_props = { 1, 0, NULL }; // Snapshots hold the reception time already.
+
+    ctx.meter = meter;
+    ctx.wall = times->etx_wall.tv_sec;
+    ctx.now = times->etx_mono.tv_sec;
+    meter->frame_ts = times->etx_wall.tv_sec * 1000LL + times->etx_wall.tv_nsec / 1000000;
+    if (tic_timestamps)
+        sprintf(meter->frame_ts_text, "%lld", meter->frame_ts);
+
+    if (json_mode != JSON_NONE)
+        tic_json_begin(&json_tic, meter->seq, meter->frame_ts);
+    if (cbor_mode != JSON_NONE)
+        tic_cbor_begin(&cbor_tic, meter->seq, meter->frame_ts);
+    influx_tic.count = 0;
+    trace.seq = meter->seq++;
+
+    start = monotonic_seconds();
+    tic_process_frame(frame, len, meter->mode, tic_process_group, &ctx, &info);
+    clock_gettime(CLOCK_MONOTONIC, &parsed);
+    tic_metrics_observe(&tic_metrics.parse_time, parsed.tv_sec + parsed.tv_nsec / 1e9 - start);
+
+    if (meter->energy != NULL && meter->device_id[0] != '\0') {
+        uint64_t consumption[TIC_ENERGY_PERIOD_COUNT];
+        long power;
+        int updated;
+
+        updated = tic_energy_end_frame(meter->energy, meter->frame_ts, consumption, &power);
+        if (publish_props && (updated & TIC_ENERGY_TOTAL_CHANGED))
+            tic_publish_energy(mosq_tic, meter, NULL, consumption);
+        if (publish_props && (updated & TIC_ENERGY_POWER_CHANGED))
+            tic_publish_power(mosq_tic, meter, power);
+        if (sink_count > 0 && (updated & TIC_ENERGY_POWER_CHANGED)) {
+            tic_influx_start(meter);
+            tic_influx_add_int(&influx_tic, tic_energy_power_attrs.prop_id, power);
+        }
+        if (verbose && (updated & TIC_ENERGY_POWER_CHANGED)) {
+            if (!single_meter)
+                printf("%s: ", meter->device_id);
+            printf("power=%ld W\n", power);
+        }
+    }
+
+    meter->counters.groups += info.groups;
+    meter->counters.group_errors += info.errors;
+    meter->counters.checksum_errors += info.checksums;
+    tic_metrics_observe(&tic_metrics.groups_per_frame, info.groups);
+
+    if (json_mode != JSON_NONE && json_tic.count > 0) {
+        if (tic_json_end(&json_tic) < 0)
+            syslog(LOG_ERR, "JSON snapshot too large: skip frame\n");
+        else
+            broker_publish_props(mosq_tic, meter->node_topic, frame_attrs.prop_id, json_tic.buf, json_tic.len, tic_qos, &snapshot_props);
+    }
+
+    if (cbor_mode != JSON_NONE && cbor_tic.count > 0) {
+        if (tic_cbor_end(&cbor_tic) < 0)
+            syslog(LOG_ERR, "CBOR snapshot too large: skip frame\n");
+        else
+            broker_publish_props(mosq_tic, meter->node_topic, CBOR_PROP_ID, cbor_tic.buf, cbor_tic.len, tic_qos, &snapshot_props);
+    }
+
+    if (influx_tic.count > 0) {
+        if (tic_influx_end(&influx_tic) < 0) {
+            syslog(LOG_ERR, "Line protocol point too large: skip frame\n");
+        } else {
+            for (i = 0; i < sink_count; i++)
+                tic_sink_add(&sinks[i], influx_tic.buf, influx_tic.len, ctx.now);
+        }
+    }
+
+    tic_metrics_observe(&tic_metrics.publish_latency, monotonic_seconds() - rx_mono);
+
+    if (tic_trace_is_open()) {
+        trace.stx_wall = tic_trace_ns(&times->stx_wall);
+        trace.stx = tic_trace_ns(&times->stx_mono);
+        trace.etx = tic_trace_ns(&times->etx_mono);
+        trace.parsed = tic_trace_ns(&parsed);
+        trace.enqueued = tic_trace_now();
+        trace.mid = broker_get_last_mid() != mid ? broker_get_last_mid() : 0;
+        trace.groups = info.groups;
+        trace.len = len;
+        trace.baudrate = (meter->mode == TIC_MODE_AUTO ? meter->detect_mode : meter->mode) == TIC_MODE_STANDARD ? 9600 : 1200;
+        tic_trace_frame(&trace);
+    }
+
+    if (meter->mode == TIC_MODE_AUTO && info.groups_ok[0] + info.groups_ok[1] > 0) {
+        int mode = info.groups_ok[1] > info.groups_ok[0] ? TIC_MODE_STANDARD : TIC_MODE_LEGACY;
+
+        syslog(LOG_NOTICE, "TIC %s mode detected on %s\n", mode == TIC_MODE_STANDARD ? "standard" : "legacy", meter->input.name);
+        if (mode != meter->detect_mode)
+            tic_input_set_speed(&meter->input, mode);
+        tic_set_mode(meter, mode);
+    }
+
+    meter->frame_ts = 0;
+}
+
+/**
+ * @brief Process TIC frame received on an input by the event loop.
+ * @param frame TIC frame.
+ * @param len Length of frame.
+ * @param userdata Meter.
+ */
+
+static void tic_frame_received(char *frame, int len, void *userdata)
+{
+    struct tic_meter *meter = userdata;
+
+    tic_frame_process(frame, len, &meter->reader.times, meter);
+}
+
+/**
+ * @brief Try next TIC mode if no valid frame was received while detecting mode.
+ * @param meter Meter.
+ * @param now Current monotonic time.
+ * @note Only local ttys have a line speed to try. On other inputs, the first valid frame gives the mode.
+ */
+
+static void tic_detect_mode(struct tic_meter *meter, time_t now)
+{
+    if (meter->mode != TIC_MODE_AUTO || meter->input.type != TIC_INPUT_TTY || now - meter->detect_start < TIC_DETECT_TIMEOUT)
+        return;
+
+    meter->detect_mode = meter->detect_mode == TIC_MODE_LEGACY ? TIC_MODE_STANDARD : TIC_MODE_LEGACY;
+    meter->detect_start = now;
+
+    tic_input_set_speed(&meter->input, meter->detect_mode);
+    if (meter->pipeline != NULL)
+        tic_pipeline_reset(meter->pipeline);
+    else
+        tic_reader_reset(&meter->reader);
+}
+
+/**
+ * @brief Handle loss of the input of a meter.
+ * @param meter Meter.
+ * @note Accepted connections are dropped. Other inputs are closed and opened
+ *       again after TIC_RETRY_DELAY, without affecting the other meters.
+ */
+
+static void tic_input_lost(struct tic_meter *meter)
+{
+    if (meter->input.type == TIC_INPUT_ACCEPTED) {
+        tic_remove_meter(meter);
+        return;
+    }
+
+    tic_stop_meter(meter);
+    meter->retry_at = monotonic_now() + TIC_RETRY_DELAY;
+}
+
+/**
+ * @brief Handle TIC data on an input.
+ * @param src Event source.
+ * @param events Events.
+ */
+
+static void tic_handler(struct event_source *src, uint32_t events)
+{
+    struct tic_meter *meter = src->userdata;
     int res;
 
-    tcflush(device, TCIFLUSH);
+    res = tic_reader_read(&meter->reader, src->fd);
+    if (res < 0) {
+        if (errno == EAGAIN)
+            return;
+        syslog(LOG_ERR, "Cannot read TIC on %s: %s", meter->input.name, strerror(errno));
+    } else if (res == 0) {
+        syslog(LOG_ERR, "End of TIC input on %s", meter->input.name);
+    } else {
+        meter->last_rx = monotonic_now();
+        return;
+    }
 
-    cp = frame;
+    tic_input_lost(meter);
+}
 
-    // Wait for STX.
-    do {
-        res = read(device, &c, 1);
-        if (res == 0) {
-            syslog(LOG_ERR, "Start of TIC frame not received");
-            return -1;
+/**
+ * @brief Handle TIC frames queued by the reader thread of a meter.
+ * @param src Event source.
+ * @param events Events.
+ */
+
+static void pipeline_handler(struct event_source *src, uint32_t events)
+{
+    struct tic_meter *meter = src->userdata;
+
+    if (tic_pipeline_drain(meter->pipeline, tic_frame_process, meter) == 0)
+        return;
+
+    tic_input_lost(meter);
+}
+
+/**
+ * @brief Open the input of a meter, if needed, and watch it.
+ * @param meter Meter.
+ * @param now Current monotonic time.
+ * @return 0 on success, -1 on failure.
+ */
+
+static int tic_start_meter(struct tic_meter *meter, time_t now)
+{
+    meter->retry_at = 0;
+
+    if (meter->input.fd < 0 && tic_input_open(&meter->input, meter->detect_mode) < 0)
+        return -1;
+
+    tic_reader_reset(&meter->reader);
+    meter->last_rx = meter->detect_start = now;
+
+    meter->src.events = EPOLLIN;
+    if (meter->pipeline != NULL) {
+        meter->src.handler = pipeline_handler;
+        meter->src.fd = tic_pipeline_start(meter->pipeline, meter->input.fd);
+    } else {
+        meter->src.handler = tic_handler;
+        meter->src.fd = meter->input.fd;
+    }
+
+    if (meter->src.fd < 0 || event_loop_add(&loop, &meter->src) < 0) {
+        meter->src.fd = -1;
+        tic_stop_meter(meter);
+        return -1;
+    }
+
+    return 0;
+}
+
+/**
+ * @brief Create a meter for an input. Its input is not opened.
+ * @param input Input.
+ * @return Meter, or NULL on failure.
+ */
+
+static struct tic_meter *tic_add_meter(const struct tic_input *input)
+{
+    struct tic_meter **grown;
+    struct tic_meter *meter;
+    int size;
+
+    if (meter_count == TIC_METERS_MAX) {
+        syslog(LOG_ERR, "Too many meters: %s ignored", input->name);
+        return NULL;
+    }
+
+    if (meter_count == meter_size) {
+        size = meter_size ? meter_size * 2 : 8;
+        grown = realloc(meters, size * sizeof(*meters));
+        if (grown == NULL) {
+            syslog(LOG_ERR, "Cannot alloc meters: %s", strerror(errno));
+            return NULL;
+        }
+        meters = grown;
+        meter_size = size;
+    }
+
+    meter = tic_meter_new(input);
+    if (meter == NULL)
+        return NULL;
+
+    tic_reader_init(&meter->reader, tic_frame_received, meter);
+    if (mode_tic != TIC_MODE_AUTO)
+        meter->mode = meter->detect_mode = mode_tic;
+
+    if (threaded_tic) {
+        meter->pipeline = malloc(sizeof(*meter->pipeline));
+        if (meter->pipeline == NULL) {
+            syslog(LOG_ERR, "Cannot alloc pipeline for %s: %s", input->name, strerror(errno));
+            tic_meter_free(meter);
+            return NULL;
         }
-    } while (c != STX);
+        tic_pipeline_init(meter->pipeline);
+    }
+
+    meters[meter_count++] = meter;
+    return meter;
+}
+
+/**
+ * @brief Accept connections of meters on a listening socket.
+ * @param src Event source.
+ * @param events Events.
+ */
+
+static void listen_handler(struct event_source *src, uint32_t events)
+{
+    struct tic_listener *listener = src->userdata;
+    struct tic_meter *meter;
+    struct tic_input input;
+
+    while (tic_input_accept(&listener->input, &input) >= 0) {
+        syslog(LOG_INFO, "Connection from %s on %s", input.name, listener->input.name);
+
+        meter = tic_add_meter(&input);
+        if (meter == NULL)
+            tic_input_close(&input);
+        else if (tic_start_meter(meter, monotonic_now()) < 0)
+            tic_remove_meter(meter);
+    }
+}
+
+/**
+ * @brief Open a listening socket and watch it.
+ * @param input Listening input, copied.
+ * @param configured Set if the input is listed in the config file.
+ * @return 0 on success, -1 on failure.
+ * @note Slots of listeners closed on reload are reused.
+ */
+
+static int tic_add_listener(const struct tic_input *input, int configured)
+{
+    struct tic_listener *listener = NULL;
+    int i;
 
-    // Read until ETX.
-    do {
-        res = read(device, &c, 1);
-        if (res == 0) {
-            syslog(LOG_ERR, "End of TIC frame not received");
+    for (i = 0; i < listener_count && listener == NULL; i++) {
+        if (listeners[i].input.fd < 0)
+            listener = &listeners[i];
+    }
+    if (listener == NULL) {
+        if (listener_count == TIC_INPUTS_MAX) {
+            syslog(LOG_ERR, "Too many listening sockets: %s ignored", input->name);
             return -1;
         }
-        *cp++ = c;
-    } while (c != ETX);
+        listener = &listeners[listener_count++];
+    }
+
+    listener->input = *input;
+    listener->configured = configured;
+    listener->src.userdata = listener;
+    listener->src.handler = listen_handler;
+    listener->src.events = EPOLLIN;
+    listener->src.fd = tic_input_open(&listener->input, mode_tic);
+    if (listener->src.fd < 0 || event_loop_add(&loop, &listener->src) < 0) {
+        tic_input_close(&listener->input);
+        return -1;
+    }
 
     return 0;
 }
 
 /**
- * @brief Verify the checksum of a group.
- * @param tag Tag.
- * @param data Data.
- * @param checksum Checksum.
- * @return 1 if checksum is valid, 0 else.
+ * @brief Close a listening socket. Meters of accepted connections are kept.
+ * @param listener Listener.
  */
 
-static int tic_is_checksum_ok(const char *start, const char *end, char checksum)
+static void tic_close_listener(struct tic_listener *listener)
 {
-    unsigned char sum = 0x00;
+    event_loop_del(&loop, &listener->src);
+    tic_input_close(&listener->input);
+    listener->src.fd = -1;
+}
 
-    while (start <= end) {
-        sum += *start++;
-    }
+/**
+ * @brief Parse a TIC mode.
+ * @param arg auto, legacy or standard.
+ * @return TIC_MODE_xxx, -1 if arg is invalid.
+ */
 
-    sum = ' ' + (sum & 0x3f);
+static int tic_parse_mode(const char *arg)
+{
+    if (strcmp(arg, "legacy") == 0)
+        return TIC_MODE_LEGACY;
+    if (strcmp(arg, "standard") == 0)
+        return TIC_MODE_STANDARD;
+    if (strcmp(arg, "auto") == 0)
+        return TIC_MODE_AUTO;
+    return -1;
+}
 
-#ifdef DEBUG
-    printf("Checksum read: %02x computed: %02x", checksum, sum);
-#endif // DEBUG
+/**
+ * @brief Parse a JSON snapshot mode.
+ * @param arg none, all or changed.
+ * @return JSON_xxx, -1 if arg is invalid.
+ */
 
-    return sum == checksum;
+static int tic_parse_json_mode(const char *arg)
+{
+    if (strcmp(arg, "none") == 0)
+        return JSON_NONE;
+    if (strcmp(arg, "all") == 0)
+        return JSON_ALL;
+    if (strcmp(arg, "changed") == 0)
+        return JSON_CHANGED;
+    return -1;
 }
 
 /**
- * @brief Process group if tag is found in tag_descs[].
- * @param tag Tag.
- * @param data Data.
- * @return 0 if successful, -1 if failure.
+ * @brief Parse a decimal integer.
+ * @param arg Integer.
+ * @param min Minimum value.
+ * @param max Maximum value.
+ * @return Value, -1 if arg is invalid or out of range.
  */
 
-static void tic_process_group(const char *tag, const char *data)
+static int tic_parse_int(const char *arg, int min, int max)
 {
-    struct tag_desc *ptag_desc;
+    char *end;
+    long value;
 
-    for (ptag_desc = tag_descs; ptag_desc->tag != NULL; ptag_desc++) {
-        if (strcmp(ptag_desc->tag, tag) == 0) {
-            int publish_requested = 0;
-            char topic[TOPIC_MAXLEN + 1];
-            int res;
-
-            if (ptag_desc->data == NULL) {
-                ptag_desc->data = calloc(1, ptag_desc->len + 1);
-                if (ptag_desc->data == NULL) {
-                    syslog(LOG_ERR, "Cannot alloc data for tag %s: %s\n", tag, strerror(errno));
-                }
-                publish_requested = 1;
-            } else if (strcmp(ptag_desc->data, data) != 0) {
-                publish_requested = 1;
-            }
+    value = strtol(arg, &end, 10);
+    if (end == arg || *end != '\0' || value < min || value > max)
+        return -1;
+    return value;
+}
 
-            if (publish_requested) {
-                const struct homie_prop_attrs *pattrs = tic_attrs + (ptag_desc - tag_descs);
+/**
+ * @brief Warn that a setting changed in the config file is only applied on restart.
+ * @param key Key of setting.
+ */
 
-                ptag_desc->data[0] = '\0';
-                strncat(ptag_desc->data, data, ptag_desc->len);
+static void tic_config_restart_needed(const char *key)
+{
+    syslog(LOG_WARNING, "Config %s: %s changed, restart needed", config_path, key);
+}
 
-                if (verbose)
-                    printf("%s=%s %s\n", tag, data, pattrs->unit);
+/**
+ * @brief Tell whether a sink is running.
+ * @param spec Specification of sink.
+ * @return 1 if a sink has this specification, 0 else.
+ */
 
-                sprintf(topic, "%s%s/%s/%s", HOMIE_BASE_TOPIC, HOMIE_DEVICE_ID, HOMIE_NODE_ID, pattrs->prop_id);
-                res = broker_publish(mosq_tic, topic, NULL, data, TIC_QOS);
-                if (res != 0)
-                    syslog(LOG_ERR, "Cannot publish topic %s: %s\n", topic, mosquitto_strerror(res));
+static int tic_has_sink(const char *spec)
+{
+    int i;
 
-            }
-            return; // No more processing.
+    for (i = 0; i < sink_count; i++) {
+        if (strcmp(sinks[i].name, spec) == 0)
+            return 1;
+    }
+
+    return 0;
+}
+
+/**
+ * @brief Check or apply a setting of the config file.
+ * @param key Key.
+ * @param value Value.
+ * @param userdata State of the pass (struct config_ctx *).
+ * @return 0 on success, -1 if the key is unknown or the value is invalid.
+ */
+
+static int tic_config_set(const char *key, const char *value, void *userdata)
+{
+    struct config_ctx *ctx = userdata;
+    struct tic_input input;
+    struct tic_filter filter;
+    struct tag_desc *ptag_desc;
+    int n;
+
+    if (strcmp(key, "input") == 0) {
+        if (ctx->input_count == TIC_INPUTS_MAX || tic_input_parse(&input, value) < 0)
+            return -1;
+        ctx->input_count++;
+        if (ctx->apply)
+            config_inputs[config_input_count++] = input;
+    } else if (strcmp(key, "mode") == 0) {
+        if ((n = tic_parse_mode(value)) < 0)
+            return -1;
+        if (ctx->apply)
+            mode_tic = n;
+    } else if (strcmp(key, "json") == 0) {
+        if ((n = tic_parse_json_mode(value)) < 0)
+            return -1;
+        if (ctx->apply)
+            json_mode = n;
+    } else if (strcmp(key, "cbor") == 0) {
+        if ((n = tic_parse_json_mode(value)) < 0)
+            return -1;
+        if (ctx->apply)
+            cbor_mode = n;
+    } else if (strcmp(key, "timestamps") == 0) {
+        if ((n = tic_parse_int(value, 0, 1)) < 0)
+            return -1;
+        if (ctx->apply)
+            tic_timestamps = n;
+    } else if (strcmp(key, "mqtt5") == 0) {
+        if ((n = tic_parse_int(value, 0, 1)) < 0)
+            return -1;
+        if (ctx->apply && ctx->reload && n != mqtt5_tic)
+            tic_config_restart_needed(key);
+        else if (ctx->apply && !ctx->reload)
+            mqtt5_tic = n;
+    } else if (strcmp(key, "qos") == 0) {
+        if ((n = tic_parse_int(value, 0, 2)) < 0)
+            return -1;
+        if (ctx->apply)
+            tic_qos = n;
+    } else if (strcmp(key, "device_id") == 0) {
+        if (*value == '\0' || strlen(value) > TIC_DEVICE_ID_MAX)
+            return -1;
+        if (ctx->apply)
+            strcpy(device_id_tic, value);
+    } else if (strcmp(key, "host") == 0) {
+        if (*value == '\0' || strlen(value) >= sizeof(host_tic))
+            return -1;
+        if (ctx->apply && ctx->reload && strcmp(value, host_tic) != 0)
+            tic_config_restart_needed(key);
+        else if (ctx->apply && !ctx->reload)
+            strcpy(host_tic, value);
+    } else if (strcmp(key, "port") == 0) {
+        if ((n = tic_parse_int(value, 1, 65535)) < 0)
+            return -1;
+        if (ctx->apply && ctx->reload && n != port_tic)
+            tic_config_restart_needed(key);
+        else if (ctx->apply && !ctx->reload)
+            port_tic = n;
+    } else if (strcmp(key, "keepalive") == 0) {
+        if ((n = tic_parse_int(value, 0, 65535)) < 0)
+            return -1;
+        if (ctx->apply && ctx->reload && n != keepalive_tic)
+            tic_config_restart_needed(key);
+        else if (ctx->apply && !ctx->reload)
+            keepalive_tic = n;
+    } else if (strcmp(key, "windows") == 0) {
+        // The state of aggregation windows is allocated with each meter.
+        if (strlen(value) >= sizeof(windows_tic))
+            return -1;
+        if (ctx->reload) {
+            if (ctx->apply && strcmp(value, windows_tic) != 0)
+                tic_config_restart_needed(key);
+        } else if (ctx->apply) {
+            if (tic_stats_set_windows(value) < 0)
+                return -1;
+            strcpy(windows_tic, value);
         }
+    } else if (strcmp(key, "sink") == 0) {
+        // Writer threads are started once, with the broker connection.
+        static struct tic_sink sink; // Too large for the stack.
+
+        if (ctx->sink_count == TIC_SINKS_MAX || tic_sink_parse(&sink, value) < 0)
+            return -1;
+        ctx->sink_count++;
+        if (ctx->reload) {
+            if (ctx->apply && !tic_has_sink(value))
+                tic_config_restart_needed(key);
+        } else if (ctx->apply) {
+            if (sink_count == TIC_SINKS_MAX)
+                return -1;
+            sinks[sink_count++] = sink;
+            config_sink_count++;
+        }
+    } else if (strncmp(key, "filter.", 7) == 0) {
+        ptag_desc = tic_tag_lookup(key + 7, strlen(key + 7));
+        if (ptag_desc == NULL || tic_filter_parse(value, &filter) < 0)
+            return -1;
+        if (ctx->apply)
+            ptag_desc->filter = filter;
+    } else {
+        return -1;
     }
+
+    return 0;
 }
 
 /**
- * @brief Process TIC frame (legacy mode).
- * @param frame TIC frame.
+ * @brief Tell whether two inputs designate the same source.
+ * @param a Input.
+ * @param b Input.
+ * @return 1 if they are the same, 0 else.
  */
 
-static void tic_process_frame(char *frame)
+static int tic_input_equal(const struct tic_input *a, const struct tic_input *b)
 {
-    char *p;
+    return a->type == b->type && strcmp(a->name, b->name) == 0;
+}
 
-    for (p = frame; *p != ETX;) {
-        char *start;
-        char *end;
-        char checksum;
-        char sep;
-        char *q;
-        char *tag;
-        char *sepp;
-        char *last;
-        char *data;
-
-        /* Step 1: identify the first character of the group. */
-        if (*p != '\n')
-            continue;
-        start = p++;
-
-        /* Step 1: identify the last character of the group. */
-        for (;;) {
-            switch (*p) {
-            case '\r': end = p++; break;
-            case '\n':
-                syslog(LOG_ERR, "Unterminated group\n");
-                start = ++p; continue;
-            case ETX: return;
-            default: p++; continue;
-            }
-            break;
+/**
+ * @brief Tell whether an input is listed in the config file.
+ * @param input Input.
+ * @return 1 if listed, 0 else.
+ */
+
+static int tic_config_has_input(const struct tic_input *input)
+{
+    int i;
+
+    for (i = 0; i < config_input_count; i++) {
+        if (tic_input_equal(&config_inputs[i], input))
+            return 1;
+    }
+    return 0;
+}
+
+/**
+ * @brief Tell whether a meter or a listener reads an input listed in the config file.
+ * @param input Input.
+ * @return 1 if the input is read, 0 else.
+ */
+
+static int tic_config_input_is_read(const struct tic_input *input)
+{
+    int i;
+
+    for (i = 0; i < meter_count; i++) {
+        if (meters[i]->configured && tic_input_equal(&meters[i]->input, input))
+            return 1;
+    }
+    for (i = 0; i < listener_count; i++) {
+        if (listeners[i].configured && listeners[i].input.fd >= 0 && tic_input_equal(&listeners[i].input, input))
+            return 1;
+    }
+    return 0;
+}
+
+/**
+ * @brief Read inputs added to the config file and close inputs removed from it.
+ * @note Inputs given on the command line and connections accepted on listening sockets are kept.
+ */
+
+static void tic_config_update_inputs(void)
+{
+    struct tic_meter *meter;
+    time_t now = monotonic_now();
+    int i;
+
+    // Backwards, as a removed meter is replaced with the last one.
+    for (i = meter_count - 1; i >= 0; i--) {
+        if (meters[i]->configured && !tic_config_has_input(&meters[i]->input)) {
+            syslog(LOG_NOTICE, "Input %s removed", meters[i]->input.name);
+            tic_remove_meter(meters[i]);
+        }
+    }
+    for (i = 0; i < listener_count; i++) {
+        if (listeners[i].configured && listeners[i].input.fd >= 0 && !tic_config_has_input(&listeners[i].input)) {
+            syslog(LOG_NOTICE, "Input %s removed", listeners[i].input.name);
+            tic_close_listener(&listeners[i]);
         }
+    }
 
-        /* Step 3: identify the checksum. */
-        checksum = end[-1];
+    for (i = 0; i < config_input_count; i++) {
+        if (tic_config_input_is_read(&config_inputs[i]))
+            continue;
+        syslog(LOG_NOTICE, "Input %s added", config_inputs[i].name);
 
-        /* Step 4: identify and check the separator. */
-        sep = end[-2];
-        switch (sep) {
-        case ' ':
-        case '\t':
-            break;
-        default:
-            syslog(LOG_ERR, "Wrong separator 0x%02x: skip group\n", (unsigned char) sep);
+        if (config_inputs[i].type == TIC_INPUT_LISTEN) {
+            tic_add_listener(&config_inputs[i], 1);
             continue;
         }
 
-        /* Step 5: verify the checksum. */
-        if (!tic_is_checksum_ok(start + 1, end - 3, checksum)) {
-            syslog(LOG_ERR, "Wrong checksum: skip group\n");
+        meter = tic_add_meter(&config_inputs[i]);
+        if (meter == NULL)
             continue;
+        meter->configured = 1;
+        if (tic_start_meter(meter, now) < 0) {
+            if (meter->input.type == TIC_INPUT_TCP)
+                meter->retry_at = now + TIC_RETRY_DELAY;
+            else
+                tic_remove_meter(meter);
         }
+    }
+}
+
+/**
+ * @brief Get serial number of a meter, as last received.
+ * @param meter Meter.
+ * @return Serial number, NULL if unknown.
+ */
+
+static const char *tic_get_serial(struct tic_meter *meter)
+{
+    const struct tag_desc *ptag_desc;
+    const struct tic_tag_state *state;
 
-        q = start + 1;
+    for (ptag_desc = tag_descs; ptag_desc->tag != NULL; ptag_desc++) {
+        if (ptag_desc->mode != meter->mode || !tic_is_serial(ptag_desc))
+            continue;
+        state = tic_meter_tag(meter, ptag_desc);
+        return state->known ? state->data : NULL;
+    }
+    return NULL;
+}
+
+/**
+ * @brief Publish a meter under another device id.
+ * @param meter Meter, identified.
+ * @param device_id New device id.
+ * @note The old device is reported disconnected. Derived counters are kept per device id.
+ */
+
+static void tic_rename_meter(struct tic_meter *meter, const char *device_id)
+{
+    char old_id[TIC_DEVICE_ID_MAX + 1];
+
+    strcpy(old_id, meter->device_id);
+    tic_meter_set_device_id(meter, device_id);
+    if (strcmp(old_id, meter->device_id) == 0)
+        return;
+
+    if (mosq_tic != NULL)
+        homie_close(mosq_tic, old_id);
+    tic_energy_close(meter->energy);
+    meter->energy = NULL;
+
+    tic_set_device_id(meter, device_id);
+    syslog(LOG_NOTICE, "Meter on %s now published as %s", meter->input.name, meter->device_id);
+    tic_republish_meter(mosq_tic, meter, 1);
+}
+
+/**
+ * @brief Reload the config file, without interrupting the inputs still listed.
+ * @note The file is checked first: an invalid file changes nothing. Filters and
+ *       QoS apply to the next values; a new mode applies to meters added afterwards.
+ *       Homie attributes are published again, only where they changed.
+ */
+
+static void tic_reload(void)
+{
+    struct config_ctx ctx = { 0, 1, 0, 0 };
+    char old_device_id[TIC_DEVICE_ID_MAX + 1];
+    char device_id[2 * (TIC_DEVICE_ID_MAX + 1)]; // Prefix and serial number, truncated by tic_meter_set_device_id().
+    struct tic_meter *meter;
+    const char *serial;
+    int i;
+
+    if (tic_config_load(config_path, tic_config_set, &ctx) < 0) {
+        syslog(LOG_ERR, "Config %s not reloaded", config_path);
+        return;
+    }
 
-        /* Step 6: identify the first character of the tag. */
-        tag = q;
+    strcpy(old_device_id, device_id_tic);
 
-        /* Step 7: identify the first separator of the group. */
-        for (sepp = NULL; q < end - 3; q++) { /* -3 to discard trailing separator before chechesum, checksum and LF. */
-            if (*q == sep) {
-                sepp = q;
-                break;
+    // Filters and inputs missing from the file are dropped; other settings keep their current value.
+    for (i = 0; i < TIC_TAG_COUNT; i++)
+        tag_descs[i].filter = default_filters[i];
+    config_input_count = 0;
+
+    ctx.apply = 1;
+    ctx.input_count = 0;
+    ctx.sink_count = 0;
+    if (tic_config_load(config_path, tic_config_set, &ctx) < 0)
+        syslog(LOG_ERR, "Config %s changed while reloading", config_path);
+    if (ctx.sink_count != config_sink_count)
+        tic_config_restart_needed("sink");
+
+    tic_config_update_inputs();
+
+    for (i = 0; i < meter_count; i++) {
+        meter = meters[i];
+        if (meter->device_id[0] == '\0')
+            continue;
+
+        if (strcmp(old_device_id, device_id_tic) != 0) {
+            if (single_meter) {
+                tic_rename_meter(meter, device_id_tic);
+                continue;
+            }
+            serial = tic_get_serial(meter);
+            if (serial != NULL) {
+                snprintf(device_id, sizeof(device_id), "%s-%s", device_id_tic, serial);
+                tic_rename_meter(meter, device_id);
+                continue;
             }
         }
-        if (sepp == NULL) {
-            syslog(LOG_ERR, "No separator after tag: skip group\n");
+
+        // JSON snapshot and aggregated tags may have changed.
+        if (meter->mode != TIC_MODE_AUTO)
+            tic_set_mode(meter, meter->mode);
+    }
+
+    syslog(LOG_NOTICE, "Config %s reloaded", config_path);
+}
+
+/**
+ * @brief Copy counters of the frame decoder of a meter.
+ * @param meter Meter.
+ */
+
+static void tic_update_counters(struct tic_meter *meter)
+{
+    struct tic_pipeline_stats stats;
+
+    if (meter->pipeline != NULL) {
+        tic_pipeline_get_stats(meter->pipeline, &stats);
+        meter->counters.frames = stats.frames;
+        meter->counters.dropped = stats.dropped;
+        meter->counters.resynced = stats.resynced;
+        meter->counters.overruns = stats.overruns;
+    } else {
+        meter->counters.frames = meter->reader.frames;
+        meter->counters.dropped = meter->reader.dropped;
+        meter->counters.resynced = meter->reader.resynced;
+    }
+}
+
+/**
+ * @brief Export metrics as Homie device statistics and, if requested, to a Prometheus text file.
+ * @param now Current monotonic time.
+ */
+
+static void tic_export_metrics(time_t now)
+{
+    struct broker_stats stats;
+    int i;
+
+    broker_get_stats(mosq_tic, &stats);
+    tic_metrics.publish_failures = stats.failures;
+    tic_metrics.queue_depth = stats.queued;
+    tic_metrics.want_write = stats.want_write;
+
+    for (i = 0; i < meter_count; i++) {
+        tic_update_counters(meters[i]);
+        if (meters[i]->device_id[0] != '\0')
+            tic_metrics_publish_homie(mosq_tic, meters[i], METRICS_INTERVAL, now);
+    }
+
+    if (metrics_path != NULL)
+        tic_metrics_write_prometheus(metrics_path, meters, meter_count);
+}
+
+/**
+ * @brief Publish statistics of the aggregation windows of a meter that ended.
+ * @param meter Meter.
+ * @param wall Current time (s since epoch).
+ * @note A window is also closed by the first value after its end: closing it here
+ *       publishes it on time when values are late or stop.
+ */
+
+static void tic_close_windows(struct tic_meter *meter, time_t wall)
+{
+    const struct tag_desc *ptag_desc;
+    struct tic_stats closed;
+    int window;
+
+    if (meter->stats == NULL || meter->device_id[0] == '\0')
+        return;
+
+    for (ptag_desc = tag_descs; ptag_desc->tag != NULL; ptag_desc++) {
+        for (window = 0; window < tic_stats_window_count(); window++) {
+            if (tic_stats_close(tic_meter_stats(meter, ptag_desc, window), window, wall, &closed))
+                tic_publish_stats(mosq_tic, meter, ptag_desc, window, &closed);
+        }
+    }
+}
+
+/**
+ * @brief Handle periodic housekeeping.
+ * @param src Event source.
+ * @param events Events.
+ */
+
+static void tick_handler(struct event_source *src, uint32_t events)
+{
+    struct tic_meter *meter;
+    time_t now = monotonic_now();
+    time_t wall = time(NULL);
+    int i;
+
+    event_timer_ack(src->fd);
+
+    broker_misc(mosq_tic);
+
+    // Backwards, as a meter whose connection is lost is replaced with the last one.
+    for (i = meter_count - 1; i >= 0; i--) {
+        meter = meters[i];
+
+        tic_close_windows(meter, wall);
+
+        if (meter->input.fd < 0) {
+            if (meter->retry_at != 0 && now >= meter->retry_at && tic_start_meter(meter, now) < 0)
+                meter->retry_at = now + TIC_RETRY_DELAY;
             continue;
         }
 
-        /* Step 8: identify the last character of the tag. */
-        last = sepp;
+        tic_detect_mode(meter, now);
 
-        /* Step 9: extract the tag. */
-        *last = '\0';
+        if (meter->pipeline != NULL) {
+            struct tic_pipeline_stats stats;
 
-        /* Step 10: identify the first character of the tag. */
-        data = q + 1;
+            tic_pipeline_get_stats(meter->pipeline, &stats);
+            if (stats.last_rx > meter->last_rx)
+                meter->last_rx = stats.last_rx;
+        }
 
-        /* Step 11: identify the last character of the tag. */
-        last = end - 2;
+        if (now - meter->last_rx > TIC_TIMEOUT) {
+            syslog(LOG_ERR, "No TIC data received on %s", meter->input.name);
+            tic_input_lost(meter);
+        }
+    }
 
-        /* Step 12: extract the data. */
-        *last = '\0';
+    for (i = 0; i < sink_count; i++)
+        tic_sink_tick(&sinks[i], now);
 
-        tic_process_group(tag, data);
+    if (now - metrics_last >= METRICS_INTERVAL) {
+        metrics_last = now;
+        tic_export_metrics(now);
+    }
 
-#ifdef DEBUG
-        printf("%s %s %c %s\n", tag, data, checksum, tic_is_checksum_ok(tag, data, checksum) ? "OK" : "FAIL");
-#endif // DEBUG
+    if (tic_cache_is_enabled() && now - snapshot_last >= SNAPSHOT_INTERVAL) {
+        snapshot_last = now;
+        tic_cache_save(meters, meter_count);
     }
 }
 
 /**
- * @brief Signal handler.
- * @param signum Signal number.
+ * @brief Handle signals.
+ * @param src Event source.
+ * @param events Events.
  */
 
-static void sighandler(int signum)
+static void signal_handler(struct event_source *src, uint32_t events)
 {
-    syslog(LOG_NOTICE, "Catch signal #%d (%s)\n", signum, strsignal(signum));
-    exit(EXIT_SUCCESS);
+    struct signalfd_siginfo si;
+
+    if (read(src->fd, &si, sizeof(si)) != sizeof(si))
+        return;
+
+    syslog(LOG_NOTICE, "Catch signal #%d (%s)\n", si.ssi_signo, strsignal(si.ssi_signo));
+
+    if (si.ssi_signo == SIGHUP && config_path != NULL) {
+        tic_reload();
+        return;
+    }
+
+    event_loop_stop(&loop);
 }
 
 /**
@@ -439,12 +1452,26 @@ static void sighandler(int signum)
 
 static void cleanup(void)
 {
-    if (fd_tic >= 0)
-        close(fd_tic);
+    int i;
+
+    tic_cache_save(meters, meter_count);
+    while (meter_count > 0)
+        tic_remove_meter(meters[meter_count - 1]);
+    free(meters);
 
-    homie_close(mosq_tic);
+    for (i = 0; i < listener_count; i++)
+        tic_input_close(&listeners[i].input);
 
-    broker_close(mosq_tic);
+    for (i = 0; i < sink_count; i++)
+        tic_sink_stop(&sinks[i]);
+
+    if (mosq_tic != NULL)
+        broker_close(mosq_tic);
+
+    journal_close(&journal_tic);
+    tic_trace_close();
+
+    event_loop_close(&loop);
 
     closelog();
 }
@@ -456,7 +1483,7 @@ static void cleanup(void)
 
 static void usage(const char *progname)
 {
-    fprintf(stderr, "Usage: %s [-Hv] [-t tty] [-h host] [-p port] [-k keepalive]\n", progname);
+    fprintf(stderr, "Usage: %s [-HvRAT5S] [-c config_file] [-t tty|pty:link|tcp:host:port|listen:[host:]port]... [-m auto|legacy|standard] [-j all|changed] [-b all|changed] [-o sink]... [-a windows] [-h host] [-p port] [-k keepalive] [-q journal] [-Q journal_kib] [-P metrics_file] [-d digests_file] [-x trace_file] [-e energy_dir] [-w values_file]\n", progname);
 }
 
 /**
@@ -483,36 +1510,150 @@ static void set_progname(char *argv0)
 int main(int argc, char *argv[])
 {
     int opt;
-    const char *tty = DEFAULT_TTY;
-    const char *host = DEFAULT_HOST;
-    int port = DEFAULT_PORT;
-    int keepalive = DEFAULT_KEEPALIVE;
-    char frame[TIC_FRAME_MAX];
+    struct tic_input inputs[TIC_INPUTS_MAX];
+    int input_count = 0;
+    struct tic_input *input;
+    struct tic_meter *meter;
+    struct config_ctx config = { 1, 0, 0, 0 };
+    int listen_count = 0;
+    time_t now;
+    int i;
+    const char *journal = NULL;
+    int journal_size = DEFAULT_JOURNAL_SIZE;
+    const char *trace = NULL;
+    static const int signums[] = { SIGINT, SIGQUIT, SIGTERM, SIGHUP, 0 };
+    struct event_source tick_src = { .handler = tick_handler, .events = EPOLLIN };
+    struct event_source signal_src = { .handler = signal_handler, .events = EPOLLIN };
 
     set_progname(argv[0]);
 
+    // Filters restored on reload for tags no longer listed in the config file.
+    for (i = 0; i < TIC_TAG_COUNT; i++)
+        default_filters[i] = tag_descs[i].filter;
+
     /* Decode options. */
     opterr = 1;
-    while ((opt = getopt(argc, argv, "vt:h:p:k:H")) != -1) {
+    while ((opt = getopt(argc, argv, "c:vt:m:j:b:o:Ra:Ah:p:k:q:Q:P:d:x:e:w:T5SH")) != -1) {
         switch (opt) {
+        case 'c':
+            // Options given after -c override the config file.
+            config_path = optarg;
+            if (tic_config_load(config_path, tic_config_set, &config) < 0) {
+                fprintf(stderr, "Invalid config file %s\n", config_path);
+                exit(EXIT_FAILURE);
+            }
+            break;
+
         case 'v':
             verbose = 1;
             break;
 
         case 't':
-            tty = optarg;
+            if (input_count == TIC_INPUTS_MAX || tic_input_parse(&inputs[input_count], optarg) < 0) {
+                usage(argv[0]);
+                exit(EXIT_FAILURE);
+            }
+            input_count++;
+            break;
+
+        case 'm':
+            mode_tic = tic_parse_mode(optarg);
+            if (mode_tic < 0) {
+                usage(argv[0]);
+                exit(EXIT_FAILURE);
+            }
+            break;
+
+        case 'j':
+            json_mode = tic_parse_json_mode(optarg);
+            if (json_mode < 0) {
+                usage(argv[0]);
+                exit(EXIT_FAILURE);
+            }
+            break;
+
+        case 'b':
+            cbor_mode = tic_parse_json_mode(optarg);
+            if (cbor_mode < 0) {
+                usage(argv[0]);
+                exit(EXIT_FAILURE);
+            }
+            break;
+
+        case 'o':
+            if (sink_count == TIC_SINKS_MAX || tic_sink_parse(&sinks[sink_count], optarg) < 0) {
+                usage(argv[0]);
+                exit(EXIT_FAILURE);
+            }
+            sink_count++;
+            break;
+
+        case 'R':
+            publish_props = 0;
+            break;
+
+        case 'a':
+            if (strlen(optarg) >= sizeof(windows_tic) || tic_stats_set_windows(optarg) < 0) {
+                usage(argv[0]);
+                exit(EXIT_FAILURE);
+            }
+            strcpy(windows_tic, optarg);
+            break;
+
+        case 'A':
+            publish_aggregated = 0;
             break;
 
         case 'h':
-            host = optarg;
+            snprintf(host_tic, sizeof(host_tic), "%s", optarg);
             break;
 
         case 'p':
-            port = atoi(optarg);
+            port_tic = atoi(optarg);
             break;
 
         case 'k':
-            keepalive = atoi(optarg);
+            keepalive_tic = atoi(optarg);
+            break;
+
+        case 'q':
+            journal = optarg;
+            break;
+
+        case 'Q':
+            journal_size = atoi(optarg);
+            break;
+
+        case 'P':
+            metrics_path = optarg;
+            break;
+
+        case 'd':
+            homie_load_digests(optarg);
+            break;
+
+        case 'T':
+            threaded_tic = 1;
+            break;
+
+        case 'x':
+            trace = optarg;
+            break;
+
+        case 'e':
+            tic_energy_set_dir(optarg);
+            break;
+
+        case 'w':
+            tic_cache_load(optarg);
+            break;
+
+        case '5':
+            mqtt5_tic = 1;
+            break;
+
+        case 'S':
+            tic_timestamps = 1;
             break;
 
         case 'H':
@@ -528,29 +1669,91 @@ int main(int argc, char *argv[])
         }
     }
 
+    if (input_count + config_input_count == 0)
+        tic_input_parse(&inputs[input_count++], DEFAULT_TTY);
+
+    loop.epfd = -1;
     atexit(cleanup);
-    signal(SIGINT, sighandler);
-    signal(SIGQUIT, sighandler);
-    signal(SIGTERM, sighandler);
-    signal(SIGHUP, sighandler);
 
     openlog("tic2mqtt", LOG_PID, LOG_USER);
 
-    mosq_tic = broker_open(host, port, keepalive);
-    if (mosq_tic == NULL)
+    // Inputs given on the command line, then those of the config file.
+    for (i = 0; i < input_count + config_input_count; i++) {
+        input = i < input_count ? &inputs[i] : &config_inputs[i - input_count];
+        if (input->type == TIC_INPUT_LISTEN)
+            listen_count++;
+        else if ((meter = tic_add_meter(input)) == NULL)
+            return EXIT_FAILURE;
+        else
+            meter->configured = i >= input_count;
+    }
+
+    // A lone meter keeps the historical device id. Otherwise, the id of each meter is derived from its serial number.
+    single_meter = meter_count == 1 && listen_count == 0;
+    if (single_meter)
+        tic_set_device_id(meters[0], device_id_tic);
+
+    if (event_loop_init(&loop) < 0)
         return EXIT_FAILURE;
 
-    fd_tic = tic_open(tty);
-    if (fd_tic < 0)
+    signal_src.fd = event_signal_open(signums);
+    if (signal_src.fd < 0 || event_loop_add(&loop, &signal_src) < 0)
+        return EXIT_FAILURE;
+
+    if (journal != NULL) {
+        if (journal_open(&journal_tic, journal, (size_t) journal_size * 1024) < 0)
+            return EXIT_FAILURE;
+        broker_set_journal(&journal_tic);
+    }
+
+    if (trace != NULL) {
+        if (tic_trace_open(trace) < 0)
+            return EXIT_FAILURE;
+        broker_set_publish_cb(tic_published, NULL);
+    }
+
+    broker_set_connect_cb(tic_republish, NULL);
+    broker_set_mqtt5(mqtt5_tic);
+
+    mosq_tic = broker_open(host_tic, port_tic, keepalive_tic);
+    if (mosq_tic == NULL)
         return EXIT_FAILURE;
 
-    homie_init(mosq_tic, tic_attrs);
+    broker_attach(mosq_tic, &loop);
 
-    for (;;) {
-        if (tic_read_frame(fd_tic, frame) < 0)
+    // Signals are blocked already: writer threads leave them to the event loop.
+    for (i = 0; i < sink_count; i++) {
+        if (tic_sink_start(&sinks[i], mosq_tic) < 0)
             return EXIT_FAILURE;
-        tic_process_frame(frame);
     }
 
+    now = metrics_last = snapshot_last = monotonic_now();
+    tic_metrics_init(now);
+
+    for (i = 0; i < meter_count; i++) {
+        if (single_meter && meters[i]->mode != TIC_MODE_AUTO)
+            tic_set_mode(meters[i], meters[i]->mode);
+
+        if (tic_start_meter(meters[i], now) < 0) {
+            // Remote meters may come up later.
+            if (meters[i]->input.type != TIC_INPUT_TCP)
+                return EXIT_FAILURE;
+            meters[i]->retry_at = now + TIC_RETRY_DELAY;
+        }
+    }
+
+    for (i = 0; i < input_count + config_input_count; i++) {
+        input = i < input_count ? &inputs[i] : &config_inputs[i - input_count];
+        if (input->type == TIC_INPUT_LISTEN && tic_add_listener(input, i >= input_count) < 0)
+            return EXIT_FAILURE;
+    }
+
+    tick_src.fd = event_timer_open(TICK_PERIOD);
+    if (tick_src.fd < 0 || event_loop_add(&loop, &tick_src) < 0)
+        return EXIT_FAILURE;
+
+    if (event_loop_run(&loop) < 0)
+        return EXIT_FAILURE;
+
     return EXIT_SUCCESS;
 }
@@ -1,12 +1,49 @@
 #ifndef __TICD_H__
 #define __TICD_H__ 1
 
-#define TIC_QOS 0
+#include <time.h>
+
+#include "homie_helper.h"
+
+#define TIC_QOS 0 /* Default QOS of messages. */
+
+extern int tic_qos; // QOS of messages.
+extern int tic_timestamps; // Add the reception time of frames to property values (MQTT v5).
+
+enum {
+    TIC_MODE_AUTO,     // Detect mode from received frames.
+    TIC_MODE_LEGACY,   // Historique: 1200 bauds, SP separator.
+    TIC_MODE_STANDARD  // Standard: 9600 bauds, HT separator, horodate.
+};
+
+enum {
+    TIC_FILTER_NONE,  // Publish every change.
+    TIC_FILTER_ABS,   // Absolute deadband.
+    TIC_FILTER_PCT,   // Deadband in percent of last published value.
+    TIC_FILTER_ALARM  // Publish every change at once.
+};
+
+/* Publish filter of a tag (see tic_tags.def). */
+
+struct tic_filter {
+    int type;         // Filter type (TIC_FILTER_xxx).
+    int deadband;     // Deadband, in units or percent.
+    int min_interval; // Minimum interval between publications (s).
+    int max_interval; // Maximum interval between publications (s).
+};
+
+#define FILTER_NONE                    { TIC_FILTER_NONE, 0, 0, 0 }
+#define FILTER_ALARM                   { TIC_FILTER_ALARM, 0, 0, 0 }
+#define FILTER_ABS(deadband, min, max) { TIC_FILTER_ABS, deadband, min, max }
+#define FILTER_PCT(deadband, min, max) { TIC_FILTER_PCT, deadband, min, max }
 
 struct tag_desc {
-    const char *tag; // Name of tag.
-    const int len;   // Length of data.
-    char *data;      // Last data received.
+    const char *tag;                     // Name of tag.
+    const int len;                       // Length of data.
+    const int mode;                      // TIC mode sending this tag.
+    const struct homie_prop_attrs attrs; // Homie property attributes.
+    struct tic_filter filter;            // Publish filter, may be changed by the config file.
+    unsigned long checksum_errors;       // Number of groups with wrong checksum, all meters.
 };
 
 #endif /* __TICD_H__ */
@@ -0,0 +1,259 @@
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <syslog.h>
+
+#include "tic2mqtt.h"
+#include "tic_cache.h"
+#include "tic_meter.h"
+#include "tic_tags.h"
+#include "tic_tagtab.h"
+
+#define TIC_CACHE_MAGIC "tic2mqtt-values 1"
+#define TIC_CACHE_LINE_MAX 256
+
+/*
+ * Snapshot of the values published for each meter, one per line:
+ * device id, tag and data separated by tabs, which never appear in data.
+ */
+
+/* Value loaded from snapshot. */
+
+struct tic_cache_entry {
+    char device_id[TIC_DEVICE_ID_MAX + 1]; // Homie device id of meter.
+    const struct tag_desc *ptag_desc;      // Tag description.
+    char *data;                            // Data.
+};
+
+static const char *tic_cache_path = NULL;
+static struct tic_cache_entry *tic_cache_entries = NULL;
+static int tic_cache_count = 0;
+static int tic_cache_size = 0;
+
+/**
+ * @brief Add a value loaded from snapshot.
+ * @param device_id Homie device id of meter.
+ * @param ptag_desc Tag description.
+ * @param data Data.
+ * @return 0 on success, -1 on allocation failure.
+ */
+
+static int tic_cache_add(const char *device_id, const struct tag_desc *ptag_desc, const char *data)
+{
+    struct tic_cache_entry *entries;
+    struct tic_cache_entry *entry;
+
+    if (tic_cache_count == tic_cache_size) {
+        entries = realloc(tic_cache_entries, (tic_cache_size ? tic_cache_size * 2 : 64) * sizeof(*entries));
+        if (entries == NULL)
+            return -1;
+        tic_cache_entries = entries;
+        tic_cache_size = tic_cache_size ? tic_cache_size * 2 : 64;
+    }
+
+    entry = &tic_cache_entries[tic_cache_count];
+    entry->device_id[0] = '\0';
+    strncat(entry->device_id, device_id, TIC_DEVICE_ID_MAX);
+    entry->ptag_desc = ptag_desc;
+    entry->data = strdup(data);
+    if (entry->data == NULL)
+        return -1;
+
+    tic_cache_count++;
+    return 0;
+}
+
+/**
+ * @brief Load values published during a previous run.
+ * @param path Path of snapshot file. It is created or updated by tic_cache_save().
+ */
+
+void tic_cache_load(const char *path)
+{
+    char line[TIC_CACHE_LINE_MAX];
+    const struct tag_desc *ptag_desc;
+    char *tag;
+    char *data;
+    char *end;
+    FILE *fp;
+
+    tic_cache_path = path;
+
+    fp = fopen(path, "r");
+    if (fp == NULL)
+        return;
+
+    if (fgets(line, sizeof(line), fp) == NULL || strcmp(line, TIC_CACHE_MAGIC "\n") != 0) {
+        syslog(LOG_WARNING, "Ignoring value snapshot %s: unknown format", path);
+        fclose(fp);
+        return;
+    }
+
+    while (fgets(line, sizeof(line), fp) != NULL) {
+        end = strchr(line, '\n');
+        tag = strchr(line, '\t');
+        data = tag != NULL ? strchr(tag + 1, '\t') : NULL;
+        if (end == NULL || data == NULL)
+            continue;
+        *end = '\0';
+        *tag++ = '\0';
+        *data++ = '\0';
+
+        ptag_desc = tic_tag_lookup(tag, strlen(tag));
+        if (ptag_desc == NULL || strlen(data) > ptag_desc->len)
+            continue;
+
+        if (tic_cache_add(line, ptag_desc, data) < 0) {
+            syslog(LOG_ERR, "Cannot alloc value snapshot: %s", strerror(errno));
+            break;
+        }
+    }
+
+    fclose(fp);
+}
+
+/**
+ * @brief Tell whether values are snapshotted.
+ * @return 1 if a snapshot file is set, 0 else.
+ */
+
+int tic_cache_is_enabled(void)
+{
+    return tic_cache_path != NULL;
+}
+
+/**
+ * @brief Fill the value cache of a meter from the snapshot, once its device id is known.
+ * @param meter Meter.
+ * @param now Current monotonic time (s).
+ * @note Loaded values are assumed to be retained by the broker: a tag is only
+ *       published again when the data received differs, according to its filter.
+ */
+
+void tic_cache_seed(struct tic_meter *meter, time_t now)
+{
+    const struct tic_cache_entry *entry;
+    struct tic_tag_state *state;
+    int i;
+
+    for (i = 0; i < tic_cache_count; i++) {
+        entry = &tic_cache_entries[i];
+        if (strcmp(entry->device_id, meter->device_id) != 0)
+            continue;
+
+        state = tic_meter_tag(meter, entry->ptag_desc);
+        if (state->known)
+            continue;
+
+        strcpy(state->data, entry->data);
+        state->len = strlen(state->data);
+        state->known = 1;
+        state->cached = 1;
+        state->published = now;
+    }
+}
+
+/**
+ * @brief Keep the values of a meter being removed, for the next snapshots.
+ * @param meter Meter.
+ */
+
+void tic_cache_keep(const struct tic_meter *meter)
+{
+    const struct tic_tag_state *state;
+    int count = 0;
+    int i;
+
+    for (i = 0; i < tic_cache_count; i++) {
+        if (strcmp(tic_cache_entries[i].device_id, meter->device_id) == 0)
+            free(tic_cache_entries[i].data);
+        else
+            tic_cache_entries[count++] = tic_cache_entries[i];
+    }
+    tic_cache_count = count;
+
+    for (i = 0; i < TIC_TAG_COUNT; i++) {
+        state = &meter->tags[i];
+        if (state->known && !state->unsent && tic_cache_add(meter->device_id, &tag_descs[i], state->data) < 0) {
+            syslog(LOG_ERR, "Cannot alloc value snapshot: %s", strerror(errno));
+            return;
+        }
+    }
+}
+
+/**
+ * @brief Tell whether a meter is the first one with its device id.
+ * @param meters Meters.
+ * @param index Index of meter.
+ * @return 1 if no previous meter has the same device id, 0 else.
+ */
+
+static int tic_cache_is_first(struct tic_meter * const *meters, int index)
+{
+    int i;
+
+    for (i = 0; i < index; i++) {
+        if (strcmp(meters[i]->device_id, meters[index]->device_id) == 0)
+            return 0;
+    }
+
+    return 1;
+}
+
+/**
+ * @brief Save values of all meters to the snapshot file.
+ * @param meters Meters.
+ * @param count Number of meters.
+ * @note Values loaded for meters that are not connected are kept. Values
+ *       neither sent nor journaled are left out, to be published after a restart.
+ */
+
+void tic_cache_save(struct tic_meter * const *meters, int count)
+{
+    const struct tic_tag_state *state;
+    const struct tic_cache_entry *entry;
+    char tmp[256];
+    FILE *fp;
+    int err;
+    int i;
+    int j;
+
+    if (tic_cache_path == NULL)
+        return;
+
+    snprintf(tmp, sizeof(tmp), "%s.tmp", tic_cache_path);
+    fp = fopen(tmp, "w");
+    if (fp == NULL) {
+        syslog(LOG_ERR, "Cannot save value snapshot to %s: %s", tic_cache_path, strerror(errno));
+        return;
+    }
+
+    fputs(TIC_CACHE_MAGIC "\n", fp);
+
+    for (i = 0; i < count; i++) {
+        if (meters[i]->device_id[0] == '\0' || !tic_cache_is_first(meters, i))
+            continue;
+
+        for (j = 0; j < TIC_TAG_COUNT; j++) {
+            state = &meters[i]->tags[j];
+            if (state->known && !state->unsent)
+                fprintf(fp, "%s\t%s\t%s\n", meters[i]->device_id, tag_descs[j].tag, state->data);
+        }
+    }
+
+    for (i = 0; i < tic_cache_count; i++) {
+        entry = &tic_cache_entries[i];
+        for (j = 0; j < count; j++) {
+            if (strcmp(meters[j]->device_id, entry->device_id) == 0)
+                break;
+        }
+        if (j == count)
+            fprintf(fp, "%s\t%s\t%s\n", entry->device_id, entry->ptag_desc->tag, entry->data);
+    }
+
+    err = ferror(fp);
+    if (fclose(fp) != 0 || err || rename(tmp, tic_cache_path) < 0)
+        syslog(LOG_ERR, "Cannot save value snapshot to %s: %s", tic_cache_path, strerror(errno));
+}
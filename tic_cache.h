@@ -0,0 +1,14 @@
+#ifndef __TIC_CACHE_H__
+#define __TIC_CACHE_H__ 1
+
+#include <time.h>
+
+struct tic_meter;
+
+extern void tic_cache_load(const char *path);
+extern int tic_cache_is_enabled(void);
+extern void tic_cache_seed(struct tic_meter *meter, time_t now);
+extern void tic_cache_keep(const struct tic_meter *meter);
+extern void tic_cache_save(struct tic_meter * const *meters, int count);
+
+#endif /* __TIC_CACHE_H__ */
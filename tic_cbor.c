@@ -0,0 +1,165 @@
+#include <stdint.h>
+#include <string.h>
+
+#include "homie_helper.h"
+#include "tic2mqtt.h"
+#include "tic_cbor.h"
+#include "tic_publish.h"
+#include "tic_tags.h"
+
+/* CBOR major types. */
+
+#define CBOR_UINT   0
+#define CBOR_TEXT   3
+#define CBOR_ARRAY  4
+
+#define CBOR_MAP_INDEFINITE 0xbf
+#define CBOR_BREAK          0xff
+
+/**
+ * @brief Append bytes to document.
+ * @param cbor CBOR document.
+ * @param s Bytes.
+ * @param n Number of bytes.
+ */
+
+static void tic_cbor_append(struct tic_cbor *cbor, const void *s, int n)
+{
+    if (cbor->len + n > TIC_CBOR_MAX) {
+        cbor->overflow = 1;
+        return;
+    }
+
+    memcpy(cbor->buf + cbor->len, s, n);
+    cbor->len += n;
+}
+
+/**
+ * @brief Append head of a data item, in its shortest form.
+ * @param cbor CBOR document.
+ * @param major Major type.
+ * @param value Value, length or count of items.
+ */
+
+static void tic_cbor_head(struct tic_cbor *cbor, int major, uint64_t value)
+{
+    unsigned char head[9];
+    int n;
+    int i;
+
+    if (value < 24) {
+        head[0] = major << 5 | value;
+        tic_cbor_append(cbor, head, 1);
+        return;
+    }
+
+    if (value <= UINT8_MAX) {
+        head[0] = major << 5 | 24;
+        n = 1;
+    } else if (value <= UINT16_MAX) {
+        head[0] = major << 5 | 25;
+        n = 2;
+    } else if (value <= UINT32_MAX) {
+        head[0] = major << 5 | 26;
+        n = 4;
+    } else {
+        head[0] = major << 5 | 27;
+        n = 8;
+    }
+
+    // Network byte order.
+    for (i = n; i > 0; i--, value >>= 8)
+        head[i] = value & 0xff;
+    tic_cbor_append(cbor, head, n + 1);
+}
+
+/**
+ * @brief Find the code of an enum value.
+ * @param ptag_desc Tag description.
+ * @param data Data.
+ * @return Index of data in the values of the tag, -1 if the tag is not an enum or data is unknown.
+ */
+
+static int tic_cbor_enum_code(const struct tag_desc *ptag_desc, const char *data)
+{
+    const char * const *values = ptag_desc->attrs.values;
+    int i;
+
+    if (ptag_desc->attrs.datatype != HOMIE_ENUM || values == NULL)
+        return -1;
+
+    for (i = 0; values[i] != NULL; i++) {
+        if (strcmp(values[i], data) == 0)
+            return i;
+    }
+
+    return -1;
+}
+
+/**
+ * @brief Start a frame snapshot.
+ * @param cbor CBOR document.
+ * @param seq Frame sequence number.
+ * @param timestamp Frame reception time (ms since Epoch).
+ */
+
+void tic_cbor_begin(struct tic_cbor *cbor, unsigned long seq, long long timestamp)
+{
+    static const unsigned char map = CBOR_MAP_INDEFINITE;
+
+    cbor->len = 0;
+    cbor->count = 0;
+    cbor->overflow = 0;
+
+    tic_cbor_head(cbor, CBOR_ARRAY, 4);
+    tic_cbor_head(cbor, CBOR_UINT, TIC_CBOR_VERSION);
+    tic_cbor_head(cbor, CBOR_UINT, seq);
+    tic_cbor_head(cbor, CBOR_UINT, timestamp);
+    // The number of values is only known at the end of the frame.
+    tic_cbor_append(cbor, &map, 1);
+}
+
+/**
+ * @brief Add a value to the frame snapshot.
+ * @param cbor CBOR document.
+ * @param ptag_desc Tag description. Its index in tic_tags.def is used as key.
+ * @param data Data. Integer properties are written as unsigned integers, enum
+ *        properties as the index of data in their values, others as text.
+ */
+
+void tic_cbor_add(struct tic_cbor *cbor, const struct tag_desc *ptag_desc, const char *data)
+{
+    uint64_t value;
+    int code;
+
+    tic_cbor_head(cbor, CBOR_UINT, ptag_desc - tag_descs);
+
+    if (tic_value_integer(ptag_desc, data, &value) != NULL) {
+        tic_cbor_head(cbor, CBOR_UINT, value);
+    } else if ((code = tic_cbor_enum_code(ptag_desc, data)) >= 0) {
+        tic_cbor_head(cbor, CBOR_UINT, code);
+    } else {
+        // Strings, and integers or enum values that do not parse, are kept as text.
+        tic_cbor_head(cbor, CBOR_TEXT, strlen(data));
+        tic_cbor_append(cbor, data, strlen(data));
+    }
+
+    cbor->count++;
+}
+
+/**
+ * @brief Terminate the frame snapshot.
+ * @param cbor CBOR document.
+ * @return Length of document, -1 if it did not fit in TIC_CBOR_MAX.
+ */
+
+int tic_cbor_end(struct tic_cbor *cbor)
+{
+    static const unsigned char brk = CBOR_BREAK;
+
+    tic_cbor_append(cbor, &brk, 1);
+    if (cbor->overflow)
+        return -1;
+
+    return cbor->len;
+}
@@ -0,0 +1,26 @@
+#ifndef __TIC_CBOR_H__
+#define __TIC_CBOR_H__ 1
+
+#define TIC_CBOR_MAX 2048
+#define TIC_CBOR_VERSION 1 /* Schema version, to bump when tags are renumbered. */
+
+struct tag_desc;
+
+/*
+ * Binary (CBOR, RFC 8949) snapshot of one frame: an array of 4 items, schema
+ * version, frame sequence number, reception time (ms since Epoch) and a map of
+ * values keyed by the index of their tag in tic_tags.def.
+ */
+
+struct tic_cbor {
+    unsigned char buf[TIC_CBOR_MAX]; // Document.
+    int len;                         // Length of document.
+    int count;                       // Number of values added.
+    int overflow;                    // Set if a value did not fit.
+};
+
+extern void tic_cbor_begin(struct tic_cbor *cbor, unsigned long seq, long long timestamp);
+extern void tic_cbor_add(struct tic_cbor *cbor, const struct tag_desc *ptag_desc, const char *data);
+extern int tic_cbor_end(struct tic_cbor *cbor);
+
+#endif /* __TIC_CBOR_H__ */
@@ -0,0 +1,88 @@
+#include <ctype.h>
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <syslog.h>
+
+#include "tic_config.h"
+
+#define TIC_CONFIG_LINE_MAX 512
+
+/**
+ * @brief Strip leading and trailing blanks of a string.
+ * @param str String, modified in place.
+ * @return Start of stripped string.
+ */
+
+static char *tic_config_strip(char *str)
+{
+    char *end;
+
+    while (isspace((unsigned char) *str))
+        str++;
+
+    end = str + strlen(str);
+    while (end > str && isspace((unsigned char) end[-1]))
+        end--;
+    *end = '\0';
+
+    return str;
+}
+
+/**
+ * @brief Read a config file.
+ * @param path Path of config file.
+ * @param cb Called for each setting, in order.
+ * @param userdata User data for cb.
+ * @return 0 on success, -1 if the file cannot be read or has an invalid line.
+ * @note Each line holds a "key = value" setting. Blank lines and lines starting with '#' are ignored.
+ */
+
+int tic_config_load(const char *path, tic_config_cb cb, void *userdata)
+{
+    char line[TIC_CONFIG_LINE_MAX];
+    char *key;
+    char *value;
+    int lineno = 0;
+    int res = 0;
+    FILE *fp;
+
+    fp = fopen(path, "r");
+    if (fp == NULL) {
+        syslog(LOG_ERR, "Cannot open config %s: %s", path, strerror(errno));
+        return -1;
+    }
+
+    while (res == 0 && fgets(line, sizeof(line), fp) != NULL) {
+        lineno++;
+
+        if (strchr(line, '\n') == NULL && !feof(fp)) {
+            syslog(LOG_ERR, "%s:%d: line too long", path, lineno);
+            res = -1;
+            break;
+        }
+
+        key = tic_config_strip(line);
+        if (*key == '\0' || *key == '#')
+            continue;
+
+        value = strchr(key, '=');
+        if (value == NULL) {
+            syslog(LOG_ERR, "%s:%d: missing '='", path, lineno);
+            res = -1;
+            break;
+        }
+        *value++ = '\0';
+        key = tic_config_strip(key);
+        value = tic_config_strip(value);
+
+        if (cb(key, value, userdata) < 0) {
+            syslog(LOG_ERR, "%s:%d: invalid setting %s = %s", path, lineno, key, value);
+            res = -1;
+        }
+    }
+
+    fclose(fp);
+    return res;
+}
@@ -0,0 +1,10 @@
+#ifndef __TIC_CONFIG_H__
+#define __TIC_CONFIG_H__ 1
+
+/* Called for each setting of the config file. Returns 0 on success, -1 if the key or value is invalid. */
+
+typedef int (*tic_config_cb)(const char *key, const char *value, void *userdata);
+
+extern int tic_config_load(const char *path, tic_config_cb cb, void *userdata);
+
+#endif /* __TIC_CONFIG_H__ */
@@ -0,0 +1,489 @@
+#include <errno.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <fcntl.h>
+#include <syslog.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+#include "homie_helper.h"
+#include "tic2mqtt.h"
+#include "tic_energy.h"
+#include "tic_tags.h"
+#include "tic_tagtab.h"
+
+#define TIC_ENERGY_MAGIC    0x47524e45 /* "ENRG" */
+#define TIC_ENERGY_VERSION  1
+#define TIC_ENERGY_COUNTERS 32 /* Counters in a state file, more than the energy indexes sent by a meter. */
+#define TIC_ENERGY_TAG_MAX  15
+
+#define TIC_ENERGY_POWER_INTERVAL 10000 /* Minimum interval between power samples (ms). */
+
+#define TIC_ENERGY_ID_MAX   31
+#define TIC_ENERGY_NAME_MAX 127
+
+/* Consumption counter of an energy index, in the state file. */
+
+struct tic_energy_counter {
+    char tag[TIC_ENERGY_TAG_MAX + 1];       // Label of index tag, empty if slot is free.
+    uint64_t index;                         // Last index (Wh).
+    uint64_t base[TIC_ENERGY_PERIOD_COUNT]; // Index at start of current period (Wh).
+    int64_t start[TIC_ENERGY_PERIOD_COUNT]; // Start of current period (s since epoch).
+};
+
+/* Header at the start of the state file, followed by TIC_ENERGY_COUNTERS counters. */
+
+struct tic_energy_header {
+    uint32_t magic;                  // TIC_ENERGY_MAGIC.
+    uint32_t version;                // TIC_ENERGY_VERSION.
+    uint32_t counter_size;           // Size of a counter.
+    uint32_t capacity;               // Number of counters.
+    struct tic_energy_counter total; // Sum of the indexes of all tariff periods.
+    int64_t power_time;              // Time of last power sample (ms since epoch), 0 if none.
+    uint64_t power_index;            // Total at power_time (Wh).
+    int64_t power;                   // Average power since previous sample (W), -1 if unknown.
+    uint64_t reserved[4];
+};
+
+/* Derived counters of a meter, mapped from its state file. */
+
+struct tic_energy {
+    int fd;                              // State file.
+    struct tic_energy_header *header;    // Mapped file: header, then counters.
+    struct tic_energy_counter *counters; // Counters.
+    signed char slots[TIC_TAG_COUNT];    // Counter of each tag, -1 until first received.
+    uint64_t total_delta;                // Energy counted by the current frame (Wh).
+};
+
+/* Homie property of consumption over one period. */
+
+struct tic_energy_prop {
+    struct homie_prop_attrs attrs;       // Homie property attributes.
+    char prop_id[TIC_ENERGY_ID_MAX + 1]; // Storage for attrs.prop_id.
+    char name[TIC_ENERGY_NAME_MAX + 1];  // Storage for attrs.name.
+};
+
+const struct homie_prop_attrs tic_energy_power_attrs = {
+    "power", "Puissance active moyenne", HOMIE_INTEGER, "W", NULL
+};
+
+static const struct homie_prop_attrs tic_energy_total_attrs = {
+    "energy", "Energie active soutirée", HOMIE_INTEGER, "Wh", NULL
+};
+
+static const char * const tic_energy_period_ids[TIC_ENERGY_PERIOD_COUNT] = { "hour", "day", "month" };
+
+static const char *tic_energy_dir = NULL;
+
+// Properties of each tag, then of the total.
+static struct tic_energy_prop *tic_energy_props[TIC_TAG_COUNT + 1];
+
+// Start of current periods, computed once per second.
+static time_t tic_energy_wall = -1;
+static time_t tic_energy_starts[TIC_ENERGY_PERIOD_COUNT];
+
+/**
+ * @brief Set directory of state files and enable derived counters.
+ * @param dir Directory.
+ */
+
+void tic_energy_set_dir(const char *dir)
+{
+    tic_energy_dir = dir;
+}
+
+/**
+ * @brief Tell whether derived counters are enabled.
+ * @return 1 if enabled, 0 else.
+ */
+
+int tic_energy_is_enabled(void)
+{
+    return tic_energy_dir != NULL;
+}
+
+/**
+ * @brief Tell whether a tag is an energy index.
+ * @param ptag_desc Tag description.
+ * @return 1 for indexes in Wh, 0 else.
+ */
+
+int tic_energy_is_counter(const struct tag_desc *ptag_desc)
+{
+    return ptag_desc->attrs.datatype == HOMIE_INTEGER && strcmp(ptag_desc->attrs.unit, "Wh") == 0;
+}
+
+/**
+ * @brief Tell whether an energy index counts towards the total.
+ * @param ptag_desc Tag description.
+ * @return 1 for tariff periods of the provider, 0 for totals, distributor periods and injection.
+ * @note In standard mode, EAST and the EASDxx indexes of the distributor add up to the
+ *       same energy as the EASFxx indexes.
+ */
+
+static int tic_energy_is_import(const struct tag_desc *ptag_desc)
+{
+    return ptag_desc->mode == TIC_MODE_LEGACY || strncmp(ptag_desc->tag, "EASF", 4) == 0;
+}
+
+/**
+ * @brief Open state file of a meter, creating it if needed.
+ * @param device_id Homie device id of the meter, naming its state file.
+ * @return Derived counters, NULL on failure.
+ * @note Counters left by a previous run are kept if the format matches.
+ */
+
+struct tic_energy *tic_energy_open(const char *device_id)
+{
+    struct tic_energy *energy;
+    struct tic_energy_header *header;
+    char path[PATH_MAX];
+    size_t size = sizeof(*header) + TIC_ENERGY_COUNTERS * sizeof(struct tic_energy_counter);
+    void *map;
+
+    snprintf(path, sizeof(path), "%s/%s.energy", tic_energy_dir, device_id);
+
+    energy = calloc(1, sizeof(*energy));
+    if (energy == NULL) {
+        syslog(LOG_ERR, "Cannot alloc energy counters: %s", strerror(errno));
+        return NULL;
+    }
+    memset(energy->slots, -1, sizeof(energy->slots));
+
+    energy->fd = open(path, O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+    if (energy->fd < 0) {
+        syslog(LOG_ERR, "Cannot open energy state %s: %s", path, strerror(errno));
+        free(energy);
+        return NULL;
+    }
+
+    if (ftruncate(energy->fd, size) < 0) {
+        syslog(LOG_ERR, "Cannot size energy state %s: %s", path, strerror(errno));
+        tic_energy_close(energy);
+        return NULL;
+    }
+
+    map = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, energy->fd, 0);
+    if (map == MAP_FAILED) {
+        syslog(LOG_ERR, "Cannot map energy state %s: %s", path, strerror(errno));
+        tic_energy_close(energy);
+        return NULL;
+    }
+
+    header = map;
+    if (header->magic != TIC_ENERGY_MAGIC || header->version != TIC_ENERGY_VERSION ||
+        header->counter_size != sizeof(struct tic_energy_counter) || header->capacity != TIC_ENERGY_COUNTERS) {
+        memset(map, 0, size);
+        header->version = TIC_ENERGY_VERSION;
+        header->counter_size = sizeof(struct tic_energy_counter);
+        header->capacity = TIC_ENERGY_COUNTERS;
+        header->power = -1;
+        header->magic = TIC_ENERGY_MAGIC;
+    }
+
+    energy->header = header;
+    energy->counters = (struct tic_energy_counter *) (header + 1);
+
+    return energy;
+}
+
+/**
+ * @brief Close state file of a meter.
+ * @param energy Derived counters. May be NULL.
+ */
+
+void tic_energy_close(struct tic_energy *energy)
+{
+    if (energy == NULL)
+        return;
+
+    if (energy->header != NULL)
+        munmap(energy->header, sizeof(*energy->header) + TIC_ENERGY_COUNTERS * sizeof(struct tic_energy_counter));
+    close(energy->fd);
+    free(energy);
+}
+
+/**
+ * @brief Compute start of current periods in local time.
+ * @param wall Current time (s since epoch).
+ */
+
+static void tic_energy_update_starts(time_t wall)
+{
+    struct tm tm;
+
+    if (wall == tic_energy_wall)
+        return;
+    tic_energy_wall = wall;
+
+    // Keep the DST flag for the hour, which may be repeated when DST ends.
+    localtime_r(&wall, &tm);
+    tm.tm_sec = 0;
+    tm.tm_min = 0;
+    tic_energy_starts[TIC_ENERGY_HOUR] = mktime(&tm);
+
+    tm.tm_hour = 0;
+    tm.tm_isdst = -1;
+    tic_energy_starts[TIC_ENERGY_DAY] = mktime(&tm);
+
+    tm.tm_mday = 1;
+    tm.tm_isdst = -1;
+    tic_energy_starts[TIC_ENERGY_MONTH] = mktime(&tm);
+}
+
+/**
+ * @brief Get counter of a tag, allocating it on first use.
+ * @param energy Derived counters.
+ * @param ptag_desc Tag description.
+ * @return Counter, NULL if the state file is full.
+ */
+
+static struct tic_energy_counter *tic_energy_counter(struct tic_energy *energy, const struct tag_desc *ptag_desc)
+{
+    signed char *slot = &energy->slots[ptag_desc - tag_descs];
+    struct tic_energy_counter *counter;
+    int free_slot = -1;
+    int i;
+
+    if (*slot >= 0)
+        return &energy->counters[(int) *slot];
+
+    for (i = 0; i < TIC_ENERGY_COUNTERS; i++) {
+        counter = &energy->counters[i];
+        if (strcmp(counter->tag, ptag_desc->tag) == 0) {
+            *slot = i;
+            return counter;
+        }
+        if (counter->tag[0] == '\0' && free_slot < 0)
+            free_slot = i;
+    }
+
+    if (free_slot < 0)
+        return NULL;
+
+    // A new counter starts all its periods from the first index received.
+    counter = &energy->counters[free_slot];
+    memset(counter, 0, sizeof(*counter));
+    strncat(counter->tag, ptag_desc->tag, TIC_ENERGY_TAG_MAX);
+    counter->index = UINT64_MAX;
+    *slot = free_slot;
+
+    return counter;
+}
+
+/**
+ * @brief Update a counter with an index.
+ * @param counter Counter.
+ * @param index Index (Wh).
+ * @param changed Set to 1 if the consumption of a period changed.
+ * @return Energy counted since the previous index (Wh).
+ */
+
+static uint64_t tic_energy_count(struct tic_energy_counter *counter, uint64_t index, int *changed)
+{
+    uint64_t delta = 0;
+    int period;
+
+    if (counter->index == UINT64_MAX) {
+        counter->index = index;
+        *changed = 1;
+    }
+
+    for (period = 0; period < TIC_ENERGY_PERIOD_COUNT; period++) {
+        if (counter->start[period] != tic_energy_starts[period]) {
+            counter->base[period] = counter->index;
+            counter->start[period] = tic_energy_starts[period];
+            *changed = 1;
+        }
+    }
+
+    if (index < counter->index) {
+        // Meter replaced or index reset: count current periods again from the new index.
+        for (period = 0; period < TIC_ENERGY_PERIOD_COUNT; period++)
+            counter->base[period] = index;
+        *changed = 1;
+    } else if (index > counter->index) {
+        delta = index - counter->index;
+        *changed = 1;
+    }
+    counter->index = index;
+
+    return delta;
+}
+
+/**
+ * @brief Get consumption of the current periods from a counter.
+ * @param counter Counter.
+ * @param consumption Filled with consumption over each period (Wh).
+ */
+
+static void tic_energy_consumption(const struct tic_energy_counter *counter, uint64_t *consumption)
+{
+    int period;
+
+    for (period = 0; period < TIC_ENERGY_PERIOD_COUNT; period++)
+        consumption[period] = counter->index - counter->base[period];
+}
+
+/**
+ * @brief Add an energy index received from the meter.
+ * @param energy Derived counters.
+ * @param ptag_desc Tag description of an energy index.
+ * @param data Data.
+ * @param wall Time of reception (s since epoch).
+ * @param consumption Filled with consumption over each period (Wh).
+ * @return 1 if the consumption of a period changed, 0 else.
+ */
+
+int tic_energy_add(struct tic_energy *energy, const struct tag_desc *ptag_desc, const char *data, time_t wall, uint64_t *consumption)
+{
+    struct tic_energy_counter *counter;
+    unsigned long long index;
+    uint64_t delta;
+    int changed = 0;
+    char *end;
+
+    index = strtoull(data, &end, 10);
+    if (end == data || *end != '\0')
+        return 0;
+
+    counter = tic_energy_counter(energy, ptag_desc);
+    if (counter == NULL)
+        return 0;
+
+    tic_energy_update_starts(wall);
+    delta = tic_energy_count(counter, index, &changed);
+    if (tic_energy_is_import(ptag_desc))
+        energy->total_delta += delta;
+
+    tic_energy_consumption(counter, consumption);
+    return changed;
+}
+
+/**
+ * @brief Update the total and the average power once all groups of a frame are added.
+ * @param energy Derived counters.
+ * @param wall_ms Time of reception (ms since epoch).
+ * @param consumption Filled with consumption of all tariff periods over each period (Wh).
+ * @param power Filled with average power (W).
+ * @return TIC_ENERGY_TOTAL_CHANGED and TIC_ENERGY_POWER_CHANGED flags.
+ * @note The power is averaged between changes of the total at least
+ *       TIC_ENERGY_POWER_INTERVAL apart. While the total does not change, it
+ *       decreases to at most 1 Wh over the time since the last change.
+ */
+
+int tic_energy_end_frame(struct tic_energy *energy, int64_t wall_ms, uint64_t *consumption, long *power)
+{
+    struct tic_energy_header *header = energy->header;
+    int64_t elapsed;
+    int64_t bound;
+    int changed = 0;
+    int result = 0;
+
+    tic_energy_update_starts(wall_ms / 1000);
+    tic_energy_count(&header->total, header->total.index + energy->total_delta, &changed);
+    energy->total_delta = 0;
+    if (changed)
+        result |= TIC_ENERGY_TOTAL_CHANGED;
+    tic_energy_consumption(&header->total, consumption);
+
+    elapsed = wall_ms - header->power_time;
+    if (header->power_time == 0 || elapsed <= 0 || header->total.index < header->power_index) {
+        header->power_time = wall_ms;
+        header->power_index = header->total.index;
+    } else if (header->total.index > header->power_index) {
+        if (elapsed >= TIC_ENERGY_POWER_INTERVAL) {
+            header->power = (header->total.index - header->power_index) * 3600000 / elapsed;
+            header->power_time = wall_ms;
+            header->power_index = header->total.index;
+            result |= TIC_ENERGY_POWER_CHANGED;
+        }
+    } else if (header->power > 0) {
+        bound = 3600000 / elapsed;
+        if (bound * 10 < header->power * 9) {
+            header->power = bound;
+            result |= TIC_ENERGY_POWER_CHANGED;
+        }
+    }
+
+    *power = header->power;
+    return result;
+}
+
+/**
+ * @brief Get consumption of the current periods.
+ * @param energy Derived counters.
+ * @param ptag_desc Tag description of an energy index, NULL for the total.
+ * @param consumption Filled with consumption over each period (Wh).
+ * @return 0 on success, -1 if no index was received for this tag.
+ */
+
+int tic_energy_get(const struct tic_energy *energy, const struct tag_desc *ptag_desc, uint64_t *consumption)
+{
+    const struct tic_energy_counter *counter;
+    int slot;
+
+    if (ptag_desc == NULL) {
+        counter = &energy->header->total;
+    } else {
+        slot = energy->slots[ptag_desc - tag_descs];
+        if (slot < 0)
+            return -1;
+        counter = &energy->counters[slot];
+    }
+
+    if (counter->index == UINT64_MAX || counter->start[0] == 0)
+        return -1;
+
+    tic_energy_consumption(counter, consumption);
+    return 0;
+}
+
+/**
+ * @brief Get average power.
+ * @param energy Derived counters.
+ * @return Average power (W), -1 if unknown.
+ */
+
+long tic_energy_get_power(const struct tic_energy *energy)
+{
+    return energy->header->power;
+}
+
+/**
+ * @brief Get Homie property of the consumption of a tag over a period, e.g. "hchc-day".
+ * @param ptag_desc Tag description of an energy index, NULL for the total ("energy-day").
+ * @param period Period (TIC_ENERGY_xxx).
+ * @return Property attributes, NULL on failure.
+ */
+
+const struct homie_prop_attrs *tic_energy_prop_attrs(const struct tag_desc *ptag_desc, int period)
+{
+    const struct homie_prop_attrs *tag_attrs = ptag_desc != NULL ? &ptag_desc->attrs : &tic_energy_total_attrs;
+    struct tic_energy_prop **pprops = &tic_energy_props[ptag_desc != NULL ? ptag_desc - tag_descs : TIC_TAG_COUNT];
+    int p;
+
+    if (*pprops == NULL) {
+        *pprops = malloc(sizeof(**pprops) * TIC_ENERGY_PERIOD_COUNT);
+        if (*pprops == NULL) {
+            syslog(LOG_ERR, "Cannot alloc consumption properties for %s: %s\n", tag_attrs->prop_id, strerror(errno));
+            return NULL;
+        }
+
+        for (p = 0; p < TIC_ENERGY_PERIOD_COUNT; p++) {
+            struct tic_energy_prop *prop = &(*pprops)[p];
+            const struct homie_prop_attrs attrs = {
+                prop->prop_id, prop->name, HOMIE_INTEGER, "Wh", NULL
+            };
+
+            memcpy(&prop->attrs, &attrs, sizeof(attrs));
+            snprintf(prop->prop_id, sizeof(prop->prop_id), "%s-%s", tag_attrs->prop_id, tic_energy_period_ids[p]);
+            snprintf(prop->name, sizeof(prop->name), "%s (%s)", tag_attrs->name, tic_energy_period_ids[p]);
+        }
+    }
+
+    return &(*pprops)[period].attrs;
+}
@@ -0,0 +1,40 @@
+#ifndef __TIC_ENERGY_H__
+#define __TIC_ENERGY_H__ 1
+
+#include <stdint.h>
+#include <time.h>
+
+#define TIC_ENERGY_PAYLOAD_MAX 24
+
+struct tag_desc;
+struct homie_prop_attrs;
+struct tic_energy;
+
+/* Calendar periods of consumption, in local time. */
+
+enum {
+    TIC_ENERGY_HOUR,
+    TIC_ENERGY_DAY,
+    TIC_ENERGY_MONTH,
+    TIC_ENERGY_PERIOD_COUNT
+};
+
+/* Results of tic_energy_end_frame(). */
+
+#define TIC_ENERGY_TOTAL_CHANGED 0x1 // Consumption of all tariff periods changed.
+#define TIC_ENERGY_POWER_CHANGED 0x2 // Average power changed.
+
+extern const struct homie_prop_attrs tic_energy_power_attrs;
+
+extern void tic_energy_set_dir(const char *dir);
+extern int tic_energy_is_enabled(void);
+extern int tic_energy_is_counter(const struct tag_desc *ptag_desc);
+extern struct tic_energy *tic_energy_open(const char *device_id);
+extern void tic_energy_close(struct tic_energy *energy);
+extern int tic_energy_add(struct tic_energy *energy, const struct tag_desc *ptag_desc, const char *data, time_t wall, uint64_t *consumption);
+extern int tic_energy_end_frame(struct tic_energy *energy, int64_t wall_ms, uint64_t *consumption, long *power);
+extern int tic_energy_get(const struct tic_energy *energy, const struct tag_desc *ptag_desc, uint64_t *consumption);
+extern long tic_energy_get_power(const struct tic_energy *energy);
+extern const struct homie_prop_attrs *tic_energy_prop_attrs(const struct tag_desc *ptag_desc, int period);
+
+#endif /* __TIC_ENERGY_H__ */
@@ -0,0 +1,200 @@
+#include <stdio.h>
+#include <string.h>
+
+#include <syslog.h>
+
+#include "tic2mqtt.h"
+#include "tic_frame.h"
+#include "tic_scan.h"
+#include "tic_tags.h"
+
+/**
+ * @brief Verify the checksum of a group.
+ * @param start First character of the group covered by checksum.
+ * @param end Last character of the group covered by checksum.
+ * @param checksum Checksum.
+ * @return 1 if checksum is valid, 0 else.
+ */
+
+int tic_is_checksum_ok(const char *start, const char *end, char checksum)
+{
+    unsigned char sum = 0x00;
+
+    while (start <= end) {
+        sum += *start++;
+    }
+
+    sum = ' ' + (sum & 0x3f);
+
+#ifdef DEBUG
+    printf("Checksum read: %02x computed: %02x", checksum, sum);
+#endif // DEBUG
+
+    return sum == checksum;
+}
+
+/**
+ * @brief Dispatch group if tag is known for mode.
+ * @param tag Tag.
+ * @param taglen Length of tag.
+ * @param horodate Horodate (standard mode), followed by its separator. May be NULL.
+ * @param horodate_len Length of horodate.
+ * @param data Data, followed by its separator.
+ * @param len Length of data.
+ * @param mode Current TIC mode.
+ * @param cb Group callback.
+ * @param userdata User data passed to callback.
+ * @note For groups carrying only a horodate (DATE), the horodate is used as data.
+ *       The separator after the data passed to cb is replaced with a NUL.
+ */
+
+static void tic_process_group(const char *tag, int taglen, char *horodate, int horodate_len, char *data, int len,
+                              int mode, tic_group_cb cb, void *userdata)
+{
+    struct tag_desc *ptag_desc;
+
+    if (mode == TIC_MODE_AUTO)
+        return; // Mode not detected yet.
+
+    ptag_desc = tic_tag_lookup(tag, taglen);
+    if (ptag_desc == NULL || ptag_desc->mode != mode)
+        return;
+
+    if (len == 0 && horodate != NULL) {
+        data = horodate;
+        len = horodate_len;
+    }
+    data[len] = '\0';
+
+    cb(ptag_desc, data, len, userdata);
+}
+
+/**
+ * @brief Count a wrong checksum against the tag of a group, if it can be read.
+ * @param start First character of the group.
+ * @param end End of the group, before the separator preceding the checksum.
+ */
+
+static void tic_count_checksum_error(const char *start, const char *end)
+{
+    struct tag_desc *ptag_desc;
+    const char *sepp;
+
+    for (sepp = start; sepp < end && *sepp != ' ' && *sepp != '\t'; sepp++)
+        ;
+
+    ptag_desc = tic_tag_lookup(start, sepp - start);
+    if (ptag_desc != NULL)
+        ptag_desc->checksum_errors++;
+}
+
+/**
+ * @brief Process TIC frame (legacy or standard mode).
+ * @param frame TIC frame, ending with ETX. The separator after the data of
+ *        each group passed to cb is replaced with a NUL; data is not copied.
+ * @param len Length of frame.
+ * @param mode Current TIC mode. With TIC_MODE_AUTO, groups are only checked.
+ * @param cb Callback called for each valid group whose tag is known for mode.
+ * @param userdata User data passed to callback.
+ * @param info Frame statistics, filled on return. May be NULL.
+ */
+
+void tic_process_frame(char *frame, int len, int mode, tic_group_cb cb, void *userdata, struct tic_frame_info *info)
+{
+    struct tic_group groups[TIC_GROUPS_MAX];
+    struct tic_frame_info dummy;
+    int unterminated;
+    int count;
+    int i;
+
+    if (info == NULL)
+        info = &dummy;
+    memset(info, 0, sizeof(*info));
+
+    /* Step 1: find all groups and their sums in one pass (ETX excluded). */
+    count = tic_scan_frame(frame, len - 1, groups, TIC_GROUPS_MAX, &unterminated);
+
+    if (unterminated > 0)
+        syslog(LOG_ERR, "Unterminated group\n");
+
+    info->groups = count + unterminated;
+
+    for (i = 0; i < count; i++) {
+        char *start = frame + groups[i].start;
+        char *end = frame + groups[i].end;
+        unsigned char sum = groups[i].sum;
+        char checksum;
+        char sep;
+        char *tag;
+        char *sepp;
+        char *horodate;
+        char *data;
+        char *q;
+        int horodate_len;
+
+        if (end - start < 3) {
+            syslog(LOG_ERR, "Group too short: skip group\n");
+            info->errors++;
+            continue;
+        }
+
+        /* Step 2: identify the checksum. */
+        checksum = end[-1];
+
+        /* Step 3: identify and check the separator. */
+        sep = end[-2];
+
+        /* Step 4: verify the checksum.
+         * - Legacy mode (SP): the separator before the checksum is not included.
+         * - Standard mode (HT): the separator before the checksum is included.
+         */
+        switch (sep) {
+        case ' ':
+            sum -= sep;
+            break;
+        case '\t':
+            break;
+        default:
+            syslog(LOG_ERR, "Wrong separator 0x%02x: skip group\n", (unsigned char) sep);
+            info->errors++;
+            continue;
+        }
+
+        sum -= checksum;
+        if ((unsigned char) (' ' + (sum & 0x3f)) != (unsigned char) checksum) {
+            syslog(LOG_ERR, "Wrong checksum: skip group\n");
+            info->errors++;
+            info->checksums++;
+            tic_count_checksum_error(start, end - 2);
+            continue;
+        }
+
+        info->groups_ok[sep == '\t']++;
+
+        /* Step 5: identify the tag and the first separator of the group. */
+        tag = start;
+        sepp = memchr(tag, sep, end - 2 - tag); /* -2 to discard trailing separator before checksum and checksum. */
+        if (sepp == NULL) {
+            syslog(LOG_ERR, "No separator after tag: skip group\n");
+            info->errors++;
+            continue;
+        }
+
+        /* Step 6: identify the data, and the horodate (standard mode), if any. */
+        data = sepp + 1;
+        horodate = NULL;
+        horodate_len = 0;
+        if (sep == '\t' && (q = memchr(data, sep, end - 2 - data)) != NULL) {
+            horodate = data;
+            horodate_len = q - data;
+            data = q + 1;
+        }
+
+#ifdef DEBUG
+        printf("%.*s %.*s %c\n", (int) (sepp - tag), tag, (int) (end - 2 - data), data, checksum);
+#endif // DEBUG
+
+        /* Step 7: dispatch the data, as a span ending before the separator preceding the checksum. */
+        tic_process_group(tag, sepp - tag, horodate, horodate_len, data, end - 2 - data, mode, cb, userdata);
+    }
+}
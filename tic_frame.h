@@ -0,0 +1,25 @@
+#ifndef __TIC_FRAME_H__
+#define __TIC_FRAME_H__ 1
+
+struct tag_desc;
+
+/*
+ * Called for each valid group of a frame, with its data in place in the frame:
+ * len chars, followed by a NUL.
+ */
+
+typedef void (*tic_group_cb)(struct tag_desc *ptag_desc, const char *data, int len, void *userdata);
+
+/* Statistics of a processed frame. */
+
+struct tic_frame_info {
+    int groups;       // Number of groups found.
+    int groups_ok[2]; // Number of valid groups with SP (legacy) and HT (standard) separator.
+    int errors;       // Number of groups skipped (format or checksum error).
+    int checksums;    // Number of groups with wrong checksum.
+};
+
+extern int tic_is_checksum_ok(const char *start, const char *end, char checksum);
+extern void tic_process_frame(char *frame, int len, int mode, tic_group_cb cb, void *userdata, struct tic_frame_info *info);
+
+#endif /* __TIC_FRAME_H__ */
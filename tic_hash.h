@@ -0,0 +1,28 @@
+#ifndef __TIC_HASH_H__
+#define __TIC_HASH_H__ 1
+
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * @brief Hash a tag label (seeded FNV-1a).
+ * @param label Label.
+ * @param len Length of label.
+ * @param seed Seed selected by mktagtab so that all known labels get distinct slots.
+ * @return Hash value.
+ * @note Shared by mktagtab (build time) and tic_tag_lookup() (run time).
+ */
+
+static inline uint32_t tic_tag_hash(const char *label, size_t len, uint32_t seed)
+{
+    uint32_t h = 2166136261u ^ seed;
+
+    while (len-- > 0) {
+        h ^= (unsigned char) *label++;
+        h *= 16777619u;
+    }
+
+    return h ^ (h >> 15);
+}
+
+#endif /* __TIC_HASH_H__ */
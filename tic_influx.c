@@ -0,0 +1,117 @@
+#include <stdio.h>
+#include <string.h>
+
+#include "homie_helper.h"
+#include "tic2mqtt.h"
+#include "tic_influx.h"
+#include "tic_publish.h"
+
+/**
+ * @brief Append characters to line.
+ * @param influx Line.
+ * @param s Characters.
+ * @param n Number of characters.
+ */
+
+static void tic_influx_append(struct tic_influx *influx, const char *s, int n)
+{
+    if (influx->len + n > TIC_INFLUX_MAX) {
+        influx->overflow = 1;
+        return;
+    }
+
+    memcpy(influx->buf + influx->len, s, n);
+    influx->len += n;
+}
+
+/**
+ * @brief Append separator before a field.
+ * @param influx Line.
+ */
+
+static void tic_influx_separate(struct tic_influx *influx)
+{
+    tic_influx_append(influx, influx->count == 0 ? " " : ",", 1);
+    influx->count++;
+}
+
+/**
+ * @brief Start the point of a frame.
+ * @param influx Line.
+ * @param device_id Homie device id of the meter, used as tag "device".
+ * @param timestamp Frame reception time (ms since Epoch).
+ * @note Device ids only hold characters that need no escaping.
+ */
+
+void tic_influx_begin(struct tic_influx *influx, const char *device_id, long long timestamp)
+{
+    influx->len = snprintf(influx->buf, sizeof(influx->buf), "%s,device=%s", TIC_INFLUX_MEASUREMENT, device_id);
+    influx->count = 0;
+    influx->overflow = 0;
+    influx->timestamp = timestamp;
+}
+
+/**
+ * @brief Add a value to the point.
+ * @param influx Line.
+ * @param ptag_desc Tag description. The Homie property id is used as field key.
+ * @param data Data. Integer properties are written as integers, others as strings.
+ */
+
+void tic_influx_add(struct tic_influx *influx, const struct tag_desc *ptag_desc, const char *data)
+{
+    const char *prop_id = ptag_desc->attrs.prop_id;
+    const char *digits;
+    int n;
+
+    tic_influx_separate(influx);
+    tic_influx_append(influx, prop_id, strlen(prop_id));
+    tic_influx_append(influx, "=", 1);
+
+    if ((digits = tic_value_integer(ptag_desc, data, NULL)) != NULL) {
+        tic_influx_append(influx, digits, strlen(digits));
+        tic_influx_append(influx, "i", 1);
+    } else {
+        n = tic_value_quote(data, influx->buf + influx->len, TIC_INFLUX_MAX - influx->len);
+        if (n < 0)
+            influx->overflow = 1;
+        else
+            influx->len += n;
+    }
+}
+
+/**
+ * @brief Add an integer value to the point, e.g. a derived counter.
+ * @param influx Line.
+ * @param key Field key.
+ * @param value Value.
+ */
+
+void tic_influx_add_int(struct tic_influx *influx, const char *key, long long value)
+{
+    char field[64];
+    int n;
+
+    tic_influx_separate(influx);
+    n = snprintf(field, sizeof(field), "%s=%lldi", key, value);
+    tic_influx_append(influx, field, n < (int) sizeof(field) ? n : (int) sizeof(field) - 1);
+}
+
+/**
+ * @brief Terminate the point with its timestamp and a newline.
+ * @param influx Line.
+ * @return Length of line, -1 if it did not fit in TIC_INFLUX_MAX.
+ * @note The timestamp is written in ns, the default precision of InfluxDB.
+ */
+
+int tic_influx_end(struct tic_influx *influx)
+{
+    char ts[32];
+
+    tic_influx_append(influx, ts, snprintf(ts, sizeof(ts), " %lld000000\n", influx->timestamp));
+    if (influx->overflow)
+        return -1;
+
+    influx->buf[influx->len] = '\0';
+    return influx->len;
+}
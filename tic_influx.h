@@ -0,0 +1,24 @@
+#ifndef __TIC_INFLUX_H__
+#define __TIC_INFLUX_H__ 1
+
+#define TIC_INFLUX_MAX 2048
+#define TIC_INFLUX_MEASUREMENT "tic"
+
+struct tag_desc;
+
+/* Point of one frame in InfluxDB line protocol: one field per value. */
+
+struct tic_influx {
+    char buf[TIC_INFLUX_MAX + 1]; // Line, NUL terminated.
+    int len;                      // Length of line.
+    int count;                    // Number of fields added.
+    int overflow;                 // Set if a field did not fit.
+    long long timestamp;          // Reception time of frame (ms since Epoch).
+};
+
+extern void tic_influx_begin(struct tic_influx *influx, const char *device_id, long long timestamp);
+extern void tic_influx_add(struct tic_influx *influx, const struct tag_desc *ptag_desc, const char *data);
+extern void tic_influx_add_int(struct tic_influx *influx, const char *key, long long value);
+extern int tic_influx_end(struct tic_influx *influx);
+
+#endif /* __TIC_INFLUX_H__ */
@@ -0,0 +1,392 @@
+#define _GNU_SOURCE
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <fcntl.h>
+#include <netdb.h>
+#include <syslog.h>
+#include <termios.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <arpa/inet.h>
+
+#include "tic2mqtt.h"
+#include "tic_input.h"
+
+#define TIC_BAUDRATE_LEGACY   B1200
+#define TIC_BAUDRATE_STANDARD B9600
+#define TIC_READ_MIN 8
+#define TIC_LISTEN_BACKLOG 64
+
+/**
+ * @brief Get baudrate for TIC mode.
+ * @param mode TIC_MODE_LEGACY or TIC_MODE_STANDARD.
+ * @return Baudrate.
+ */
+
+static speed_t tic_baudrate(int mode)
+{
+    return mode == TIC_MODE_STANDARD ? TIC_BAUDRATE_STANDARD : TIC_BAUDRATE_LEGACY;
+}
+
+/**
+ * @brief Change TIC TTY speed.
+ * @param fd File descriptor to tty.
+ * @param mode TIC_MODE_LEGACY or TIC_MODE_STANDARD.
+ */
+
+static void tic_set_speed(int fd, int mode)
+{
+    struct termios termios;
+
+    tcgetattr(fd, &termios);
+    cfsetispeed(&termios, tic_baudrate(mode));
+    cfsetospeed(&termios, tic_baudrate(mode));
+    tcsetattr(fd, TCSANOW, &termios);
+
+    tcflush(fd, TCIFLUSH);
+}
+
+/**
+ * @brief Open TIC TTY.
+ * @param tty TTY name (/dev/ttyxx).
+ * @param mode TIC_MODE_LEGACY or TIC_MODE_STANDARD.
+ * @return File descriptor to tty, -1 on failure.
+ */
+
+static int tic_open_tty(const char *tty, int mode)
+{
+    int fd;
+    struct termios termios;
+
+    if ((fd = open(tty, O_RDWR | O_NOCTTY | O_NONBLOCK)) < 0) {
+        syslog(LOG_ERR, "Cannot open %s: %s", tty, strerror(errno));
+        return -1;
+    }
+
+    tcgetattr(fd, &termios);
+
+    /* Configure input and output speed. */
+    cfsetispeed(&termios, tic_baudrate(mode));
+    cfsetospeed(&termios, tic_baudrate(mode));
+
+    /* Set input modes:
+     * - Disable XON/XOFF flow control on input.
+     * - Do not translate carriage return to newline on input.
+     * - Enable input parity checking.
+     * - Strip off eighth bit.
+     */
+
+    termios.c_iflag &= ~(IXON | IXOFF | IXANY | ICRNL);
+    termios.c_iflag |= INPCK | ISTRIP;
+
+    /* Set output modes:
+     * - Disable implementation-defined output processing (raw mode).
+     */
+
+    termios.c_oflag &= ~OPOST;
+
+    /* Set control modes:
+     * - Enable receiver.
+     * - Ignore modem control lines.
+     * - 7 bit.
+     * - 1 stop bit.
+     * - Enable parity generation on output and parity checking for input.
+     * - Disable RTS/CTS (hardware) flow control.
+     */
+
+    termios.c_cflag |= CLOCAL | CREAD;
+    termios.c_cflag &= ~(CSIZE | PARODD | CSTOPB);
+    termios.c_cflag |=   CS7   | PARENB;
+    termios.c_cflag &= ~CRTSCTS;
+
+    /* Set local modes:
+     * - Do bot generate signal when the characters INTR, QUIT, SUSP or DSUSP are received.
+     * - Disable canonical mode.
+     * - Do not echo input characters.
+     */
+
+    termios.c_lflag &= ~(ISIG | ICANON | ECHO | ECHOE);
+
+    /* Set special characters:
+     * - No inter-character timeout.
+     * - Minimum number of characters for noncanonical read set to TIC_READ_MIN,
+     *   so that the tty is only reported readable once a few bytes are
+     *   available instead of on every byte. The last bytes of a frame, ETX
+     *   included, then wait for the next frame: at most TIC_READ_MIN byte
+     *   times, 67 ms at 1200 bauds and 8 ms at 9600 bauds.
+     */
+
+    termios.c_cc[VTIME] = 0;
+    termios.c_cc[VMIN]  = TIC_READ_MIN;
+
+    tcsetattr(fd, TCSANOW, &termios);
+
+    tcflush(fd, TCIFLUSH);
+    return fd;
+}
+
+
+/**
+ * @brief Split "[host:]port" at its last colon.
+ * @param name Address.
+ * @param host Buffer of TIC_INPUT_NAME_MAX + 1 chars, filled with host, empty if none.
+ * @return Port, within name.
+ */
+
+static const char *tic_split_address(const char *name, char *host)
+{
+    const char *colon = strrchr(name, ':');
+
+    host[0] = '\0';
+    if (colon == NULL)
+        return name;
+
+    strncat(host, name, colon - name);
+    return colon + 1;
+}
+
+/**
+ * @brief Open a TCP socket, connected or listening.
+ * @param name Address, "host:port" to connect to or "[host:]port" to listen on.
+ * @param listening 1 to listen, 0 to connect.
+ * @return Non-blocking socket, -1 on failure. A connection may still be in progress.
+ * @note Host names are resolved synchronously.
+ */
+
+static int tic_open_socket(const char *name, int listening)
+{
+    struct addrinfo hints = { .ai_family = AF_UNSPEC, .ai_socktype = SOCK_STREAM };
+    struct addrinfo *res;
+    struct addrinfo *ai;
+    char host[TIC_INPUT_NAME_MAX + 1];
+    const char *port;
+    int one = 1;
+    int err;
+    int fd = -1;
+
+    port = tic_split_address(name, host);
+    if (listening)
+        hints.ai_flags = AI_PASSIVE;
+
+    err = getaddrinfo(host[0] != '\0' ? host : NULL, port, &hints, &res);
+    if (err != 0) {
+        syslog(LOG_ERR, "Cannot resolve %s: %s", name, gai_strerror(err));
+        return -1;
+    }
+
+    for (ai = res; ai != NULL; ai = ai->ai_next) {
+        fd = socket(ai->ai_family, ai->ai_socktype | SOCK_NONBLOCK | SOCK_CLOEXEC, ai->ai_protocol);
+        if (fd < 0)
+            continue;
+
+        if (listening) {
+            setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+            if (bind(fd, ai->ai_addr, ai->ai_addrlen) == 0 && listen(fd, TIC_LISTEN_BACKLOG) == 0)
+                break;
+        } else {
+            setsockopt(fd, SOL_SOCKET, SO_KEEPALIVE, &one, sizeof(one));
+            if (connect(fd, ai->ai_addr, ai->ai_addrlen) == 0 || errno == EINPROGRESS)
+                break;
+        }
+
+        err = errno;
+        close(fd);
+        fd = -1;
+        errno = err;
+    }
+
+    freeaddrinfo(res);
+
+    if (fd < 0)
+        syslog(LOG_ERR, "Cannot %s %s: %s", listening ? "listen on" : "connect to", name, strerror(errno));
+
+    return fd;
+}
+
+/**
+ * @brief Create a pty and link its slave side, for another program to write frames to.
+ * @param input Input, with the link path as name.
+ * @return File descriptor to master side, -1 on failure.
+ * @note An existing file at the link path is only replaced if it is a symbolic link.
+ */
+
+static int tic_open_pty(struct tic_input *input)
+{
+    struct termios termios;
+    struct stat st;
+    const char *slave;
+    int fd;
+
+    fd = posix_openpt(O_RDWR | O_NOCTTY | O_CLOEXEC);
+    if (fd < 0 || grantpt(fd) < 0 || unlockpt(fd) < 0 || (slave = ptsname(fd)) == NULL)
+        goto fail;
+
+    input->slave_fd = open(slave, O_RDWR | O_NOCTTY | O_CLOEXEC);
+    if (input->slave_fd < 0)
+        goto fail;
+
+    /* Raw mode, so that bytes written to the slave side reach the master side unchanged. */
+    tcgetattr(input->slave_fd, &termios);
+    cfmakeraw(&termios);
+    tcsetattr(input->slave_fd, TCSANOW, &termios);
+
+    if (fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK) < 0)
+        goto fail;
+
+    if (lstat(input->name, &st) == 0 && S_ISLNK(st.st_mode))
+        unlink(input->name);
+    if (symlink(slave, input->name) < 0)
+        goto fail;
+
+    syslog(LOG_INFO, "Pty %s linked to %s", slave, input->name);
+    return fd;
+
+fail:
+    syslog(LOG_ERR, "Cannot create pty %s: %s", input->name, strerror(errno));
+    if (input->slave_fd >= 0)
+        close(input->slave_fd);
+    input->slave_fd = -1;
+    if (fd >= 0)
+        close(fd);
+    return -1;
+}
+
+/**
+ * @brief Parse an input specification.
+ * @param input Input, closed.
+ * @param spec "/dev/ttyxx", "pty:link", "tcp:host:port" or "listen:[host:]port".
+ * @return 0 on success, -1 if spec is invalid.
+ */
+
+int tic_input_parse(struct tic_input *input, const char *spec)
+{
+    static const struct {
+        const char *prefix;
+        int type;
+    } prefixes[] = {
+        { "pty:", TIC_INPUT_PTY },
+        { "tcp:", TIC_INPUT_TCP },
+        { "listen:", TIC_INPUT_LISTEN },
+        { NULL, TIC_INPUT_TTY }
+    };
+    int i;
+
+    for (i = 0; prefixes[i].prefix != NULL; i++) {
+        if (strncmp(spec, prefixes[i].prefix, strlen(prefixes[i].prefix)) == 0)
+            break;
+    }
+
+    input->type = prefixes[i].type;
+    input->fd = -1;
+    input->slave_fd = -1;
+
+    if (prefixes[i].prefix != NULL)
+        spec += strlen(prefixes[i].prefix);
+    if (spec[0] == '\0' || strlen(spec) > TIC_INPUT_NAME_MAX)
+        return -1;
+    if (input->type == TIC_INPUT_TCP && (strchr(spec, ':') == NULL || strrchr(spec, ':')[1] == '\0'))
+        return -1;
+
+    strcpy(input->name, spec);
+    return 0;
+}
+
+/**
+ * @brief Open an input.
+ * @param input Input.
+ * @param mode TIC_MODE_LEGACY or TIC_MODE_STANDARD, line speed of a tty.
+ * @return Non-blocking file descriptor, -1 on failure.
+ */
+
+int tic_input_open(struct tic_input *input, int mode)
+{
+    switch (input->type) {
+    case TIC_INPUT_TTY:
+        input->fd = tic_open_tty(input->name, mode);
+        break;
+
+    case TIC_INPUT_PTY:
+        input->fd = tic_open_pty(input);
+        break;
+
+    case TIC_INPUT_TCP:
+        input->fd = tic_open_socket(input->name, 0);
+        break;
+
+    case TIC_INPUT_LISTEN:
+        input->fd = tic_open_socket(input->name, 1);
+        break;
+
+    default:
+        // Accepted connections are opened by tic_input_accept().
+        break;
+    }
+
+    return input->fd;
+}
+
+/**
+ * @brief Close an input.
+ * @param input Input.
+ */
+
+void tic_input_close(struct tic_input *input)
+{
+    if (input->fd >= 0)
+        close(input->fd);
+    input->fd = -1;
+
+    if (input->slave_fd >= 0) {
+        close(input->slave_fd);
+        unlink(input->name);
+    }
+    input->slave_fd = -1;
+}
+
+/**
+ * @brief Change line speed of an input. Only local ttys have one.
+ * @param input Input.
+ * @param mode TIC_MODE_LEGACY or TIC_MODE_STANDARD.
+ */
+
+void tic_input_set_speed(const struct tic_input *input, int mode)
+{
+    if (input->type == TIC_INPUT_TTY && input->fd >= 0)
+        tic_set_speed(input->fd, mode);
+}
+
+/**
+ * @brief Accept a connection on a listening socket.
+ * @param listener Listening input.
+ * @param input Filled with the accepted connection, named after the peer address.
+ * @return Non-blocking file descriptor, -1 on failure or with errno set to EAGAIN if none is pending.
+ */
+
+int tic_input_accept(const struct tic_input *listener, struct tic_input *input)
+{
+    struct sockaddr_storage addr;
+    socklen_t len = sizeof(addr);
+    char host[INET6_ADDRSTRLEN];
+    char port[NI_MAXSERV];
+
+    input->type = TIC_INPUT_ACCEPTED;
+    input->slave_fd = -1;
+    input->fd = accept4(listener->fd, (struct sockaddr *) &addr, &len, SOCK_NONBLOCK | SOCK_CLOEXEC);
+    if (input->fd < 0) {
+        if (errno != EAGAIN && errno != EINTR)
+            syslog(LOG_ERR, "Cannot accept on %s: %s", listener->name, strerror(errno));
+        return -1;
+    }
+
+    if (getnameinfo((struct sockaddr *) &addr, len, host, sizeof(host), port, sizeof(port), NI_NUMERICHOST | NI_NUMERICSERV) != 0) {
+        strcpy(host, "?");
+        strcpy(port, "?");
+    }
+    snprintf(input->name, sizeof(input->name), "%s:%s", host, port);
+
+    return input->fd;
+}
@@ -0,0 +1,31 @@
+#ifndef __TIC_INPUT_H__
+#define __TIC_INPUT_H__ 1
+
+#define TIC_INPUT_NAME_MAX 127
+
+/* Kinds of input. */
+
+enum {
+    TIC_INPUT_TTY,      // Local serial device: /dev/ttyxx.
+    TIC_INPUT_PTY,      // Pseudo-terminal for another program to write frames to: pty:link.
+    TIC_INPUT_TCP,      // TCP client, e.g. to ser2net in raw mode: tcp:host:port.
+    TIC_INPUT_LISTEN,   // Listening TCP socket, each connection is a meter: listen:[host:]port.
+    TIC_INPUT_ACCEPTED  // Connection accepted on a listening socket.
+};
+
+/* Source of a TIC byte stream. */
+
+struct tic_input {
+    int type;                             // Kind of input (TIC_INPUT_xxx).
+    int fd;                               // Non-blocking file descriptor, -1 if closed.
+    int slave_fd;                         // Slave side of pty, kept open so that the master never reads EOF.
+    char name[TIC_INPUT_NAME_MAX + 1];    // Device, pty link, [host:]port or peer address.
+};
+
+extern int tic_input_parse(struct tic_input *input, const char *spec);
+extern int tic_input_open(struct tic_input *input, int mode);
+extern void tic_input_close(struct tic_input *input);
+extern void tic_input_set_speed(const struct tic_input *input, int mode);
+extern int tic_input_accept(const struct tic_input *listener, struct tic_input *input);
+
+#endif /* __TIC_INPUT_H__ */
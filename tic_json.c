@@ -0,0 +1,85 @@
+#include <stdio.h>
+#include <string.h>
+
+#include "homie_helper.h"
+#include "tic2mqtt.h"
+#include "tic_json.h"
+#include "tic_publish.h"
+
+/**
+ * @brief Append characters to document.
+ * @param json JSON document.
+ * @param s Characters.
+ * @param n Number of characters.
+ */
+
+static void tic_json_append(struct tic_json *json, const char *s, int n)
+{
+    if (json->len + n > TIC_JSON_MAX) {
+        json->overflow = 1;
+        return;
+    }
+
+    memcpy(json->buf + json->len, s, n);
+    json->len += n;
+}
+
+/**
+ * @brief Start a frame snapshot.
+ * @param json JSON document.
+ * @param seq Frame sequence number.
+ * @param timestamp Frame reception time (ms since Epoch).
+ */
+
+void tic_json_begin(struct tic_json *json, unsigned long seq, long long timestamp)
+{
+    json->len = snprintf(json->buf, sizeof(json->buf), "{\"seq\":%lu,\"ts\":%lld", seq, timestamp);
+    json->count = 0;
+    json->overflow = 0;
+}
+
+/**
+ * @brief Add a value to the frame snapshot.
+ * @param json JSON document.
+ * @param ptag_desc Tag description. The Homie property id is used as key.
+ * @param data Data. Integer properties are written as numbers, others as strings.
+ */
+
+void tic_json_add(struct tic_json *json, const struct tag_desc *ptag_desc, const char *data)
+{
+    const char *prop_id = ptag_desc->attrs.prop_id;
+    const char *digits;
+    int n;
+
+    tic_json_append(json, ",\"", 2);
+    tic_json_append(json, prop_id, strlen(prop_id));
+    tic_json_append(json, "\":", 2);
+
+    if ((digits = tic_value_integer(ptag_desc, data, NULL)) != NULL) {
+        tic_json_append(json, digits, strlen(digits));
+    } else {
+        n = tic_value_quote(data, json->buf + json->len, TIC_JSON_MAX - json->len);
+        if (n < 0)
+            json->overflow = 1;
+        else
+            json->len += n;
+    }
+
+    json->count++;
+}
+
+/**
+ * @brief Terminate the frame snapshot.
+ * @param json JSON document.
+ * @return Length of document, -1 if it did not fit in TIC_JSON_MAX.
+ */
+
+int tic_json_end(struct tic_json *json)
+{
+    tic_json_append(json, "}", 1);
+    if (json->overflow)
+        return -1;
+
+    json->buf[json->len] = '\0';
+    return json->len;
+}
@@ -0,0 +1,21 @@
+#ifndef __TIC_JSON_H__
+#define __TIC_JSON_H__ 1
+
+#define TIC_JSON_MAX 4096
+
+struct tag_desc;
+
+/* JSON snapshot of one frame. */
+
+struct tic_json {
+    char buf[TIC_JSON_MAX + 1]; // Document, NUL terminated.
+    int len;                    // Length of document.
+    int count;                  // Number of values added.
+    int overflow;               // Set if a value did not fit.
+};
+
+extern void tic_json_begin(struct tic_json *json, unsigned long seq, long long timestamp);
+extern void tic_json_add(struct tic_json *json, const struct tag_desc *ptag_desc, const char *data);
+extern int tic_json_end(struct tic_json *json);
+
+#endif /* __TIC_JSON_H__ */
@@ -0,0 +1,151 @@
+#include <ctype.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <syslog.h>
+
+#include "homie_helper.h"
+#include "tic2mqtt.h"
+#include "tic_energy.h"
+#include "tic_meter.h"
+#include "tic_stats.h"
+#include "tic_tags.h"
+#include "tic_tagtab.h"
+
+/* Max length of the topic prefix of node 'tic', e.g. "homie/linky/tic/". */
+
+#define TIC_NODE_TOPIC_MAX (sizeof(HOMIE_BASE_TOPIC) - 1 + TIC_DEVICE_ID_MAX + 1 + sizeof(HOMIE_NODE_ID) - 1 + 1)
+
+/**
+ * @brief Allocate a meter.
+ * @param input Input, copied.
+ * @return Meter, or NULL on allocation failure.
+ * @note Windows of aggregation must be set before, as their state is allocated here.
+ */
+
+struct tic_meter *tic_meter_new(const struct tic_input *input)
+{
+    struct tic_meter *meter;
+    size_t size = 0;
+    int i;
+
+    meter = calloc(1, sizeof(*meter));
+    if (meter == NULL)
+        goto fail;
+
+    meter->input = *input;
+    meter->mode = TIC_MODE_AUTO;
+    meter->detect_mode = TIC_MODE_LEGACY;
+    meter->src.fd = -1;
+    meter->src.userdata = meter;
+
+    meter->tags = calloc(TIC_TAG_COUNT, sizeof(*meter->tags));
+    if (meter->tags == NULL)
+        goto fail;
+
+    // Preallocate the data of all tags, so that the publish path never allocates.
+    for (i = 0; i < TIC_TAG_COUNT; i++)
+        size += tag_descs[i].len + 1;
+    meter->values = calloc(1, size);
+    if (meter->values == NULL)
+        goto fail;
+    for (i = 0, size = 0; i < TIC_TAG_COUNT; i++) {
+        meter->tags[i].data = meter->values + size;
+        size += tag_descs[i].len + 1;
+    }
+
+    // Same for the topics of their properties, filled once the device id is known.
+    for (i = 0, size = 0; i < TIC_TAG_COUNT; i++)
+        size += TIC_NODE_TOPIC_MAX + strlen(tag_descs[i].attrs.prop_id) + 1;
+    meter->topics = calloc(1, size);
+    if (meter->topics == NULL)
+        goto fail;
+    for (i = 0, size = 0; i < TIC_TAG_COUNT; i++) {
+        meter->tags[i].topic = meter->topics + size;
+        size += TIC_NODE_TOPIC_MAX + strlen(tag_descs[i].attrs.prop_id) + 1;
+    }
+
+    if (tic_stats_window_count() > 0) {
+        meter->stats = calloc(TIC_TAG_COUNT * tic_stats_window_count(), sizeof(*meter->stats));
+        if (meter->stats == NULL)
+            goto fail;
+    }
+
+    return meter;
+
+fail:
+    syslog(LOG_ERR, "Cannot alloc meter for %s: %s", input->name, strerror(errno));
+    tic_meter_free(meter);
+    return NULL;
+}
+
+/**
+ * @brief Free a meter. Its input and reader thread must be closed before.
+ * @param meter Meter. May be NULL.
+ */
+
+void tic_meter_free(struct tic_meter *meter)
+{
+    if (meter == NULL)
+        return;
+
+    free(meter->tags);
+    free(meter->values);
+    free(meter->topics);
+    free(meter->stats);
+    free(meter->pipeline);
+    tic_energy_close(meter->energy);
+    free(meter);
+}
+
+/**
+ * @brief Set Homie device id of a meter, its topic prefix and the topics of its properties.
+ * @param meter Meter.
+ * @param device_id Device id. Truncated to TIC_DEVICE_ID_MAX chars; chars not
+ *        allowed in Homie ids are lowercased or replaced with '-'.
+ * @note Topics are only built here, so that publishing a value formats nothing.
+ */
+
+void tic_meter_set_device_id(struct tic_meter *meter, const char *device_id)
+{
+    int len;
+    int i;
+
+    for (i = 0; i < TIC_DEVICE_ID_MAX && device_id[i] != '\0'; i++)
+        meter->device_id[i] = isalnum((unsigned char) device_id[i]) ? tolower((unsigned char) device_id[i]) : '-';
+    meter->device_id[i] = '\0';
+
+    len = snprintf(meter->node_topic, sizeof(meter->node_topic), "%s%s/%s/", HOMIE_BASE_TOPIC, meter->device_id, HOMIE_NODE_ID);
+
+    for (i = 0; i < TIC_TAG_COUNT; i++) {
+        memcpy(meter->tags[i].topic, meter->node_topic, len);
+        strcpy(meter->tags[i].topic + len, tag_descs[i].attrs.prop_id);
+    }
+}
+
+/**
+ * @brief Get state of a tag for a meter.
+ * @param meter Meter.
+ * @param ptag_desc Tag description.
+ * @return State of tag.
+ */
+
+struct tic_tag_state *tic_meter_tag(const struct tic_meter *meter, const struct tag_desc *ptag_desc)
+{
+    return &meter->tags[ptag_desc - tag_descs];
+}
+
+/**
+ * @brief Get statistics of a tag over an aggregation window for a meter.
+ * @param meter Meter.
+ * @param ptag_desc Tag description.
+ * @param window Window index.
+ * @return Statistics of window.
+ */
+
+struct tic_stats *tic_meter_stats(struct tic_meter *meter, const struct tag_desc *ptag_desc, int window)
+{
+    return &meter->stats[(ptag_desc - tag_descs) * tic_stats_window_count() + window];
+}
@@ -0,0 +1,80 @@
+#ifndef __TIC_METER_H__
+#define __TIC_METER_H__ 1
+
+#include <time.h>
+
+#include "broker_helper.h"
+#include "event_loop.h"
+#include "tic_input.h"
+#include "tic_reader.h"
+
+#define TIC_DEVICE_ID_MAX 31
+
+struct tag_desc;
+struct tic_energy;
+struct tic_pipeline;
+struct tic_stats;
+
+/* State of a tag for one meter. */
+
+struct tic_tag_state {
+    char *data;         // Last data published, in the value cache of the meter.
+    int len;            // Length of data.
+    char *topic;        // Topic of the Homie property, in the topic cache of the meter. Empty until the device id is known.
+    int known;          // Set once data is received or loaded from a snapshot.
+    int cached;         // Set while data loaded from a snapshot was not published again.
+    time_t published;   // Time of last publication (monotonic).
+    unsigned long seen; // Sequence number of the frame that last carried the tag, plus 1. 0 if none.
+    int unsent;         // Set while data was neither sent to the broker nor journaled.
+};
+
+/* Counters of a meter. */
+
+struct tic_meter_counters {
+    // Copied from the frame decoder before export.
+    unsigned long frames;          // Frames received.
+    unsigned long dropped;         // Frames dropped (overflow, EOT).
+    unsigned long resynced;        // Frames restarted on unexpected STX.
+    unsigned long overruns;        // Frames dropped because the pipeline ring was full.
+
+    unsigned long groups;          // Groups received.
+    unsigned long group_errors;    // Groups skipped (format or checksum error).
+    unsigned long checksum_errors; // Groups with wrong checksum.
+};
+
+/*
+ * A meter connected to an input. Meters share the event loop and the broker
+ * connection; everything that depends on the received frames lives here.
+ */
+
+struct tic_meter {
+    struct tic_input input;                   // Input, fd is -1 while closed.
+    time_t retry_at;                          // Time to open input again after a failure (monotonic s), 0 if none.
+    int configured;                           // Set if the input is listed in the config file.
+    int mode;                                 // TIC mode, TIC_MODE_AUTO until detected.
+    int detect_mode;                          // Mode being tried while mode is TIC_MODE_AUTO.
+    time_t detect_start;                      // Start of current detection attempt (monotonic s).
+    time_t last_rx;                           // Time of last reception (monotonic s).
+    struct tic_reader reader;                 // Frame decoder, when the input is read by the event loop.
+    struct tic_pipeline *pipeline;            // Reader thread, NULL when the input is read by the event loop.
+    struct event_source src;                  // Event source of input or pipeline.
+    unsigned long seq;                        // Sequence number of next frame.
+    long long frame_ts;                       // Reception time of the frame being processed (ms since Epoch), 0 outside frames.
+    char frame_ts_text[24];                   // frame_ts as text, for MQTT v5 user property "ts".
+    char device_id[TIC_DEVICE_ID_MAX + 1];    // Homie device id, empty until known.
+    char node_topic[TOPIC_MAXLEN + 1];        // Topic prefix of node 'tic', e.g. "homie/linky/tic/".
+    struct tic_meter_counters counters;       // Counters.
+    struct tic_tag_state *tags;               // State of tags, indexed like tag_descs[].
+    char *values;                             // Value cache: storage for the data of all tags.
+    char *topics;                             // Topic cache: storage for the property topics of all tags.
+    struct tic_stats *stats;                  // Aggregation windows of tags, NULL if aggregation is disabled.
+    struct tic_energy *energy;                // Derived power and consumption, NULL if disabled or until the device id is known.
+};
+
+extern struct tic_meter *tic_meter_new(const struct tic_input *input);
+extern void tic_meter_free(struct tic_meter *meter);
+extern void tic_meter_set_device_id(struct tic_meter *meter, const char *device_id);
+extern struct tic_tag_state *tic_meter_tag(const struct tic_meter *meter, const struct tag_desc *ptag_desc);
+extern struct tic_stats *tic_meter_stats(struct tic_meter *meter, const struct tag_desc *ptag_desc, int window);
+
+#endif /* __TIC_METER_H__ */
@@ -0,0 +1,240 @@
+#include <errno.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <syslog.h>
+
+#include "broker_helper.h"
+#include "homie_helper.h"
+#include "tic2mqtt.h"
+#include "tic_meter.h"
+#include "tic_metrics.h"
+#include "tic_tags.h"
+
+#define TIC_METRICS_PREFIX "tic2mqtt_"
+
+static const double groups_bounds[] = { 5, 10, 15, 20, 25, 30, 40, 50, 60, 80, 100 };
+static const double time_bounds[] = {
+    10e-6, 25e-6, 50e-6, 100e-6, 250e-6, 500e-6, 1e-3, 2.5e-3, 5e-3, 10e-3, 25e-3, 50e-3, 100e-3, 250e-3
+};
+
+#define COUNTOF(a) ((int) (sizeof(a) / sizeof((a)[0])))
+
+struct tic_metrics tic_metrics = {
+    .groups_per_frame = {
+        "groups_per_frame", "Number of groups per frame.", groups_bounds, COUNTOF(groups_bounds)
+    },
+    .parse_time = {
+        "parse_seconds", "Time to parse a frame and hand its groups to the publisher.", time_bounds, COUNTOF(time_bounds)
+    },
+    .publish_latency = {
+        "publish_latency_seconds", "Time from reception of a frame to handoff of its messages to the broker client.",
+        time_bounds, COUNTOF(time_bounds)
+    }
+};
+
+/**
+ * @brief Initialize metrics.
+ * @param now Current monotonic time (s).
+ */
+
+void tic_metrics_init(time_t now)
+{
+    tic_metrics.start = now;
+}
+
+/**
+ * @brief Add an observation to a histogram.
+ * @param histogram Histogram.
+ * @param value Observed value.
+ */
+
+void tic_metrics_observe(struct tic_histogram *histogram, double value)
+{
+    int i;
+
+    for (i = 0; i < histogram->nbounds && value > histogram->bounds[i]; i++)
+        ;
+
+    histogram->buckets[i]++;
+    histogram->count++;
+    histogram->sum += value;
+    if (value > histogram->max)
+        histogram->max = value;
+}
+
+/**
+ * @brief Write a counter or a gauge in Prometheus text format.
+ * @param fp Output file.
+ * @param name Metric name, without prefix.
+ * @param type "counter" or "gauge".
+ * @param help Metric description.
+ * @param value Value.
+ */
+
+static void tic_metrics_write_value(FILE *fp, const char *name, const char *type, const char *help, unsigned long value)
+{
+    fprintf(fp, "# HELP " TIC_METRICS_PREFIX "%s %s\n", name, help);
+    fprintf(fp, "# TYPE " TIC_METRICS_PREFIX "%s %s\n", name, type);
+    fprintf(fp, TIC_METRICS_PREFIX "%s %lu\n", name, value);
+}
+
+/**
+ * @brief Write a counter of each meter in Prometheus text format, labelled with its device id.
+ * @param fp Output file.
+ * @param name Metric name, without prefix.
+ * @param help Metric description.
+ * @param meters Meters.
+ * @param count Number of meters.
+ * @param offset Offset of counter in struct tic_meter_counters.
+ */
+
+static void tic_metrics_write_meters(FILE *fp, const char *name, const char *help, struct tic_meter * const *meters, int count, size_t offset)
+{
+    int i;
+
+    fprintf(fp, "# HELP " TIC_METRICS_PREFIX "%s %s\n", name, help);
+    fprintf(fp, "# TYPE " TIC_METRICS_PREFIX "%s counter\n", name);
+    for (i = 0; i < count; i++) {
+        fprintf(fp, TIC_METRICS_PREFIX "%s{device=\"%s\",input=\"%s\"} %lu\n", name, meters[i]->device_id, meters[i]->input.name,
+                *(const unsigned long *) ((const char *) &meters[i]->counters + offset));
+    }
+}
+
+/**
+ * @brief Write a histogram in Prometheus text format.
+ * @param fp Output file.
+ * @param histogram Histogram.
+ */
+
+static void tic_metrics_write_histogram(FILE *fp, const struct tic_histogram *histogram)
+{
+    unsigned long count = 0;
+    int i;
+
+    fprintf(fp, "# HELP " TIC_METRICS_PREFIX "%s %s\n", histogram->name, histogram->help);
+    fprintf(fp, "# TYPE " TIC_METRICS_PREFIX "%s histogram\n", histogram->name);
+
+    for (i = 0; i < histogram->nbounds; i++) {
+        count += histogram->buckets[i];
+        fprintf(fp, TIC_METRICS_PREFIX "%s_bucket{le=\"%g\"} %lu\n", histogram->name, histogram->bounds[i], count);
+    }
+    fprintf(fp, TIC_METRICS_PREFIX "%s_bucket{le=\"+Inf\"} %lu\n", histogram->name, histogram->count);
+    fprintf(fp, TIC_METRICS_PREFIX "%s_sum %g\n", histogram->name, histogram->sum);
+    fprintf(fp, TIC_METRICS_PREFIX "%s_count %lu\n", histogram->name, histogram->count);
+}
+
+/**
+ * @brief Write metrics to a file in Prometheus text format, e.g. for the node exporter textfile collector.
+ * @param path Path of file. It is replaced atomically.
+ * @param meters Meters.
+ * @param count Number of meters.
+ * @return 0 on success, -1 on failure.
+ */
+
+int tic_metrics_write_prometheus(const char *path, struct tic_meter * const *meters, int count)
+{
+    const struct tag_desc *ptag_desc;
+    char tmp[256];
+    FILE *fp;
+
+    snprintf(tmp, sizeof(tmp), "%s.tmp", path);
+    fp = fopen(tmp, "w");
+    if (fp == NULL) {
+        syslog(LOG_ERR, "Cannot write metrics to %s: %s", tmp, strerror(errno));
+        return -1;
+    }
+
+#define WRITE_METERS(name, help, counter) \
+    tic_metrics_write_meters(fp, name, help, meters, count, offsetof(struct tic_meter_counters, counter))
+
+    WRITE_METERS("frames_total", "Frames received.", frames);
+    WRITE_METERS("frames_dropped_total", "Frames dropped (overflow, EOT).", dropped);
+    WRITE_METERS("frames_resynced_total", "Frames restarted on unexpected STX.", resynced);
+    WRITE_METERS("frames_overrun_total", "Frames dropped because the pipeline ring was full.", overruns);
+    WRITE_METERS("groups_total", "Groups received.", groups);
+    WRITE_METERS("group_errors_total", "Groups skipped on format or checksum error.", group_errors);
+    WRITE_METERS("checksum_errors_total", "Groups with wrong checksum.", checksum_errors);
+
+#undef WRITE_METERS
+
+    // Tags are only known for groups whose label is intact, so the sum may be lower than checksum_errors_total.
+    fprintf(fp, "# HELP " TIC_METRICS_PREFIX "tag_checksum_errors_total Groups with wrong checksum, by tag, all meters.\n");
+    fprintf(fp, "# TYPE " TIC_METRICS_PREFIX "tag_checksum_errors_total counter\n");
+    for (ptag_desc = tag_descs; ptag_desc->tag != NULL; ptag_desc++) {
+        if (ptag_desc->checksum_errors != 0)
+            fprintf(fp, TIC_METRICS_PREFIX "tag_checksum_errors_total{tag=\"%s\"} %lu\n", ptag_desc->tag, ptag_desc->checksum_errors);
+    }
+
+    tic_metrics_write_value(fp, "publish_failures_total", "counter", "Messages the broker could not take.", tic_metrics.publish_failures);
+    tic_metrics_write_value(fp, "queue_depth", "gauge", "Messages waiting in journal.", tic_metrics.queue_depth);
+    tic_metrics_write_value(fp, "mqtt_want_write", "gauge", "Set while the broker client has packets to write.", tic_metrics.want_write);
+
+    tic_metrics_write_histogram(fp, &tic_metrics.groups_per_frame);
+    tic_metrics_write_histogram(fp, &tic_metrics.parse_time);
+    tic_metrics_write_histogram(fp, &tic_metrics.publish_latency);
+
+    if (fclose(fp) != 0 || rename(tmp, path) < 0) {
+        syslog(LOG_ERR, "Cannot write metrics to %s: %s", path, strerror(errno));
+        return -1;
+    }
+
+    return 0;
+}
+
+/**
+ * @brief Publish metrics as Homie device statistics ($stats) of a meter.
+ * @param mosq Mosquitto instance.
+ * @param meter Meter, with a device id.
+ * @param interval Publication interval (s).
+ * @param now Current monotonic time (s).
+ * @note Broker and latency statistics are those of the process, shared by all meters.
+ */
+
+void tic_metrics_publish_homie(struct mosquitto *mosq, const struct tic_meter *meter, int interval, time_t now)
+{
+    static const char * const names[] = {
+        "interval", "uptime", "frames", "dropped", "resynced", "overruns", "groups", "errors", "checksum-errors",
+        "publish-failures", "queue-depth", "parse-us", "latency-us"
+    };
+    const struct tic_meter_counters *counters = &meter->counters;
+    const struct tic_histogram *parse = &tic_metrics.parse_time;
+    const struct tic_histogram *latency = &tic_metrics.publish_latency;
+    char topic_prefix[TOPIC_MAXLEN + 1];
+    char payload[1024 + 1];
+    char value[32];
+    int i;
+
+    sprintf(topic_prefix, "%s%s/", HOMIE_BASE_TOPIC, meter->device_id);
+
+    for (i = 0, payload[0] = '\0'; i < COUNTOF(names); i++) {
+        if (i > 0)
+            strcat(payload, ",");
+        strcat(payload, names[i]);
+    }
+    broker_publish(mosq, topic_prefix, "$stats", payload, tic_qos);
+    strcat(topic_prefix, "$stats/");
+
+#define PUBLISH_STAT(name, fmt, val) \
+    do { \
+        sprintf(value, fmt, val); \
+        broker_publish(mosq, topic_prefix, name, value, tic_qos); \
+    } while (0)
+
+    PUBLISH_STAT("interval", "%d", interval);
+    PUBLISH_STAT("uptime", "%ld", (long) (now - tic_metrics.start));
+    PUBLISH_STAT("frames", "%lu", counters->frames);
+    PUBLISH_STAT("dropped", "%lu", counters->dropped);
+    PUBLISH_STAT("resynced", "%lu", counters->resynced);
+    PUBLISH_STAT("overruns", "%lu", counters->overruns);
+    PUBLISH_STAT("groups", "%lu", counters->groups);
+    PUBLISH_STAT("errors", "%lu", counters->group_errors);
+    PUBLISH_STAT("checksum-errors", "%lu", counters->checksum_errors);
+    PUBLISH_STAT("publish-failures", "%lu", tic_metrics.publish_failures);
+    PUBLISH_STAT("queue-depth", "%lu", tic_metrics.queue_depth);
+    PUBLISH_STAT("parse-us", "%.0f", parse->count ? parse->sum / parse->count * 1e6 : 0.0);
+    PUBLISH_STAT("latency-us", "%.0f", latency->count ? latency->sum / latency->count * 1e6 : 0.0);
+
+#undef PUBLISH_STAT
+}
@@ -0,0 +1,50 @@
+#ifndef __TIC_METRICS_H__
+#define __TIC_METRICS_H__ 1
+
+#include <time.h>
+
+#define TIC_METRICS_BUCKETS_MAX 16
+
+struct mosquitto;
+struct tic_meter;
+
+/* Cumulative histogram, in the Prometheus sense. */
+
+struct tic_histogram {
+    const char *name;                                   // Metric name.
+    const char *help;                                   // Metric description.
+    const double *bounds;                               // Upper bounds of buckets, increasing.
+    int nbounds;                                        // Number of bounds.
+    unsigned long buckets[TIC_METRICS_BUCKETS_MAX + 1]; // Observations per bucket, last is +Inf.
+    unsigned long count;                                // Number of observations.
+    double sum;                                         // Sum of observations.
+    double max;                                         // Largest observation.
+};
+
+/*
+ * Runtime metrics of the process. Counters are only updated by the thread
+ * running the event loop, so the hot path takes no lock; exporters read them
+ * from the same thread. Counters of each meter are kept in struct tic_meter.
+ */
+
+struct tic_metrics {
+    time_t start;                   // Start time (monotonic s).
+
+    // Copied from their owners before export.
+    unsigned long publish_failures; // Messages the broker could not take.
+    unsigned long queue_depth;      // Messages waiting in journal.
+    int want_write;                 // Set while libmosquitto has packets to write.
+
+    struct tic_histogram groups_per_frame; // Groups per frame.
+    struct tic_histogram parse_time;       // Time to parse a frame and hand its groups over (s).
+    struct tic_histogram publish_latency;  // Time from reception of ETX to publish handoff (s).
+};
+
+extern struct tic_metrics tic_metrics;
+
+extern void tic_metrics_init(time_t now);
+extern void tic_metrics_observe(struct tic_histogram *histogram, double value);
+extern int tic_metrics_write_prometheus(const char *path, struct tic_meter * const *meters, int count);
+extern void tic_metrics_publish_homie(struct mosquitto *mosq, const struct tic_meter *meter, int interval, time_t now);
+
+#endif /* __TIC_METRICS_H__ */
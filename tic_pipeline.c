@@ -0,0 +1,220 @@
+#include <errno.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <poll.h>
+#include <syslog.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+
+#include "tic_pipeline.h"
+
+#define TIC_PIPELINE_POLL_MS 250 /* Bounds the time to stop the reader thread. */
+
+/**
+ * @brief Queue a frame decoded by the reader thread.
+ * @param frame TIC frame.
+ * @param len Length of frame.
+ * @param userdata Pipeline.
+ * @note The frame is dropped if the ring is full.
+ */
+
+static void tic_pipeline_push(char *frame, int len, void *userdata)
+{
+    struct tic_pipeline *pipeline = userdata;
+    struct tic_pipeline_frame *slot;
+    unsigned int tail = atomic_load_explicit(&pipeline->tail, memory_order_relaxed);
+    unsigned int head = atomic_load_explicit(&pipeline->head, memory_order_acquire);
+
+    if (tail - head == TIC_PIPELINE_SLOTS) {
+        atomic_fetch_add_explicit(&pipeline->overruns, 1, memory_order_relaxed);
+        return;
+    }
+
+    slot = &pipeline->slots[tail & (TIC_PIPELINE_SLOTS - 1)];
+    slot->len = len;
+    slot->times = pipeline->reader.times;
+    memcpy(slot->frame, frame, len);
+
+    atomic_store_explicit(&pipeline->tail, tail + 1, memory_order_release);
+    pipeline->queued++;
+}
+
+/**
+ * @brief Reader thread: read tty, decode frames and queue them.
+ * @param arg Pipeline.
+ * @return NULL.
+ */
+
+static void *tic_pipeline_run(void *arg)
+{
+    struct tic_pipeline *pipeline = arg;
+    struct tic_reader *reader = &pipeline->reader;
+    struct pollfd pfd = { .fd = pipeline->fd, .events = POLLIN };
+    uint64_t one = 1;
+    int res;
+
+    while (!atomic_load(&pipeline->stop)) {
+        res = poll(&pfd, 1, TIC_PIPELINE_POLL_MS);
+        if (res < 0 && errno != EINTR) {
+            syslog(LOG_ERR, "Cannot poll TIC: %s", strerror(errno));
+            break;
+        }
+
+        if (atomic_exchange(&pipeline->reset, 0))
+            tic_reader_reset(reader);
+
+        if (res <= 0)
+            continue;
+
+        pipeline->queued = 0;
+
+        res = tic_reader_read(reader, pipeline->fd);
+        if (res < 0) {
+            if (errno == EAGAIN)
+                continue;
+            syslog(LOG_ERR, "Cannot read TIC: %s", strerror(errno));
+            break;
+        } else if (res == 0) {
+            syslog(LOG_ERR, "End of TIC input");
+            break;
+        }
+
+        atomic_store_explicit(&pipeline->frames, reader->frames, memory_order_relaxed);
+        atomic_store_explicit(&pipeline->dropped, reader->dropped, memory_order_relaxed);
+        atomic_store_explicit(&pipeline->resynced, reader->resynced, memory_order_relaxed);
+        atomic_store_explicit(&pipeline->last_rx, reader->times.etx_mono.tv_sec, memory_order_relaxed);
+
+        if (pipeline->queued > 0 && write(pipeline->efd, &one, sizeof(one)) < 0)
+            syslog(LOG_ERR, "Cannot signal TIC frames: %s", strerror(errno));
+    }
+
+    if (!atomic_load(&pipeline->stop)) {
+        atomic_store(&pipeline->ended, 1);
+        if (write(pipeline->efd, &one, sizeof(one)) < 0)
+            syslog(LOG_ERR, "Cannot signal end of TIC input: %s", strerror(errno));
+    }
+
+    return NULL;
+}
+
+/**
+ * @brief Initialize pipeline. Counters are kept across restarts of the reader thread.
+ * @param pipeline Pipeline.
+ */
+
+void tic_pipeline_init(struct tic_pipeline *pipeline)
+{
+    memset(pipeline, 0, sizeof(*pipeline));
+    pipeline->fd = -1;
+    pipeline->efd = -1;
+    tic_reader_init(&pipeline->reader, tic_pipeline_push, pipeline);
+}
+
+/**
+ * @brief Start reader thread.
+ * @param pipeline Pipeline, initialized and stopped.
+ * @param fd File descriptor to tty.
+ * @return File descriptor to watch for queued frames, -1 on failure.
+ * @note Signals handled by the event loop must be blocked before, so that the
+ *       reader thread inherits the mask.
+ */
+
+int tic_pipeline_start(struct tic_pipeline *pipeline, int fd)
+{
+    int res;
+
+    pipeline->fd = fd;
+    tic_reader_reset(&pipeline->reader);
+    atomic_store(&pipeline->head, 0);
+    atomic_store(&pipeline->tail, 0);
+    atomic_store(&pipeline->stop, 0);
+    atomic_store(&pipeline->reset, 0);
+    atomic_store(&pipeline->ended, 0);
+
+    pipeline->efd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (pipeline->efd < 0) {
+        syslog(LOG_ERR, "Cannot create eventfd: %s", strerror(errno));
+        return -1;
+    }
+
+    res = pthread_create(&pipeline->thread, NULL, tic_pipeline_run, pipeline);
+    if (res != 0) {
+        syslog(LOG_ERR, "Cannot create reader thread: %s", strerror(res));
+        close(pipeline->efd);
+        pipeline->efd = -1;
+        return -1;
+    }
+
+    return pipeline->efd;
+}
+
+/**
+ * @brief Stop reader thread.
+ * @param pipeline Pipeline.
+ */
+
+void tic_pipeline_stop(struct tic_pipeline *pipeline)
+{
+    if (pipeline->efd < 0)
+        return;
+
+    atomic_store(&pipeline->stop, 1);
+    pthread_join(pipeline->thread, NULL);
+
+    close(pipeline->efd);
+    pipeline->efd = -1;
+}
+
+/**
+ * @brief Process queued frames, from the consumer thread.
+ * @param pipeline Pipeline.
+ * @param cb Callback called for each frame.
+ * @param userdata User data passed to callback.
+ * @return 0 on success, -1 once the reader thread has stopped on end of input or read error.
+ */
+
+int tic_pipeline_drain(struct tic_pipeline *pipeline, tic_pipeline_cb cb, void *userdata)
+{
+    struct tic_pipeline_frame *slot;
+    unsigned int head = atomic_load_explicit(&pipeline->head, memory_order_relaxed);
+    unsigned int tail;
+    uint64_t count;
+
+    if (read(pipeline->efd, &count, sizeof(count)) < 0 && errno != EAGAIN)
+        syslog(LOG_ERR, "Cannot read eventfd: %s", strerror(errno));
+
+    tail = atomic_load_explicit(&pipeline->tail, memory_order_acquire);
+    while (head != tail) {
+        slot = &pipeline->slots[head & (TIC_PIPELINE_SLOTS - 1)];
+        cb(slot->frame, slot->len, &slot->times, userdata);
+        atomic_store_explicit(&pipeline->head, ++head, memory_order_release);
+    }
+
+    return atomic_load(&pipeline->ended) ? -1 : 0;
+}
+
+/**
+ * @brief Discard frame in progress in reader thread, e.g. after a change of line speed.
+ * @param pipeline Pipeline.
+ */
+
+void tic_pipeline_reset(struct tic_pipeline *pipeline)
+{
+    atomic_store(&pipeline->reset, 1);
+}
+
+/**
+ * @brief Get counters of pipeline.
+ * @param pipeline Pipeline.
+ * @param stats Filled with counters.
+ */
+
+void tic_pipeline_get_stats(struct tic_pipeline *pipeline, struct tic_pipeline_stats *stats)
+{
+    stats->frames = atomic_load_explicit(&pipeline->frames, memory_order_relaxed);
+    stats->dropped = atomic_load_explicit(&pipeline->dropped, memory_order_relaxed);
+    stats->resynced = atomic_load_explicit(&pipeline->resynced, memory_order_relaxed);
+    stats->overruns = atomic_load_explicit(&pipeline->overruns, memory_order_relaxed);
+    stats->last_rx = atomic_load_explicit(&pipeline->last_rx, memory_order_relaxed);
+}
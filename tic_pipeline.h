@@ -0,0 +1,70 @@
+#ifndef __TIC_PIPELINE_H__
+#define __TIC_PIPELINE_H__ 1
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <time.h>
+
+#include "tic_reader.h"
+
+#define TIC_PIPELINE_SLOTS 16 /* Power of 2. */
+
+/* Frame timestamped by the reader thread. */
+
+struct tic_pipeline_frame {
+    int len;                      // Length of frame.
+    struct tic_frame_times times; // Reception times.
+    char frame[TIC_FRAME_MAX];    // Frame, after STX and ending with ETX.
+};
+
+/* Called by the consumer for each frame. */
+
+typedef void (*tic_pipeline_cb)(char *frame, int len, const struct tic_frame_times *times, void *userdata);
+
+/*
+ * Reader thread feeding frames to the event loop thread through a single
+ * producer, single consumer ring. When the ring is full, new frames are
+ * dropped and counted, so that the reader never waits for the consumer.
+ */
+
+struct tic_pipeline {
+    int fd;                     // File descriptor of tty.
+    int efd;                    // eventfd signaled when frames are queued.
+    pthread_t thread;           // Reader thread.
+    struct tic_reader reader;   // Frame decoder, owned by reader thread.
+    int queued;                 // Frames queued by last read, owned by reader thread.
+
+    struct tic_pipeline_frame slots[TIC_PIPELINE_SLOTS];
+    atomic_uint head;           // Next slot to consume, written by consumer.
+    atomic_uint tail;           // Next slot to fill, written by reader thread.
+
+    atomic_int stop;            // Set to stop reader thread.
+    atomic_int reset;           // Set to discard frame in progress.
+    atomic_int ended;           // Set by reader thread on end of input or read error.
+
+    // Written by reader thread, read by consumer.
+    atomic_ulong frames;        // Frames received.
+    atomic_ulong dropped;       // Frames dropped by decoder (overflow, EOT).
+    atomic_ulong resynced;      // Frames restarted on unexpected STX.
+    atomic_ulong overruns;      // Frames dropped because the ring was full.
+    atomic_long last_rx;        // Time of last read (monotonic s).
+};
+
+/* Counters of pipeline. */
+
+struct tic_pipeline_stats {
+    unsigned long frames;   // Frames received.
+    unsigned long dropped;  // Frames dropped by decoder (overflow, EOT).
+    unsigned long resynced; // Frames restarted on unexpected STX.
+    unsigned long overruns; // Frames dropped because the ring was full.
+    time_t last_rx;         // Time of last read (monotonic s).
+};
+
+extern void tic_pipeline_init(struct tic_pipeline *pipeline);
+extern int tic_pipeline_start(struct tic_pipeline *pipeline, int fd);
+extern void tic_pipeline_stop(struct tic_pipeline *pipeline);
+extern int tic_pipeline_drain(struct tic_pipeline *pipeline, tic_pipeline_cb cb, void *userdata);
+extern void tic_pipeline_reset(struct tic_pipeline *pipeline);
+extern void tic_pipeline_get_stats(struct tic_pipeline *pipeline, struct tic_pipeline_stats *stats);
+
+#endif /* __TIC_PIPELINE_H__ */
@@ -0,0 +1,414 @@
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <syslog.h>
+
+#include "broker_helper.h"
+#include "homie_helper.h"
+#include "tic2mqtt.h"
+#include "tic_energy.h"
+#include "tic_meter.h"
+#include "tic_publish.h"
+#include "tic_stats.h"
+#include "tic_tags.h"
+
+#define TIC_EXPIRY_FACTOR 3 /* Expiry of volatile values, in max intervals of their filter. */
+
+/* Limit of a value, received in the same frames. */
+
+struct tic_limit {
+    const char *tag;   // Tag of the value.
+    const char *limit; // Tag of the limit.
+    long scale;        // Units of the value per unit of the limit.
+};
+
+/* Values whose crossing of their limit is published at once, whatever their filter. */
+
+static const struct tic_limit tic_limits[] = {
+    { "IINST",  "ISOUSC", 1 },    /* Legacy mode: current vs subscribed current (A). */
+    { "SINSTS", "PCOUP",  1000 }, /* Standard mode: power (VA) vs cut-off power (kVA). */
+    { NULL, NULL, 0 }
+};
+
+int tic_qos = TIC_QOS;
+int tic_timestamps = 0;
+
+/**
+ * @brief Parse a publish filter, e.g. "none", "alarm", "abs:1:0:60" or "pct:5:0:60".
+ * @param arg Filter: type, then deadband, min and max intervals for deadband filters (see tic_tags.def).
+ * @param filter Filled with filter.
+ * @return 0 on success, -1 if arg is invalid.
+ */
+
+int tic_filter_parse(const char *arg, struct tic_filter *filter)
+{
+    char type[4];
+    char end;
+
+    memset(filter, 0, sizeof(*filter));
+
+    if (strcmp(arg, "none") == 0) {
+        filter->type = TIC_FILTER_NONE;
+        return 0;
+    }
+    if (strcmp(arg, "alarm") == 0) {
+        filter->type = TIC_FILTER_ALARM;
+        return 0;
+    }
+
+    if (sscanf(arg, "%3[a-z]:%d:%d:%d%c", type, &filter->deadband, &filter->min_interval, &filter->max_interval, &end) != 4 ||
+        filter->deadband < 0 || filter->min_interval < 0 || filter->max_interval < 0)
+        return -1;
+
+    if (strcmp(type, "abs") == 0)
+        filter->type = TIC_FILTER_ABS;
+    else if (strcmp(type, "pct") == 0)
+        filter->type = TIC_FILTER_PCT;
+    else
+        return -1;
+
+    return 0;
+}
+
+/**
+ * @brief Tell whether a numeric value moved out of the deadband of a tag.
+ * @param ptag_desc Tag description.
+ * @param published Last published data.
+ * @param data New data.
+ * @return 1 if out of deadband or not numeric, 0 if within deadband.
+ */
+
+static int tic_is_out_of_deadband(const struct tag_desc *ptag_desc, const char *published, const char *data)
+{
+    const struct tic_filter *filter = &ptag_desc->filter;
+    char *end;
+    long last;
+    long value;
+    long delta;
+
+    last = strtol(published, &end, 10);
+    if (end == published || *end != '\0')
+        return 1;
+    value = strtol(data, &end, 10);
+    if (end == data || *end != '\0')
+        return 1;
+
+    delta = labs(value - last);
+    if (filter->type == TIC_FILTER_PCT)
+        return delta * 100 > filter->deadband * labs(last);
+
+    return delta > filter->deadband;
+}
+
+/**
+ * @brief Tell whether a value crossed the limit of its tag (see tic_limits[]).
+ * @param meter Meter.
+ * @param ptag_desc Tag description.
+ * @param published Last published data.
+ * @param data New data.
+ * @return 1 if the limit lies between the published and the new value, 0 otherwise or if the limit is unknown.
+ */
+
+static int tic_crosses_limit(const struct tic_meter *meter, const struct tag_desc *ptag_desc, const char *published, const char *data)
+{
+    const struct tic_limit *plimit;
+    const struct tag_desc *limit_desc;
+    const struct tic_tag_state *limit_state;
+    long limit;
+
+    for (plimit = tic_limits; plimit->tag != NULL; plimit++) {
+        if (strcmp(plimit->tag, ptag_desc->tag) == 0)
+            break;
+    }
+    if (plimit->tag == NULL)
+        return 0;
+
+    limit_desc = tic_tag_lookup(plimit->limit, strlen(plimit->limit));
+    if (limit_desc == NULL)
+        return 0;
+    limit_state = tic_meter_tag(meter, limit_desc);
+    if (!limit_state->known)
+        return 0;
+
+    limit = atol(limit_state->data) * plimit->scale;
+    if (limit <= 0)
+        return 0;
+
+    return (atol(published) > limit) != (atol(data) > limit);
+}
+
+/**
+ * @brief Store group data if it must be published, according to the filter of the tag.
+ * @param meter Meter, whose seq is past the frame being processed.
+ * @param ptag_desc Tag description.
+ * @param data Data, NUL terminated.
+ * @param len Length of data.
+ * @param now Current monotonic time (s).
+ * @return 1 if data must be published, 0 if filtered out.
+ * @note Alarm tags are published on every change, and each time they appear
+ *       again after a frame without them. Other changes are dropped within
+ *       min_interval of the last publication or within the deadband, unless
+ *       max_interval elapsed or the value crossed its limit (e.g. IINST above
+ *       ISOUSC). An unchanged value is republished every max_interval, if set.
+ */
+
+int tic_update_value(struct tic_meter *meter, const struct tag_desc *ptag_desc, const char *data, int len, time_t now)
+{
+    struct tic_tag_state *state = tic_meter_tag(meter, ptag_desc);
+    const struct tic_filter *filter = &ptag_desc->filter;
+    int reappeared = state->seen + 1 != meter->seq;
+    int expired;
+
+    state->seen = meter->seq;
+
+    if (state->known && !(filter->type == TIC_FILTER_ALARM && reappeared)) {
+        expired = filter->max_interval > 0 && now - state->published >= filter->max_interval;
+
+        if (state->len == len && memcmp(state->data, data, len) == 0) {
+            if (!expired)
+                return 0;
+        } else if (filter->type != TIC_FILTER_ALARM && !expired) {
+            if ((now - state->published < filter->min_interval ||
+                 (filter->type != TIC_FILTER_NONE && !tic_is_out_of_deadband(ptag_desc, state->data, data))) &&
+                !tic_crosses_limit(meter, ptag_desc, state->data, data))
+                return 0;
+        }
+    }
+
+    if (len > ptag_desc->len)
+        len = ptag_desc->len;
+    memcpy(state->data, data, len);
+    state->data[len] = '\0';
+    state->len = len;
+    state->known = 1;
+    state->cached = 0;
+    state->published = now;
+
+    return 1;
+}
+
+/**
+ * @brief Get an integer value as digits, for encoders writing integers as numbers.
+ * @param ptag_desc Tag description.
+ * @param data Data.
+ * @param value Filled with value if not NULL.
+ * @return Digits of data without leading zeros (keeping at least one), NULL if the
+ *         property is not an integer, or data is not a decimal integer or does not fit in 64 bits.
+ */
+
+const char *tic_value_integer(const struct tag_desc *ptag_desc, const char *data, uint64_t *value)
+{
+    const char *p;
+    uint64_t n = 0;
+
+    if (ptag_desc->attrs.datatype != HOMIE_INTEGER || *data == '\0')
+        return NULL;
+
+    for (p = data; *p != '\0'; p++) {
+        if (*p < '0' || *p > '9' || n > (UINT64_MAX - 9) / 10)
+            return NULL;
+        n = n * 10 + (*p - '0');
+    }
+
+    if (value != NULL)
+        *value = n;
+
+    while (data[0] == '0' && data[1] != '\0')
+        data++;
+
+    return data;
+}
+
+/**
+ * @brief Write data as a quoted string, escaping quotes and backslashes (JSON, InfluxDB line protocol).
+ * @param data Data.
+ * @param buf Buffer.
+ * @param size Size of buffer.
+ * @return Length written, -1 if it does not fit.
+ */
+
+int tic_value_quote(const char *data, char *buf, int size)
+{
+    int len = 0;
+
+    if (size < 2)
+        return -1;
+
+    buf[len++] = '"';
+    for (; *data != '\0'; data++) {
+        if (len + 3 > size)
+            return -1;
+        if (*data == '"' || *data == '\\')
+            buf[len++] = '\\';
+        buf[len++] = *data;
+    }
+    buf[len++] = '"';
+
+    return len;
+}
+
+/**
+ * @brief Get MQTT v5 properties of the value of a Homie property of a meter.
+ * @param meter Meter.
+ * @param expiry Message expiry interval (s), 0 for none.
+ * @param props Filled with properties.
+ * @note With MQTT v5, property topics are published through topic aliases and,
+ *       if requested, values of a frame carry its reception time as user property "ts".
+ */
+
+static void tic_prop_msg_props(const struct tic_meter *meter, unsigned int expiry, struct broker_msg_props *props)
+{
+    props->alias = 1;
+    props->expiry = expiry;
+    props->timestamp = tic_timestamps && meter->frame_ts != 0 ? meter->frame_ts_text : NULL;
+}
+
+/**
+ * @brief Publish value of a Homie property of a meter.
+ * @param mosq Mosquitto instance.
+ * @param meter Meter.
+ * @param prop_id Property id.
+ * @param payload Value.
+ * @param expiry Message expiry interval (s), 0 for none.
+ * @return 0 on success, -1 on failure.
+ */
+
+static int tic_publish_prop(struct mosquitto *mosq, const struct tic_meter *meter, const char *prop_id, const char *payload, unsigned int expiry)
+{
+    struct broker_msg_props props;
+
+    tic_prop_msg_props(meter, expiry, &props);
+    if (broker_publish_props(mosq, meter->node_topic, prop_id, payload, strlen(payload), tic_qos, &props) != 0)
+        return -1;
+
+    return 0;
+}
+
+/**
+ * @brief Publish group data to its Homie property topic.
+ * @param mosq Mosquitto instance.
+ * @param meter Meter.
+ * @param ptag_desc Tag description.
+ * @param data Data.
+ * @param len Length of data.
+ * @return 0 on success, -1 on failure.
+ * @note The topic is the one built with the device id of the meter. The tag
+ *       state is marked unsent if the broker or the journal did not take it.
+ * @note Values of deadband filtered tags (e.g. IINST, PAPP) are republished every
+ *       max interval: the broker drops them once a few of them were missed.
+ */
+
+int tic_publish_value(struct mosquitto *mosq, const struct tic_meter *meter, const struct tag_desc *ptag_desc, const char *data, int len)
+{
+    struct tic_tag_state *state = tic_meter_tag(meter, ptag_desc);
+    const struct tic_filter *filter = &ptag_desc->filter;
+    struct broker_msg_props props;
+    unsigned int expiry = 0;
+
+    if (filter->type == TIC_FILTER_ABS || filter->type == TIC_FILTER_PCT)
+        expiry = TIC_EXPIRY_FACTOR * filter->max_interval;
+
+    tic_prop_msg_props(meter, expiry, &props);
+    state->unsent = broker_publish_topic(mosq, state->topic, data, len, tic_qos, &props) != 0;
+    if (state->unsent)
+        return -1;
+
+    return 0;
+}
+
+/**
+ * @brief Publish group data if it passes the filter of the tag.
+ * @param mosq Mosquitto instance.
+ * @param meter Meter.
+ * @param ptag_desc Tag description.
+ * @param data Data, NUL terminated.
+ * @param len Length of data.
+ * @param now Current monotonic time (s).
+ * @return 1 if data was published, 0 if filtered out, -1 on failure.
+ */
+
+int tic_publish_group(struct mosquitto *mosq, struct tic_meter *meter, const struct tag_desc *ptag_desc, const char *data, int len, time_t now)
+{
+    if (!tic_update_value(meter, ptag_desc, data, len, now))
+        return 0;
+
+    if (tic_publish_value(mosq, meter, ptag_desc, data, len) < 0)
+        return -1;
+
+    return 1;
+}
+
+/**
+ * @brief Publish statistics of a tag over an ended window.
+ * @param mosq Mosquitto instance.
+ * @param meter Meter.
+ * @param ptag_desc Tag description.
+ * @param window Window index.
+ * @param stats Statistics of the window.
+ * @return 0 on success, -1 on failure.
+ */
+
+int tic_publish_stats(struct mosquitto *mosq, const struct tic_meter *meter, const struct tag_desc *ptag_desc, int window, const struct tic_stats *stats)
+{
+    const struct homie_prop_attrs *attrs;
+    char payload[TIC_STATS_PAYLOAD_MAX + 1];
+    int stat;
+
+    for (stat = 0; stat < TIC_STAT_COUNT; stat++) {
+        attrs = tic_stats_prop_attrs(ptag_desc, window, stat);
+        if (attrs == NULL)
+            return -1;
+
+        tic_stats_format(stats, stat, payload);
+        if (tic_publish_prop(mosq, meter, attrs->prop_id, payload, 0) != 0)
+            return -1;
+    }
+
+    return 0;
+}
+
+/**
+ * @brief Publish consumption of an energy index over the current periods.
+ * @param mosq Mosquitto instance.
+ * @param meter Meter.
+ * @param ptag_desc Tag description of an energy index, NULL for the total.
+ * @param consumption Consumption over each period (Wh).
+ * @return 0 on success, -1 on failure.
+ */
+
+int tic_publish_energy(struct mosquitto *mosq, const struct tic_meter *meter, const struct tag_desc *ptag_desc, const uint64_t *consumption)
+{
+    const struct homie_prop_attrs *attrs;
+    char payload[TIC_ENERGY_PAYLOAD_MAX + 1];
+    int period;
+
+    for (period = 0; period < TIC_ENERGY_PERIOD_COUNT; period++) {
+        attrs = tic_energy_prop_attrs(ptag_desc, period);
+        if (attrs == NULL)
+            return -1;
+
+        sprintf(payload, "%llu", (unsigned long long) consumption[period]);
+        if (tic_publish_prop(mosq, meter, attrs->prop_id, payload, 0) != 0)
+            return -1;
+    }
+
+    return 0;
+}
+
+/**
+ * @brief Publish average power.
+ * @param mosq Mosquitto instance.
+ * @param meter Meter.
+ * @param power Average power (W).
+ * @return 0 on success, -1 on failure.
+ */
+
+int tic_publish_power(struct mosquitto *mosq, const struct tic_meter *meter, long power)
+{
+    char payload[TIC_ENERGY_PAYLOAD_MAX + 1];
+
+    sprintf(payload, "%ld", power);
+    return tic_publish_prop(mosq, meter, tic_energy_power_attrs.prop_id, payload, 0);
+}
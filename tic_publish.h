@@ -0,0 +1,23 @@
+#ifndef __TIC_PUBLISH_H__
+#define __TIC_PUBLISH_H__ 1
+
+#include <stdint.h>
+#include <time.h>
+
+struct mosquitto;
+struct tag_desc;
+struct tic_filter;
+struct tic_meter;
+struct tic_stats;
+
+extern int tic_filter_parse(const char *arg, struct tic_filter *filter);
+extern int tic_update_value(struct tic_meter *meter, const struct tag_desc *ptag_desc, const char *data, int len, time_t now);
+extern const char *tic_value_integer(const struct tag_desc *ptag_desc, const char *data, uint64_t *value);
+extern int tic_value_quote(const char *data, char *buf, int size);
+extern int tic_publish_value(struct mosquitto *mosq, const struct tic_meter *meter, const struct tag_desc *ptag_desc, const char *data, int len);
+extern int tic_publish_group(struct mosquitto *mosq, struct tic_meter *meter, const struct tag_desc *ptag_desc, const char *data, int len, time_t now);
+extern int tic_publish_stats(struct mosquitto *mosq, const struct tic_meter *meter, const struct tag_desc *ptag_desc, int window, const struct tic_stats *stats);
+extern int tic_publish_energy(struct mosquitto *mosq, const struct tic_meter *meter, const struct tag_desc *ptag_desc, const uint64_t *consumption);
+extern int tic_publish_power(struct mosquitto *mosq, const struct tic_meter *meter, long power);
+
+#endif /* __TIC_PUBLISH_H__ */
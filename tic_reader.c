@@ -0,0 +1,131 @@
+#include <errno.h>
+#include <string.h>
+
+#include <syslog.h>
+#include <unistd.h>
+
+#include "tic_reader.h"
+
+enum {
+    TIC_READER_WAIT_STX, // Waiting for start of frame.
+    TIC_READER_IN_FRAME  // Receiving frame, waiting for ETX.
+};
+
+/**
+ * @brief Initialize frame decoder.
+ * @param reader Frame decoder.
+ * @param cb Callback called for each complete frame.
+ * @param userdata User data passed to callback.
+ */
+
+void tic_reader_init(struct tic_reader *reader, tic_frame_cb cb, void *userdata)
+{
+    memset(reader, 0, sizeof(*reader));
+
+    reader->state = TIC_READER_WAIT_STX;
+    reader->cb = cb;
+    reader->userdata = userdata;
+}
+
+/**
+ * @brief Discard frame in progress, e.g. after a change of line speed.
+ * @param reader Frame decoder.
+ */
+
+void tic_reader_reset(struct tic_reader *reader)
+{
+    reader->state = TIC_READER_WAIT_STX;
+    reader->len = 0;
+}
+
+/**
+ * @brief Feed bytes to frame decoder.
+ * @param reader Frame decoder.
+ * @param buf Bytes received.
+ * @param len Number of bytes received.
+ * @note A partial frame is kept until the next call.
+ */
+
+void tic_reader_feed(struct tic_reader *reader, const char *buf, int len)
+{
+    const char *p = buf;
+    const char *end = buf + len;
+
+    while (p < end) {
+        if (reader->state == TIC_READER_WAIT_STX) {
+            p = memchr(p, STX, end - p);
+            if (p == NULL)
+                return;
+            p++;
+            reader->len = 0;
+            reader->state = TIC_READER_IN_FRAME;
+            reader->times.stx_wall = reader->times.etx_wall;
+            reader->times.stx_mono = reader->times.etx_mono;
+            continue;
+        }
+
+        switch (*p) {
+        case STX:
+            // Start of a new frame while the previous one is not complete.
+            syslog(LOG_WARNING, "Unexpected STX: resync frame");
+            reader->resynced++;
+            reader->len = 0;
+            reader->times.stx_wall = reader->times.etx_wall;
+            reader->times.stx_mono = reader->times.etx_mono;
+            p++;
+            continue;
+
+        case EOT:
+            // Frame interrupted by the meter.
+            reader->dropped++;
+            reader->state = TIC_READER_WAIT_STX;
+            p++;
+            continue;
+
+        default:
+            break;
+        }
+
+        if (reader->len >= TIC_FRAME_MAX) {
+            syslog(LOG_ERR, "TIC frame too long: drop frame");
+            reader->dropped++;
+            reader->state = TIC_READER_WAIT_STX;
+            continue;
+        }
+
+        reader->frame[reader->len++] = *p;
+
+        if (*p++ == ETX) {
+            reader->frames++;
+            reader->state = TIC_READER_WAIT_STX;
+            reader->cb(reader->frame, reader->len, reader->userdata);
+        }
+    }
+}
+
+/**
+ * @brief Read available bytes from fd and feed them to frame decoder.
+ * @param reader Frame decoder.
+ * @param fd File descriptor to read from.
+ * @return Number of bytes read, 0 on end of file, -1 on failure (errno is set).
+ * @note Reception times of frames are those of the read() calls returning their STX and ETX.
+ */
+
+int tic_reader_read(struct tic_reader *reader, int fd)
+{
+    ssize_t res;
+
+    do {
+        res = read(fd, reader->buf, sizeof(reader->buf));
+    } while (res < 0 && errno == EINTR);
+
+    reader->reads++;
+
+    if (res > 0) {
+        clock_gettime(CLOCK_REALTIME, &reader->times.etx_wall);
+        clock_gettime(CLOCK_MONOTONIC, &reader->times.etx_mono);
+        tic_reader_feed(reader, reader->buf, res);
+    }
+
+    return res;
+}
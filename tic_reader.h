@@ -0,0 +1,48 @@
+#ifndef __TIC_READER_H__
+#define __TIC_READER_H__ 1
+
+#include <time.h>
+
+#define STX 0x02
+#define ETX 0x03
+#define EOT 0x04
+
+#define TIC_FRAME_MAX 2048
+#define TIC_READ_CHUNK 256
+
+/* Reception times of a frame, taken when read() returned the bytes. */
+
+struct tic_frame_times {
+    struct timespec stx_wall; // Realtime at reception of STX.
+    struct timespec stx_mono; // Monotonic time at reception of STX.
+    struct timespec etx_wall; // Realtime at reception of ETX.
+    struct timespec etx_mono; // Monotonic time at reception of ETX.
+};
+
+/* Called for each complete frame. The frame starts after STX and ends with ETX. */
+
+typedef void (*tic_frame_cb)(char *frame, int len, void *userdata);
+
+/* Streaming frame decoder state. */
+
+struct tic_reader {
+    int state;                    // Decoder state (TIC_READER_xxx).
+    int len;                      // Number of bytes in frame[].
+    char frame[TIC_FRAME_MAX];    // Frame being received, kept across reads.
+    char buf[TIC_READ_CHUNK];     // Read buffer.
+    tic_frame_cb cb;              // Frame callback.
+    void *userdata;               // User data for frame callback.
+    struct tic_frame_times times; // Reception times of frame, ETX times are those of last read.
+
+    unsigned long reads;          // Number of read() calls.
+    unsigned long frames;         // Number of frames delivered.
+    unsigned long dropped;        // Number of frames dropped (overflow, EOT).
+    unsigned long resynced;       // Number of frames restarted on unexpected STX.
+};
+
+extern void tic_reader_init(struct tic_reader *reader, tic_frame_cb cb, void *userdata);
+extern void tic_reader_reset(struct tic_reader *reader);
+extern void tic_reader_feed(struct tic_reader *reader, const char *buf, int len);
+extern int tic_reader_read(struct tic_reader *reader, int fd);
+
+#endif /* __TIC_READER_H__ */
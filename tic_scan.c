@@ -0,0 +1,188 @@
+#include <stdint.h>
+#include <string.h>
+
+#include "tic_scan.h"
+
+#if defined(TIC_SCAN_SCALAR)
+/* Byte by byte scan only, for reference and testing. */
+#elif defined(__SSE2__)
+#define TIC_SCAN_SSE2 1
+#include <emmintrin.h>
+#elif defined(__aarch64__) && defined(__ARM_NEON)
+#define TIC_SCAN_NEON 1
+#include <arm_neon.h>
+#elif __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+#define TIC_SCAN_SWAR 1
+#endif
+
+/* Scanner state, carried across blocks. */
+
+struct tic_scan {
+    struct tic_group *groups; // Groups found.
+    int max;                  // Size of groups[].
+    int count;                // Number of groups found.
+    int unterminated;         // Number of LF not followed by CR.
+    int in_group;             // Set between LF and CR.
+    int start;                // Offset of first character of current group.
+    unsigned char start_sum;  // Running sum at start of current group.
+};
+
+#if defined(TIC_SCAN_SSE2) || defined(TIC_SCAN_NEON)
+/* Loading 16 bytes at ones_then_zeros + 16 - n gives a mask of the first n bytes. */
+
+static const unsigned char ones_then_zeros[32] = {
+    0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff
+};
+#endif
+
+/**
+ * @brief Handle a delimiter.
+ * @param scan Scanner state.
+ * @param c Delimiter (LF or CR).
+ * @param pos Offset of delimiter in frame.
+ * @param sum Sum of all characters before delimiter, modulo 256.
+ */
+
+static inline void tic_scan_delim(struct tic_scan *scan, char c, int pos, unsigned char sum)
+{
+    if (c == '\n') {
+        if (scan->in_group)
+            scan->unterminated++;
+        scan->in_group = 1;
+        scan->start = pos + 1;
+        scan->start_sum = sum + '\n';
+    } else if (scan->in_group) {
+        scan->in_group = 0;
+        if (scan->count < scan->max) {
+            struct tic_group *group = &scan->groups[scan->count++];
+
+            group->start = scan->start;
+            group->end = pos;
+            group->sum = sum - scan->start_sum;
+        }
+    }
+}
+
+#ifdef TIC_SCAN_SWAR
+/**
+ * @brief Find bytes equal to c in a word.
+ * @param x Word.
+ * @param c Byte to find.
+ * @return Word with the high bit of each matching byte set.
+ */
+
+static inline uint64_t swar_eq(uint64_t x, unsigned char c)
+{
+    uint64_t t = x ^ (0x0101010101010101ULL * c);
+
+    return ~(((t & 0x7f7f7f7f7f7f7f7fULL) + 0x7f7f7f7f7f7f7f7fULL) | t | 0x7f7f7f7f7f7f7f7fULL);
+}
+
+/**
+ * @brief Sum bytes of a word.
+ * @param x Word.
+ * @return Sum of bytes, modulo 256.
+ */
+
+static inline unsigned char swar_sum(uint64_t x)
+{
+    uint64_t t = (x & 0x00ff00ff00ff00ffULL) + ((x >> 8) & 0x00ff00ff00ff00ffULL);
+
+    return (t * 0x0001000100010001ULL) >> 48;
+}
+#endif
+
+/**
+ * @brief Find all groups of a frame and sum their characters in one pass.
+ * @param frame TIC frame.
+ * @param len Length of frame.
+ * @param groups Groups found, in frame order.
+ * @param max Size of groups[]. Extra groups are ignored.
+ * @param unterminated Number of LF not followed by CR, set on return. May be NULL.
+ * @return Number of groups found.
+ * @note Blocks of 16 (SSE2, NEON) or 8 (SWAR) bytes are checked for LF/CR at once,
+ *       and the running sum is updated per block. Only delimiters need a partial
+ *       block sum.
+ */
+
+int tic_scan_frame(const char *frame, int len, struct tic_group *groups, int max, int *unterminated)
+{
+    struct tic_scan scan = { .groups = groups, .max = max };
+    const unsigned char *p = (const unsigned char *) frame;
+    unsigned char sum = 0;
+    int i = 0;
+
+#if defined(TIC_SCAN_SSE2)
+    const __m128i lf = _mm_set1_epi8('\n');
+    const __m128i cr = _mm_set1_epi8('\r');
+    const __m128i zero = _mm_setzero_si128();
+
+    for (; i + 16 <= len; i += 16) {
+        __m128i v = _mm_loadu_si128((const __m128i *) (p + i));
+        unsigned int mask = _mm_movemask_epi8(_mm_or_si128(_mm_cmpeq_epi8(v, lf), _mm_cmpeq_epi8(v, cr)));
+        __m128i s;
+
+        while (mask != 0) {
+            int b = __builtin_ctz(mask);
+            __m128i m = _mm_loadu_si128((const __m128i *) (ones_then_zeros + 16 - b));
+
+            s = _mm_sad_epu8(_mm_and_si128(v, m), zero);
+            tic_scan_delim(&scan, p[i + b], i + b, sum + _mm_cvtsi128_si32(s) + _mm_extract_epi16(s, 4));
+            mask &= mask - 1;
+        }
+
+        s = _mm_sad_epu8(v, zero);
+        sum += _mm_cvtsi128_si32(s) + _mm_extract_epi16(s, 4);
+    }
+#elif defined(TIC_SCAN_NEON)
+    const uint8x16_t lf = vdupq_n_u8('\n');
+    const uint8x16_t cr = vdupq_n_u8('\r');
+
+    for (; i + 16 <= len; i += 16) {
+        uint8x16_t v = vld1q_u8(p + i);
+        uint8x16_t m = vorrq_u8(vceqq_u8(v, lf), vceqq_u8(v, cr));
+        uint64_t mask = vget_lane_u64(vreinterpret_u64_u8(vshrn_n_u16(vreinterpretq_u16_u8(m), 4)), 0); // One nibble per byte.
+
+        while (mask != 0) {
+            int b = __builtin_ctzll(mask) >> 2;
+
+            tic_scan_delim(&scan, p[i + b], i + b, sum + vaddvq_u8(vandq_u8(v, vld1q_u8(ones_then_zeros + 16 - b))));
+            mask &= ~(0xfULL << (b * 4));
+        }
+
+        sum += vaddvq_u8(v);
+    }
+#elif defined(TIC_SCAN_SWAR)
+    for (; i + 8 <= len; i += 8) {
+        uint64_t x;
+        uint64_t mask;
+
+        memcpy(&x, p + i, sizeof(x));
+        mask = (swar_eq(x, '\n') | swar_eq(x, '\r')) & 0x8080808080808080ULL;
+
+        while (mask != 0) {
+            int b = __builtin_ctzll(mask) >> 3;
+
+            tic_scan_delim(&scan, p[i + b], i + b, sum + (b ? swar_sum(x & ((1ULL << (8 * b)) - 1)) : 0));
+            mask &= mask - 1;
+        }
+
+        sum += swar_sum(x);
+    }
+#endif
+
+    /* Remaining bytes. */
+    for (; i < len; i++) {
+        if (p[i] == '\n' || p[i] == '\r')
+            tic_scan_delim(&scan, p[i], i, sum);
+        sum += p[i];
+    }
+
+    if (scan.in_group)
+        scan.unterminated++;
+
+    if (unterminated != NULL)
+        *unterminated = scan.unterminated;
+
+    return scan.count;
+}
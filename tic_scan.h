@@ -0,0 +1,16 @@
+#ifndef __TIC_SCAN_H__
+#define __TIC_SCAN_H__ 1
+
+#define TIC_GROUPS_MAX 128
+
+/* Group found in a frame: characters between LF and CR. */
+
+struct tic_group {
+    unsigned short start; // Offset of the first character after LF.
+    unsigned short end;   // Offset of CR.
+    unsigned char sum;    // Sum of characters from start to end (excluded), modulo 256.
+};
+
+extern int tic_scan_frame(const char *frame, int len, struct tic_group *groups, int max, int *unterminated);
+
+#endif /* __TIC_SCAN_H__ */
@@ -0,0 +1,432 @@
+#define _GNU_SOURCE
+#include <errno.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <fcntl.h>
+#include <netdb.h>
+#include <poll.h>
+#include <syslog.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+
+#include "broker_helper.h"
+#include "tic2mqtt.h"
+#include "tic_sink.h"
+
+#define TIC_SINK_POLL_MS 250       /* Bounds the time to stop the writer thread. */
+#define TIC_SINK_DATAGRAM_MAX 1400 /* Default length of UDP batches: no IP fragmentation. */
+#define TIC_SINK_BATCH_POINTS 50   /* Default points per batch. */
+#define TIC_SINK_INTERVAL 10       /* Default max time a point waits (s). */
+#define TIC_SINK_FILE_SIZE 10240   /* Default size of file before rotation (KiB). */
+
+/**
+ * @brief Parse an option of a sink specification.
+ * @param sink Sink.
+ * @param opt Option, "key=value".
+ * @return 0 on success, -1 if opt is invalid.
+ */
+
+static int tic_sink_parse_option(struct tic_sink *sink, const char *opt)
+{
+    const char *value = strchr(opt, '=');
+    char *end;
+    long n;
+
+    if (value == NULL)
+        return -1;
+    value++;
+
+    n = strtol(value, &end, 10);
+    if (end == value || (*end != '\0' && *end != ','))
+        return -1;
+
+    if (strncmp(opt, "batch=", 6) == 0 && n >= 1 && n <= 100000)
+        sink->batch_points = n;
+    else if (strncmp(opt, "bytes=", 6) == 0 && n >= 256 && n <= TIC_SINK_BATCH_MAX)
+        sink->batch_bytes = n;
+    else if (strncmp(opt, "interval=", 9) == 0 && n >= 1 && n <= 3600)
+        sink->interval = n;
+    else if (strncmp(opt, "size=", 5) == 0 && sink->type == TIC_SINK_FILE && n >= 1 && n <= 1024 * 1024)
+        sink->max_size = n * 1024;
+    else
+        return -1;
+
+    return 0;
+}
+
+/**
+ * @brief Parse a sink specification.
+ * @param sink Sink, filled with its settings. Nothing is opened.
+ * @param spec "influx-udp:host:port", "influx-unix:path", "file:path" or "mqtt:topic",
+ *        followed by options: ",batch=points", ",interval=s", ",bytes=n" (max length
+ *        of a batch) and, for files, ",size=KiB" (size before rotation).
+ * @return 0 on success, -1 if spec is invalid.
+ */
+
+int tic_sink_parse(struct tic_sink *sink, const char *spec)
+{
+    static const struct {
+        const char *prefix;
+        int type;
+    } prefixes[] = {
+        { "influx-udp:", TIC_SINK_UDP },
+        { "influx-unix:", TIC_SINK_UNIX },
+        { "file:", TIC_SINK_FILE },
+        { "mqtt:", TIC_SINK_MQTT },
+        { NULL, 0 }
+    };
+    const char *opt;
+    size_t len;
+    int i;
+
+    memset(sink, 0, sizeof(*sink));
+    sink->fd = -1;
+    sink->efd = -1;
+
+    for (i = 0; prefixes[i].prefix != NULL; i++) {
+        if (strncmp(spec, prefixes[i].prefix, strlen(prefixes[i].prefix)) == 0)
+            break;
+    }
+    if (prefixes[i].prefix == NULL || strlen(spec) > TIC_SINK_NAME_MAX)
+        return -1;
+
+    strcpy(sink->name, spec);
+    sink->type = prefixes[i].type;
+    sink->batch_points = TIC_SINK_BATCH_POINTS;
+    sink->batch_bytes = sink->type == TIC_SINK_UDP ? TIC_SINK_DATAGRAM_MAX : TIC_SINK_BATCH_MAX;
+    sink->interval = TIC_SINK_INTERVAL;
+    sink->max_size = TIC_SINK_FILE_SIZE * 1024L;
+
+    spec += strlen(prefixes[i].prefix);
+    len = strcspn(spec, ",");
+    if (len == 0)
+        return -1;
+    strncat(sink->target, spec, len);
+    if (sink->type == TIC_SINK_UDP && (strchr(sink->target, ':') == NULL || strrchr(sink->target, ':')[1] == '\0'))
+        return -1;
+
+    for (opt = spec + len; *opt == ','; opt += strcspn(opt + 1, ",") + 1) {
+        if (tic_sink_parse_option(sink, opt + 1) < 0)
+            return -1;
+    }
+
+    return 0;
+}
+
+/**
+ * @brief Open the socket or file of a sink, from the writer thread.
+ * @param sink Sink.
+ * @return 0 on success, -1 on failure.
+ * @note Host names are resolved here, so that a slow resolver only delays this sink.
+ */
+
+static int tic_sink_open(struct tic_sink *sink)
+{
+    struct addrinfo hints = { .ai_family = AF_UNSPEC, .ai_socktype = SOCK_DGRAM };
+    struct sockaddr_un sun = { .sun_family = AF_UNIX };
+    struct addrinfo *res;
+    struct addrinfo *ai;
+    struct stat st;
+    char host[TIC_SINK_NAME_MAX + 1] = "";
+    const char *port;
+    int err;
+
+    switch (sink->type) {
+    case TIC_SINK_UDP:
+        port = strrchr(sink->target, ':');
+        strncat(host, sink->target, port - sink->target);
+        err = getaddrinfo(host, port + 1, &hints, &res);
+        if (err != 0) {
+            if (!sink->failing)
+                syslog(LOG_ERR, "Cannot resolve %s: %s", sink->target, gai_strerror(err));
+            return -1;
+        }
+        for (ai = res; ai != NULL && sink->fd < 0; ai = ai->ai_next) {
+            sink->fd = socket(ai->ai_family, ai->ai_socktype | SOCK_CLOEXEC, ai->ai_protocol);
+            if (sink->fd >= 0 && connect(sink->fd, ai->ai_addr, ai->ai_addrlen) < 0) {
+                close(sink->fd);
+                sink->fd = -1;
+            }
+        }
+        freeaddrinfo(res);
+        break;
+
+    case TIC_SINK_UNIX:
+        if (strlen(sink->target) >= sizeof(sun.sun_path)) {
+            errno = ENAMETOOLONG;
+            break;
+        }
+        strcpy(sun.sun_path, sink->target);
+        sink->fd = socket(AF_UNIX, SOCK_DGRAM | SOCK_CLOEXEC, 0);
+        if (sink->fd >= 0 && connect(sink->fd, (struct sockaddr *) &sun, sizeof(sun)) < 0) {
+            err = errno;
+            close(sink->fd);
+            sink->fd = -1;
+            errno = err;
+        }
+        break;
+
+    case TIC_SINK_FILE:
+        sink->fd = open(sink->target, O_WRONLY | O_APPEND | O_CREAT | O_CLOEXEC, 0644);
+        if (sink->fd >= 0)
+            sink->size = fstat(sink->fd, &st) == 0 ? st.st_size : 0;
+        break;
+
+    default:
+        break;
+    }
+
+    if (sink->fd < 0) {
+        if (!sink->failing)
+            syslog(LOG_ERR, "Cannot open sink %s: %s", sink->target, strerror(errno));
+        return -1;
+    }
+
+    return 0;
+}
+
+/**
+ * @brief Write a batch, from the writer thread.
+ * @param sink Sink.
+ * @param batch Batch.
+ * @note A file is renamed to <path>.1 once it reaches its max size, replacing the previous one.
+ */
+
+static void tic_sink_write(struct tic_sink *sink, const struct tic_sink_batch *batch)
+{
+    char rotated[TIC_SINK_NAME_MAX + 3];
+    ssize_t res = -1;
+    int done = 0;
+
+    if (sink->fd >= 0 || tic_sink_open(sink) == 0) {
+        if (sink->type == TIC_SINK_FILE) {
+            // Files may take partial writes.
+            while (done < batch->len && (res = write(sink->fd, batch->buf + done, batch->len - done)) > 0)
+                done += res;
+        } else {
+            res = send(sink->fd, batch->buf, batch->len, 0);
+            if (res == batch->len)
+                done = res;
+        }
+    }
+
+    if (done < batch->len) {
+        atomic_fetch_add_explicit(&sink->errors, 1, memory_order_relaxed);
+        if (!sink->failing && sink->fd >= 0)
+            syslog(LOG_ERR, "Cannot write to sink %s: %s", sink->target, strerror(errno));
+        sink->failing = 1;
+        // Datagram sockets are connected again, e.g. once the receiver is back.
+        if (sink->fd >= 0 && sink->type != TIC_SINK_FILE) {
+            close(sink->fd);
+            sink->fd = -1;
+        }
+        return;
+    }
+
+    if (sink->failing)
+        syslog(LOG_INFO, "Sink %s writable again", sink->target);
+    sink->failing = 0;
+    atomic_fetch_add_explicit(&sink->batches, 1, memory_order_relaxed);
+
+    if (sink->type == TIC_SINK_FILE) {
+        sink->size += done;
+        if (sink->size >= sink->max_size) {
+            snprintf(rotated, sizeof(rotated), "%s.1", sink->target);
+            if (rename(sink->target, rotated) < 0)
+                syslog(LOG_ERR, "Cannot rotate sink %s: %s", sink->target, strerror(errno));
+            close(sink->fd);
+            sink->fd = -1;
+        }
+    }
+}
+
+/**
+ * @brief Writer thread: write queued batches.
+ * @param arg Sink.
+ * @return NULL.
+ */
+
+static void *tic_sink_run(void *arg)
+{
+    struct tic_sink *sink = arg;
+    struct pollfd pfd = { .fd = sink->efd, .events = POLLIN };
+    unsigned int head = atomic_load_explicit(&sink->head, memory_order_relaxed);
+    uint64_t count;
+    int stop;
+
+    do {
+        stop = atomic_load(&sink->stop);
+
+        while (head != atomic_load_explicit(&sink->tail, memory_order_acquire)) {
+            tic_sink_write(sink, &sink->slots[head & (TIC_SINK_SLOTS - 1)]);
+            atomic_store_explicit(&sink->head, ++head, memory_order_release);
+        }
+
+        if (!stop && poll(&pfd, 1, TIC_SINK_POLL_MS) > 0 && read(sink->efd, &count, sizeof(count)) < 0 && errno != EAGAIN)
+            syslog(LOG_ERR, "Cannot read eventfd: %s", strerror(errno));
+    } while (!stop);
+
+    if (sink->fd >= 0)
+        close(sink->fd);
+    sink->fd = -1;
+
+    return NULL;
+}
+
+/**
+ * @brief Start a sink.
+ * @param sink Sink, parsed.
+ * @param mosq Broker connection, used by MQTT sinks.
+ * @return 0 on success, -1 on failure.
+ * @note Signals handled by the event loop must be blocked before, so that the
+ *       writer thread inherits the mask. The socket or file is opened by the
+ *       writer thread: a sink that cannot be opened yet does not prevent startup.
+ */
+
+int tic_sink_start(struct tic_sink *sink, struct mosquitto *mosq)
+{
+    int res;
+
+    sink->mosq = mosq;
+    if (sink->type == TIC_SINK_MQTT)
+        return 0;
+
+    atomic_store(&sink->head, 0);
+    atomic_store(&sink->tail, 0);
+    atomic_store(&sink->stop, 0);
+
+    sink->efd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (sink->efd < 0) {
+        syslog(LOG_ERR, "Cannot create eventfd: %s", strerror(errno));
+        return -1;
+    }
+
+    res = pthread_create(&sink->thread, NULL, tic_sink_run, sink);
+    if (res != 0) {
+        syslog(LOG_ERR, "Cannot create writer thread: %s", strerror(res));
+        close(sink->efd);
+        sink->efd = -1;
+        return -1;
+    }
+
+    return 0;
+}
+
+/**
+ * @brief Hand the batch being filled to the writer thread, or to the broker connection.
+ * @param sink Sink.
+ */
+
+static void tic_sink_flush(struct tic_sink *sink)
+{
+    struct tic_sink_batch *batch;
+    unsigned int tail = atomic_load_explicit(&sink->tail, memory_order_relaxed);
+    uint64_t one = 1;
+
+    if (sink->fill_points == 0)
+        return;
+
+    batch = &sink->slots[tail & (TIC_SINK_SLOTS - 1)];
+    batch->len = sink->fill_len;
+    batch->points = sink->fill_points;
+    sink->fill_len = 0;
+    sink->fill_points = 0;
+
+    if (sink->type == TIC_SINK_MQTT) {
+        broker_publish_len(sink->mosq, NULL, sink->target, batch->buf, batch->len, tic_qos);
+        return;
+    }
+
+    atomic_store_explicit(&sink->tail, tail + 1, memory_order_release);
+    if (write(sink->efd, &one, sizeof(one)) < 0)
+        syslog(LOG_ERR, "Cannot signal sink %s: %s", sink->target, strerror(errno));
+}
+
+/**
+ * @brief Tell whether a point can be added to the batch being filled.
+ * @param sink Sink.
+ * @return 1 if the sink is started and its slot is not queued for the writer thread, 0 else.
+ */
+
+static int tic_sink_is_ready(struct tic_sink *sink)
+{
+    if (sink->type == TIC_SINK_MQTT)
+        return sink->mosq != NULL;
+
+    return sink->efd >= 0 &&
+           atomic_load_explicit(&sink->tail, memory_order_relaxed) -
+           atomic_load_explicit(&sink->head, memory_order_acquire) < TIC_SINK_SLOTS;
+}
+
+/**
+ * @brief Add a point to a sink.
+ * @param sink Sink, started.
+ * @param line Point, one line ending with a newline.
+ * @param len Length of line.
+ * @param now Current monotonic time (s).
+ * @note The batch is handed over once it holds batch_points points, or once the
+ *       next point does not fit in batch_bytes.
+ */
+
+void tic_sink_add(struct tic_sink *sink, const char *line, int len, time_t now)
+{
+    struct tic_sink_batch *batch;
+
+    if (sink->fill_len + len > sink->batch_bytes)
+        tic_sink_flush(sink);
+
+    if (len > sink->batch_bytes || !tic_sink_is_ready(sink)) {
+        sink->dropped++;
+        return;
+    }
+
+    batch = &sink->slots[atomic_load_explicit(&sink->tail, memory_order_relaxed) & (TIC_SINK_SLOTS - 1)];
+    memcpy(batch->buf + sink->fill_len, line, len);
+    if (sink->fill_points == 0)
+        sink->fill_start = now;
+    sink->fill_len += len;
+    sink->fill_points++;
+    sink->points++;
+
+    if (sink->fill_points >= sink->batch_points)
+        tic_sink_flush(sink);
+}
+
+/**
+ * @brief Hand the batch being filled over once its oldest point waited for the flush interval.
+ * @param sink Sink.
+ * @param now Current monotonic time (s).
+ */
+
+void tic_sink_tick(struct tic_sink *sink, time_t now)
+{
+    if (sink->fill_points > 0 && now - sink->fill_start >= sink->interval)
+        tic_sink_flush(sink);
+}
+
+/**
+ * @brief Write pending points and stop a sink.
+ * @param sink Sink.
+ */
+
+void tic_sink_stop(struct tic_sink *sink)
+{
+    // Points are only added while the slot being filled is owned, so it can always be queued.
+    tic_sink_flush(sink);
+
+    if (sink->efd >= 0) {
+        atomic_store(&sink->stop, 1);
+        pthread_join(sink->thread, NULL);
+        close(sink->efd);
+        sink->efd = -1;
+    }
+
+    syslog(LOG_INFO, "Sink %s: %lu points, %lu dropped, %lu batches written, %lu lost", sink->target,
+           sink->points, sink->dropped, (unsigned long) sink->batches, (unsigned long) sink->errors);
+}
@@ -0,0 +1,77 @@
+#ifndef __TIC_SINK_H__
+#define __TIC_SINK_H__ 1
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <time.h>
+
+#define TIC_SINK_NAME_MAX 127
+#define TIC_SINK_BATCH_MAX 16384 /* Max bytes of a batch. */
+#define TIC_SINK_SLOTS 8         /* Power of 2. */
+
+struct mosquitto;
+
+/* Kinds of sink. All of them receive points in InfluxDB line protocol. */
+
+enum {
+    TIC_SINK_UDP,  // UDP datagrams, e.g. to InfluxDB or Telegraf: influx-udp:host:port.
+    TIC_SINK_UNIX, // Unix datagram socket, e.g. to Telegraf: influx-unix:path.
+    TIC_SINK_FILE, // Append-only file, rotated to path.1 on size: file:path.
+    TIC_SINK_MQTT  // Messages on a topic, through the broker connection: mqtt:topic.
+};
+
+/* Batch of points, one per line. */
+
+struct tic_sink_batch {
+    int len;                      // Length of batch.
+    int points;                   // Number of points.
+    char buf[TIC_SINK_BATCH_MAX]; // Points.
+};
+
+/*
+ * Output of points, written in batches by a dedicated thread, so that a slow
+ * sink never delays the event loop nor the other sinks. Batches are handed to
+ * the thread through a single producer, single consumer ring. When the ring is
+ * full, new points are dropped and counted. MQTT sinks have no thread: their
+ * batches are handed to the asynchronous broker connection.
+ */
+
+struct tic_sink {
+    int type;                           // Kind of sink (TIC_SINK_xxx).
+    char name[TIC_SINK_NAME_MAX + 1];   // Specification.
+    char target[TIC_SINK_NAME_MAX + 1]; // Address, path or topic.
+    int batch_points;                   // Points that trigger a write.
+    int batch_bytes;                    // Max length of a batch, e.g. one datagram.
+    int interval;                       // Max time a point waits for a write (s).
+    long max_size;                      // Size of file that triggers rotation (bytes).
+    struct mosquitto *mosq;             // Broker connection of MQTT sinks.
+
+    // Owned by event loop thread.
+    int fill_len;                       // Length of batch being filled.
+    int fill_points;                    // Points of batch being filled.
+    time_t fill_start;                  // Time of first point of batch being filled (monotonic s).
+    unsigned long points;               // Points queued.
+    unsigned long dropped;              // Points dropped because the ring was full or too long.
+
+    // Owned by writer thread.
+    int fd;                             // Socket or file, -1 while closed.
+    long size;                          // Size of file.
+    int failing;                        // Set after a write error, until a write succeeds.
+
+    int efd;                            // eventfd signaled when batches are queued, -1 if not started.
+    pthread_t thread;                   // Writer thread.
+    struct tic_sink_batch slots[TIC_SINK_SLOTS];
+    atomic_uint head;                   // Next batch to write, written by writer thread.
+    atomic_uint tail;                   // Batch being filled, written by event loop thread.
+    atomic_int stop;                    // Set to stop writer thread once the ring is empty.
+    atomic_ulong batches;               // Batches written.
+    atomic_ulong errors;                // Batches lost on write errors.
+};
+
+extern int tic_sink_parse(struct tic_sink *sink, const char *spec);
+extern int tic_sink_start(struct tic_sink *sink, struct mosquitto *mosq);
+extern void tic_sink_add(struct tic_sink *sink, const char *line, int len, time_t now);
+extern void tic_sink_tick(struct tic_sink *sink, time_t now);
+extern void tic_sink_stop(struct tic_sink *sink);
+
+#endif /* __TIC_SINK_H__ */
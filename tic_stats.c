@@ -0,0 +1,238 @@
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <syslog.h>
+
+#include "homie_helper.h"
+#include "tic2mqtt.h"
+#include "tic_stats.h"
+#include "tic_tags.h"
+#include "tic_tagtab.h"
+
+#define TIC_STATS_ID_MAX   31
+#define TIC_STATS_NAME_MAX 127
+
+/* Homie property of one statistic of a tag. */
+
+struct tic_stats_prop {
+    struct homie_prop_attrs attrs;          // Homie property attributes.
+    char prop_id[TIC_STATS_ID_MAX + 1];     // Storage for attrs.prop_id.
+    char name[TIC_STATS_NAME_MAX + 1];      // Storage for attrs.name.
+};
+
+static const char * const tic_stat_names[TIC_STAT_COUNT] = { "min", "max", "mean", "last" };
+
+static int tic_stats_windows[TIC_STATS_WINDOWS_MAX]; // Window lengths (s).
+static int tic_stats_nwindows = 0;
+
+static struct tic_stats_prop *tic_stats_props[TIC_TAG_COUNT];
+
+/**
+ * @brief Set aggregation windows.
+ * @param arg Comma separated window lengths in seconds, e.g. "10,60,900".
+ * @return 0 on success, -1 if arg is invalid.
+ */
+
+int tic_stats_set_windows(const char *arg)
+{
+    int nwindows = 0;
+    char *end;
+    long window;
+
+    do {
+        window = strtol(arg, &end, 10);
+        if (end == arg || window <= 0 || window > 86400 || (*end != ',' && *end != '\0'))
+            return -1;
+        if (nwindows == TIC_STATS_WINDOWS_MAX)
+            return -1;
+        tic_stats_windows[nwindows++] = window;
+        arg = end + 1;
+    } while (*end == ',');
+
+    tic_stats_nwindows = nwindows;
+    return 0;
+}
+
+/**
+ * @brief Get number of aggregation windows.
+ * @return Number of windows, 0 if aggregation is disabled.
+ */
+
+int tic_stats_window_count(void)
+{
+    return tic_stats_nwindows;
+}
+
+/**
+ * @brief Tell whether statistics are kept for a tag.
+ * @param ptag_desc Tag description.
+ * @return 1 for instantaneous values (integers with a deadband filter), 0 else.
+ */
+
+int tic_stats_is_aggregated(const struct tag_desc *ptag_desc)
+{
+    return ptag_desc->attrs.datatype == HOMIE_INTEGER &&
+           (ptag_desc->filter.type == TIC_FILTER_ABS || ptag_desc->filter.type == TIC_FILTER_PCT);
+}
+
+/**
+ * @brief Add a value of a tag to the statistics of a window.
+ * @param stats Statistics of the tag over the current window.
+ * @param window Window index.
+ * @param data Data.
+ * @param now Current time (s since epoch). Windows are aligned on multiples of their length.
+ * @param closed Filled with the statistics of the previous window when it ends.
+ * @return 1 if a window ended and closed is filled, 0 else.
+ */
+
+int tic_stats_add(struct tic_stats *stats, int window, const char *data, time_t now, struct tic_stats *closed)
+{
+    time_t start = now - now % tic_stats_windows[window];
+    int ended = 0;
+    char *end;
+    long value;
+
+    value = strtol(data, &end, 10);
+    if (end == data || *end != '\0')
+        return 0;
+
+    // Late value of a window already closed by tic_stats_close().
+    if (start < stats->start)
+        return 0;
+
+    if (stats->count > 0 && stats->start != start) {
+        *closed = *stats;
+        ended = 1;
+    }
+
+    if (stats->count == 0 || stats->start != start) {
+        stats->start = start;
+        stats->min = stats->max = value;
+        stats->sum = 0;
+        stats->count = 0;
+    }
+
+    if (value < stats->min)
+        stats->min = value;
+    if (value > stats->max)
+        stats->max = value;
+    stats->last = value;
+    stats->sum += value;
+    stats->count++;
+
+    return ended;
+}
+
+/**
+ * @brief Close the window of a tag if it ended, without waiting for the next value.
+ * @param stats Statistics of the tag over the current window.
+ * @param window Window index.
+ * @param now Current time (s since epoch).
+ * @param closed Filled with the statistics of the window when it ended.
+ * @return 1 if a window ended and closed is filled, 0 else.
+ */
+
+int tic_stats_close(struct tic_stats *stats, int window, time_t now, struct tic_stats *closed)
+{
+    time_t start = now - now % tic_stats_windows[window];
+
+    if (stats->count == 0 || stats->start == start)
+        return 0;
+
+    *closed = *stats;
+    stats->start = start;
+    stats->count = 0;
+
+    return 1;
+}
+
+/**
+ * @brief Format a statistic.
+ * @param stats Statistics of a window.
+ * @param stat Statistic (TIC_STAT_xxx).
+ * @param payload Buffer of TIC_STATS_PAYLOAD_MAX + 1 chars.
+ */
+
+void tic_stats_format(const struct tic_stats *stats, int stat, char *payload)
+{
+    switch (stat) {
+    case TIC_STAT_MIN:
+        sprintf(payload, "%ld", stats->min);
+        break;
+
+    case TIC_STAT_MAX:
+        sprintf(payload, "%ld", stats->max);
+        break;
+
+    case TIC_STAT_MEAN:
+        sprintf(payload, "%.1f", (double) stats->sum / stats->count);
+        break;
+
+    default:
+        sprintf(payload, "%ld", stats->last);
+        break;
+    }
+}
+
+/**
+ * @brief Format window length, e.g. "10s", "1m", "15m", "1h".
+ * @param buf Buffer.
+ * @param size Size of buffer.
+ * @param window Window length (s).
+ */
+
+static void tic_stats_window_id(char *buf, size_t size, int window)
+{
+    if (window % 3600 == 0)
+        snprintf(buf, size, "%dh", window / 3600);
+    else if (window % 60 == 0)
+        snprintf(buf, size, "%dm", window / 60);
+    else
+        snprintf(buf, size, "%ds", window);
+}
+
+/**
+ * @brief Get Homie property of a statistic of a tag, e.g. "papp-1m-max".
+ * @param ptag_desc Tag description.
+ * @param window Window index.
+ * @param stat Statistic (TIC_STAT_xxx).
+ * @return Property attributes, NULL on failure.
+ */
+
+const struct homie_prop_attrs *tic_stats_prop_attrs(const struct tag_desc *ptag_desc, int window, int stat)
+{
+    struct tic_stats_prop **pprops = &tic_stats_props[ptag_desc - tag_descs];
+    char window_id[16];
+    int w;
+    int s;
+
+    if (*pprops == NULL) {
+        *pprops = malloc(sizeof(**pprops) * TIC_STATS_WINDOWS_MAX * TIC_STAT_COUNT);
+        if (*pprops == NULL) {
+            syslog(LOG_ERR, "Cannot alloc statistics for tag %s: %s\n", ptag_desc->tag, strerror(errno));
+            return NULL;
+        }
+
+        for (w = 0; w < tic_stats_nwindows; w++) {
+            tic_stats_window_id(window_id, sizeof(window_id), tic_stats_windows[w]);
+
+            for (s = 0; s < TIC_STAT_COUNT; s++) {
+                struct tic_stats_prop *prop = &(*pprops)[w * TIC_STAT_COUNT + s];
+                const struct homie_prop_attrs attrs = {
+                    prop->prop_id, prop->name, s == TIC_STAT_MEAN ? HOMIE_FLOAT : HOMIE_INTEGER,
+                    ptag_desc->attrs.unit, NULL
+                };
+
+                memcpy(&prop->attrs, &attrs, sizeof(attrs));
+                snprintf(prop->prop_id, sizeof(prop->prop_id), "%s-%s-%s",
+                         ptag_desc->attrs.prop_id, window_id, tic_stat_names[s]);
+                snprintf(prop->name, sizeof(prop->name), "%s (%s %s)",
+                         ptag_desc->attrs.name, tic_stat_names[s], window_id);
+            }
+        }
+    }
+
+    return &(*pprops)[window * TIC_STAT_COUNT + stat].attrs;
+}
@@ -0,0 +1,41 @@
+#ifndef __TIC_STATS_H__
+#define __TIC_STATS_H__ 1
+
+#include <time.h>
+
+#define TIC_STATS_WINDOWS_MAX 4
+#define TIC_STATS_PAYLOAD_MAX 24
+
+struct tag_desc;
+struct homie_prop_attrs;
+
+/* Statistics published for each window. */
+
+enum {
+    TIC_STAT_MIN,
+    TIC_STAT_MAX,
+    TIC_STAT_MEAN,
+    TIC_STAT_LAST,
+    TIC_STAT_COUNT
+};
+
+/* Statistics of a tag over the current window. */
+
+struct tic_stats {
+    time_t start;        // Start of window (s since epoch).
+    long min;            // Minimum value.
+    long max;            // Maximum value.
+    long last;           // Last value.
+    long long sum;       // Sum of values, for the mean.
+    unsigned long count; // Number of values, 0 if window is empty.
+};
+
+extern int tic_stats_set_windows(const char *arg);
+extern int tic_stats_window_count(void);
+extern int tic_stats_is_aggregated(const struct tag_desc *ptag_desc);
+extern int tic_stats_add(struct tic_stats *stats, int window, const char *data, time_t now, struct tic_stats *closed);
+extern int tic_stats_close(struct tic_stats *stats, int window, time_t now, struct tic_stats *closed);
+extern void tic_stats_format(const struct tic_stats *stats, int stat, char *payload);
+extern const struct homie_prop_attrs *tic_stats_prop_attrs(const struct tag_desc *ptag_desc, int window, int stat);
+
+#endif /* __TIC_STATS_H__ */
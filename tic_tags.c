@@ -0,0 +1,75 @@
+#include <string.h>
+
+#include "homie_helper.h"
+#include "tic2mqtt.h"
+#include "tic_hash.h"
+#include "tic_tags.h"
+#include "tic_tagtab.h"
+
+/* Values for enum attributes of Homie property 'tic'. */
+
+static const char * const values_optarif[] = {
+    "BASE", /* Option Base. */
+    "HC..", /* Option Heures Creuses. */
+    "EJP.", /* Option EJP. */
+    "BBRx", /* Option Tempo. */
+    NULL
+};
+
+static const char * const values_ptec[] = {
+    "TH..", /* Toutes les Heures. */
+    "HC..", /* Heures Creuses. */
+    "HP..", /* Heures Pleines. */
+    "HN..", /* Heures Normales. */
+    "PM..", /* Heures de Pointe Mobile. */
+    "HCJB", /* Heures Creuses Jours Bleus. */
+    "HCJW", /* Heures Creuses Jours Blancs (White). */
+    "HCJR", /* Heures Creuses Jours Rouges. */
+    "HPJB", /* Heures Pleines Jours Bleus. */
+    "HPJW", /* Heures Pleines Jours Blancs (White). */
+    "HPJR", /* Heures Pleines Jours Rouges. */
+    NULL
+};
+
+static const char * const values_demain[] = {
+    "----", /* Couleur du lendemain non connue. */
+    "BLEU", /* Le lendemain est jour BLEU. */
+    "BLAN", /* Le lendemain est jour BLANC. */
+    "ROUG", /* Le lendemain est jour ROUGE. */
+    NULL
+};
+
+/* Tags and Homie property attributes of node 'tic', from tic_tags.def. */
+
+#define TIC_TAG(label, len, mode, prop_id, datatype, unit, values, filter, name) \
+    { label, len, mode, { prop_id, name, datatype, unit, values }, filter },
+
+struct tag_desc tag_descs[TIC_TAG_COUNT + 1] = {
+#include "tic_tags.def"
+
+    { NULL, 0 } /* End of table marker. */
+};
+
+/**
+ * @brief Find tag description.
+ * @param tag Tag.
+ * @param len Length of tag.
+ * @return Tag description, NULL if tag is unknown.
+ * @note Constant time: one hash and one comparison (see mktagtab.c).
+ */
+
+struct tag_desc *tic_tag_lookup(const char *tag, size_t len)
+{
+    uint32_t slot = tic_tag_hash(tag, len, TIC_TAGTAB_SEED) & ((1 << TIC_TAGTAB_BITS) - 1);
+    int index = tic_tagtab[slot];
+    struct tag_desc *ptag_desc;
+
+    if (index == 0)
+        return NULL;
+
+    ptag_desc = &tag_descs[index - 1];
+    if (strncmp(ptag_desc->tag, tag, len) != 0 || ptag_desc->tag[len] != '\0')
+        return NULL;
+
+    return ptag_desc;
+}
@@ -0,0 +1,12 @@
+#ifndef __TIC_TAGS_H__
+#define __TIC_TAGS_H__ 1
+
+#include <stddef.h>
+
+#include "tic2mqtt.h"
+
+extern struct tag_desc tag_descs[];
+
+extern struct tag_desc *tic_tag_lookup(const char *tag, size_t len);
+
+#endif /* __TIC_TAGS_H__ */
@@ -0,0 +1,211 @@
+#include <errno.h>
+#include <string.h>
+
+#include <fcntl.h>
+#include <syslog.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+#include "tic_trace.h"
+
+#define TIC_TRACE_ACKS    256 /* Recent acknowledgements, for messages acked before their frame is traced. */
+#define TIC_TRACE_PENDING 64  /* Frames waiting for acknowledgement of their last message. */
+
+/* Acknowledgement of a message. */
+
+struct tic_trace_ack {
+    int mid;       // Message id.
+    uint64_t time; // Monotonic time (ns).
+};
+
+/* Frame waiting for acknowledgement. */
+
+struct tic_trace_pending {
+    int mid;       // Message id of last message of frame, 0 if slot is free.
+    uint64_t seq;  // Frame sequence number.
+    uint64_t slot; // Index of record.
+};
+
+static int tic_trace_fd = -1;
+static size_t tic_trace_size;
+static struct tic_trace_header *tic_trace_header = NULL;
+static struct tic_trace_record *tic_trace_records;
+static struct tic_trace_ack tic_trace_acks[TIC_TRACE_ACKS];
+static unsigned int tic_trace_acks_next = 0;
+static struct tic_trace_pending tic_trace_pending[TIC_TRACE_PENDING];
+static unsigned int tic_trace_pending_next = 0;
+
+/**
+ * @brief Open trace file, creating it if needed.
+ * @param path Path of trace file.
+ * @return 0 on success, -1 on failure.
+ * @note Records left by a previous run are kept if the format matches.
+ */
+
+int tic_trace_open(const char *path)
+{
+    struct tic_trace_header *header;
+    void *map;
+
+    tic_trace_size = sizeof(*header) + TIC_TRACE_RECORDS * sizeof(struct tic_trace_record);
+
+    tic_trace_fd = open(path, O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+    if (tic_trace_fd < 0) {
+        syslog(LOG_ERR, "Cannot open trace %s: %s", path, strerror(errno));
+        return -1;
+    }
+
+    if (ftruncate(tic_trace_fd, tic_trace_size) < 0) {
+        syslog(LOG_ERR, "Cannot size trace %s: %s", path, strerror(errno));
+        close(tic_trace_fd);
+        tic_trace_fd = -1;
+        return -1;
+    }
+
+    map = mmap(NULL, tic_trace_size, PROT_READ | PROT_WRITE, MAP_SHARED, tic_trace_fd, 0);
+    if (map == MAP_FAILED) {
+        syslog(LOG_ERR, "Cannot map trace %s: %s", path, strerror(errno));
+        close(tic_trace_fd);
+        tic_trace_fd = -1;
+        return -1;
+    }
+
+    header = map;
+    if (header->magic != TIC_TRACE_MAGIC || header->version != TIC_TRACE_VERSION ||
+        header->record_size != sizeof(struct tic_trace_record) || header->capacity != TIC_TRACE_RECORDS) {
+        memset(map, 0, tic_trace_size);
+        header->version = TIC_TRACE_VERSION;
+        header->record_size = sizeof(struct tic_trace_record);
+        header->capacity = TIC_TRACE_RECORDS;
+        header->magic = TIC_TRACE_MAGIC;
+    }
+
+    tic_trace_header = header;
+    tic_trace_records = (struct tic_trace_record *) (header + 1);
+
+    return 0;
+}
+
+/**
+ * @brief Close trace file.
+ */
+
+void tic_trace_close(void)
+{
+    if (tic_trace_header == NULL)
+        return;
+
+    munmap(tic_trace_header, tic_trace_size);
+    close(tic_trace_fd);
+    tic_trace_header = NULL;
+    tic_trace_fd = -1;
+}
+
+/**
+ * @brief Check whether tracing is enabled.
+ * @return 1 if trace file is open, 0 otherwise.
+ */
+
+int tic_trace_is_open(void)
+{
+    return tic_trace_header != NULL;
+}
+
+/**
+ * @brief Convert a time to ns.
+ * @param ts Time.
+ * @return Time in ns.
+ */
+
+uint64_t tic_trace_ns(const struct timespec *ts)
+{
+    return ts->tv_sec * 1000000000ULL + ts->tv_nsec;
+}
+
+/**
+ * @brief Get monotonic time in ns.
+ * @return Time in ns.
+ */
+
+uint64_t tic_trace_now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return tic_trace_ns(&ts);
+}
+
+/**
+ * @brief Append the timeline of a frame to trace.
+ * @param record Timeline. If record->mid is set and its acknowledgement is
+ *        not known yet, the record is completed by tic_trace_ack().
+ */
+
+void tic_trace_frame(const struct tic_trace_record *record)
+{
+    struct tic_trace_record *rec;
+    struct tic_trace_pending *pending;
+    uint64_t slot;
+    unsigned int i;
+
+    if (tic_trace_header == NULL)
+        return;
+
+    slot = tic_trace_header->next;
+    rec = &tic_trace_records[slot % TIC_TRACE_RECORDS];
+    *rec = *record;
+    rec->acked = 0;
+
+    if (rec->mid != 0) {
+        // With QoS 0, libmosquitto may report the message written before publish returns.
+        for (i = 0; i < TIC_TRACE_ACKS; i++) {
+            if (tic_trace_acks[i].mid == rec->mid && tic_trace_acks[i].time >= rec->parsed) {
+                rec->acked = tic_trace_acks[i].time;
+                break;
+            }
+        }
+
+        if (rec->acked == 0) {
+            // The oldest pending frame is given up if all slots are used.
+            pending = &tic_trace_pending[tic_trace_pending_next++ % TIC_TRACE_PENDING];
+            pending->mid = rec->mid;
+            pending->seq = rec->seq;
+            pending->slot = slot;
+        }
+    }
+
+    tic_trace_header->next = slot + 1;
+}
+
+/**
+ * @brief Record acknowledgement of a message: PUBACK with QoS 1, written to socket with QoS 0.
+ * @param mid Message id.
+ */
+
+void tic_trace_ack(int mid)
+{
+    struct tic_trace_record *rec;
+    struct tic_trace_pending *pending;
+    uint64_t now;
+    unsigned int i;
+
+    if (tic_trace_header == NULL)
+        return;
+
+    now = tic_trace_now();
+
+    tic_trace_acks[tic_trace_acks_next].mid = mid;
+    tic_trace_acks[tic_trace_acks_next].time = now;
+    tic_trace_acks_next = (tic_trace_acks_next + 1) % TIC_TRACE_ACKS;
+
+    for (i = 0; i < TIC_TRACE_PENDING; i++) {
+        pending = &tic_trace_pending[i];
+        if (pending->mid != mid)
+            continue;
+
+        rec = &tic_trace_records[pending->slot % TIC_TRACE_RECORDS];
+        if (rec->seq == pending->seq && rec->mid == mid)
+            rec->acked = now;
+        pending->mid = 0;
+    }
+}
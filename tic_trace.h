@@ -0,0 +1,51 @@
+#ifndef __TIC_TRACE_H__
+#define __TIC_TRACE_H__ 1
+
+#include <stdint.h>
+#include <time.h>
+
+#define TIC_TRACE_MAGIC   0x45435254 /* "TRCE" */
+#define TIC_TRACE_VERSION 1
+#define TIC_TRACE_RECORDS 4096
+
+/*
+ * Trace file: a header followed by a ring of TIC_TRACE_RECORDS records.
+ * Record i is stored at slot i % capacity, so that the file holds the last
+ * frames. Times are in ns; monotonic times can be converted to realtime with
+ * the offset between stx_wall and stx.
+ */
+
+struct tic_trace_header {
+    uint32_t magic;       // TIC_TRACE_MAGIC.
+    uint32_t version;     // TIC_TRACE_VERSION.
+    uint32_t record_size; // Size of a record.
+    uint32_t capacity;    // Number of records in ring.
+    uint64_t next;        // Index of next record.
+    uint64_t reserved[5];
+};
+
+/* Timeline of a frame. */
+
+struct tic_trace_record {
+    uint64_t seq;      // Frame sequence number.
+    int64_t stx_wall;  // Realtime at reception of STX (ns since Epoch).
+    uint64_t stx;      // Monotonic time at reception of STX.
+    uint64_t etx;      // Monotonic time at reception of ETX.
+    uint64_t parsed;   // Monotonic time at end of parse.
+    uint64_t enqueued; // Monotonic time once all messages of frame are handed to broker client.
+    uint64_t acked;    // Monotonic time of acknowledgement of last message, 0 if none (see tic_trace_ack()).
+    uint32_t mid;      // Message id of last message handed to broker client, 0 if none.
+    uint32_t groups;   // Number of groups.
+    uint32_t len;      // Length of frame, in bytes.
+    uint32_t baudrate; // Line speed, in bauds.
+};
+
+extern int tic_trace_open(const char *path);
+extern void tic_trace_close(void);
+extern int tic_trace_is_open(void);
+extern uint64_t tic_trace_ns(const struct timespec *ts);
+extern uint64_t tic_trace_now(void);
+extern void tic_trace_frame(const struct tic_trace_record *record);
+extern void tic_trace_ack(int mid);
+
+#endif /* __TIC_TRACE_H__ */
@@ -0,0 +1,699 @@
+/*
+ * Simulator of a TIC line, to run tic2mqtt end to end without a meter.
+ *
+ * Usage: tic_sim [-o] [-m legacy|standard] [-x speed] [-n frames] [-a serial]
+ *                [-s seed] [-P pct] [-C pct] [-T pct] [-N pct] [-i interval] path
+ *
+ * Creates a pseudo-terminal and a symlink <path> to it, for tic2mqtt to read
+ * with -t <path>, and writes frames of a single-phase meter with the HC option
+ * (legacy mode) or the TEMPO-less standard calendar: power follows a daily
+ * profile with random appliances, indexes count the energy, the tariff period
+ * switches at 22h and 6h. With -o, <path> is an existing tty or pty instead,
+ * e.g. the link created by tic2mqtt -t pty:<path>.
+ *
+ * Frames are paced at line speed (1200 bit/s in legacy mode, 9600 bit/s in
+ * standard mode), times -x speed; -x 0 writes as fast as the reader takes
+ * them. Simulated time advances by the transmission time of each frame, so
+ * days go by faster with a higher speed.
+ *
+ * Errors are injected in a percentage of frames: -P replaces a byte with NUL,
+ * as the tty driver does on a parity error (INPCK without PARMRK), -C corrupts
+ * the checksum of a group, -T cuts the frame, followed by EOT or not, and -N
+ * adds a burst of random 7-bit bytes after the frame.
+ *
+ * Counters are printed every -i seconds (10 by default, 0 for none) and on exit.
+ */
+
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <termios.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "tic_reader.h"
+
+#define LEGACY_BAUDRATE 1200
+#define STANDARD_BAUDRATE 9600
+#define BITS_PER_BYTE 10 /* Start bit, 7 data bits, parity, stop bit. */
+
+#define DEFAULT_SERIAL "031762120857"
+#define SUBSCRIBED_KVA 9 /* Subscribed power: 45 A at 230 V. */
+#define NOISE_MAX 16     /* Max bytes of a burst of noise. */
+
+/* Kinds of injected errors. */
+
+enum {
+    ERROR_PARITY,   // One byte replaced with NUL.
+    ERROR_CHECKSUM, // Wrong checksum of one group.
+    ERROR_TRUNCATE, // Frame cut, with or without EOT.
+    ERROR_NOISE,    // Random bytes after the frame.
+    ERROR_COUNT
+};
+
+static const char * const error_names[ERROR_COUNT] = {
+    "parity", "checksum", "truncated", "noise"
+};
+
+/* Load profile of a household (VA), by hour of the day. */
+
+static const int profile[24] = {
+    350, 300, 300, 300, 300, 350, 900, 1600, 1200, 700, 600, 800,
+    1400, 1000, 700, 600, 700, 1000, 1900, 2600, 2200, 1500, 1100, 600
+};
+
+/* State of the simulated meter. */
+
+struct sim_meter {
+    int standard;         // Standard mode, legacy mode otherwise.
+    const char *serial;   // ADCO or ADSC.
+    double now;           // Simulated time (s since Epoch).
+    double power;         // Apparent power (VA), cos phi taken as 1.
+    double appliance;     // Power of the appliance running (VA).
+    double appliance_end; // End of the appliance cycle (simulated s).
+    double voltage;       // URMS1 (V).
+    double voltage_sum;   // Sum of voltages over the current 10 min period, for UMOY1.
+    int voltage_count;    // Samples of voltage_sum.
+    int umoy;             // UMOY1 of the last 10 min period.
+    time_t umoy_time;     // End of the last 10 min period.
+    double index[2];      // Energy of the HC and HP periods (Wh).
+    double period_energy; // Energy of the current 30 min period, for CCASN (Wh).
+    int ccasn[2];         // CCASN and CCASN-1 (W).
+    time_t ccasn_time[2]; // End of their periods.
+    int smax[2];          // SMAXSN and SMAXSN-1 (VA).
+    time_t smax_time[2];  // Time of the max.
+    int day;              // Day of the year, to roll SMAXSN over.
+};
+
+/* Frame being built. */
+
+struct sim_frame {
+    char buf[TIC_FRAME_MAX];
+    int len;
+    int groups;
+    int checksums[64]; // Offsets of the checksums of the groups.
+};
+
+static volatile sig_atomic_t stop = 0;
+static uint64_t rng_state = 0x9e3779b97f4a7c15ULL;
+
+/**
+ * @brief Get next pseudo-random number (xorshift64*).
+ * @return Random number.
+ */
+
+static uint64_t rng_next(void)
+{
+    rng_state ^= rng_state >> 12;
+    rng_state ^= rng_state << 25;
+    rng_state ^= rng_state >> 27;
+    return rng_state * 0x2545f4914f6cdd1dULL;
+}
+
+/**
+ * @brief Get a uniform random number.
+ * @return Number in [0, 1).
+ */
+
+static double rng_uniform(void)
+{
+    return (rng_next() >> 11) * (1.0 / 9007199254740992.0);
+}
+
+/**
+ * @brief Get an approximately normal random number (sum of uniforms).
+ * @return Number of mean 0 and standard deviation 1.
+ */
+
+static double rng_normal(void)
+{
+    double sum = 0;
+    int i;
+
+    for (i = 0; i < 12; i++)
+        sum += rng_uniform();
+    return sum - 6;
+}
+
+/**
+ * @brief Tell whether an event with a probability in percent happens.
+ * @param pct Probability (%).
+ * @return 1 if it happens, 0 else.
+ */
+
+static int rng_percent(double pct)
+{
+    return pct > 0 && rng_uniform() * 100 < pct;
+}
+
+/**
+ * @brief Tell whether a time falls in the off-peak period (HC), from 22h to 6h.
+ * @param tm Local time.
+ * @return 1 in off-peak period, 0 else.
+ */
+
+static int is_off_peak(const struct tm *tm)
+{
+    return tm->tm_hour >= 22 || tm->tm_hour < 6;
+}
+
+/**
+ * @brief Advance the meter to a simulated time.
+ * @param meter Meter.
+ * @param dt Elapsed simulated time (s).
+ */
+
+static void meter_update(struct sim_meter *meter, double dt)
+{
+    struct tm tm;
+    time_t t;
+    time_t period;
+    int off_peak;
+
+    meter->now += dt;
+    t = (time_t) meter->now;
+    localtime_r(&t, &tm);
+    off_peak = is_off_peak(&tm);
+
+    // Appliances start at random, more often during the day, and run from 1 to 30 min.
+    if (meter->now >= meter->appliance_end) {
+        meter->appliance = 0;
+        if (rng_uniform() < dt * (off_peak ? 0.0002 : 0.001)) {
+            meter->appliance = 800 + rng_uniform() * 2500;
+            meter->appliance_end = meter->now + 60 + rng_uniform() * 1740;
+        }
+    }
+
+    // Mean reverting walk around the profile, so that consecutive frames stay close.
+    meter->power += (profile[tm.tm_hour] + meter->appliance - meter->power) * (dt < 10 ? dt / 10 : 1);
+    meter->power += rng_normal() * meter->power * 0.02;
+    if (meter->power < 50)
+        meter->power = 50;
+    if (meter->power > SUBSCRIBED_KVA * 1150)
+        meter->power = SUBSCRIBED_KVA * 1150;
+
+    meter->voltage += (230 - meter->voltage) * 0.05 + rng_normal() * 0.5;
+    meter->voltage_sum += meter->voltage;
+    meter->voltage_count++;
+
+    meter->index[off_peak ? 0 : 1] += meter->power * dt / 3600;
+    meter->period_energy += meter->power * dt / 3600;
+
+    // Load curve (CCASN) over 30 min periods, mean voltage (UMOY1) over 10 min periods.
+    period = t - t % 1800;
+    if (period > meter->ccasn_time[0]) {
+        meter->ccasn[1] = meter->ccasn[0];
+        meter->ccasn_time[1] = meter->ccasn_time[0];
+        meter->ccasn[0] = (int) (meter->period_energy * 2 + 0.5);
+        meter->ccasn_time[0] = period;
+        meter->period_energy = 0;
+    }
+    period = t - t % 600;
+    if (period > meter->umoy_time) {
+        meter->umoy = (int) (meter->voltage_sum / meter->voltage_count + 0.5);
+        meter->umoy_time = period;
+        meter->voltage_sum = 0;
+        meter->voltage_count = 0;
+    }
+
+    if (tm.tm_yday != meter->day) {
+        meter->smax[1] = meter->smax[0];
+        meter->smax_time[1] = meter->smax_time[0];
+        meter->smax[0] = 0;
+        meter->day = tm.tm_yday;
+    }
+    if (meter->power > meter->smax[0]) {
+        meter->smax[0] = (int) meter->power;
+        meter->smax_time[0] = t;
+    }
+}
+
+/**
+ * @brief Append a group to a frame.
+ * @param frame Frame.
+ * @param standard Standard mode (HT separator, checksum includes the last separator).
+ * @param tag Tag.
+ * @param horodate Horodate, NULL if none (standard mode only).
+ * @param data Data.
+ */
+
+static void frame_add(struct sim_frame *frame, int standard, const char *tag, const char *horodate, const char *data)
+{
+    char sep = standard ? '\t' : ' ';
+    char *group;
+    unsigned int sum = 0;
+    int n;
+
+    if (frame->groups == (int) (sizeof(frame->checksums) / sizeof(frame->checksums[0])))
+        return;
+
+    group = frame->buf + frame->len + 1;
+    if (horodate != NULL)
+        n = snprintf(group, sizeof(frame->buf) - frame->len - 4, "%s%c%s%c%s%c", tag, sep, horodate, sep, data, sep);
+    else
+        n = snprintf(group, sizeof(frame->buf) - frame->len - 4, "%s%c%s%c", tag, sep, data, sep);
+    if (n >= (int) sizeof(frame->buf) - frame->len - 4)
+        return;
+
+    for (; *group != '\0'; group++)
+        sum += (unsigned char) *group;
+    if (!standard)
+        sum -= sep;
+
+    frame->buf[frame->len] = '\n';
+    frame->len += 1 + n;
+    frame->checksums[frame->groups++] = frame->len;
+    frame->buf[frame->len++] = ' ' + (sum & 0x3f);
+    frame->buf[frame->len++] = '\r';
+}
+
+/**
+ * @brief Format a horodate of standard mode: season (E summer, H winter) and YYMMDDhhmmss.
+ * @param buf Buffer of 14 chars.
+ * @param t Time.
+ */
+
+static void format_horodate(char *buf, time_t t)
+{
+    struct tm tm;
+
+    localtime_r(&t, &tm);
+    buf[0] = tm.tm_isdst > 0 ? 'E' : 'H';
+    strftime(buf + 1, 13, "%y%m%d%H%M%S", &tm);
+}
+
+/**
+ * @brief Build the frame of the current state of the meter.
+ * @param meter Meter.
+ * @param frame Frame.
+ */
+
+static void frame_build(const struct sim_meter *meter, struct sim_frame *frame)
+{
+    static const char * const standard_zeros[] = {
+        "EASF03", "EASF04", "EASF05", "EASF06", "EASF07", "EASF08", "EASF09", "EASF10", "EASD03", "EASD04", NULL
+    };
+    time_t t = (time_t) meter->now;
+    char horodate[14];
+    char data[32];
+    struct tm tm;
+    int off_peak;
+    int current;
+    int i;
+
+    localtime_r(&t, &tm);
+    off_peak = is_off_peak(&tm);
+    current = (int) (meter->power / 230 + 0.5);
+
+    frame->len = 0;
+    frame->groups = 0;
+    frame->buf[frame->len++] = STX;
+
+    if (!meter->standard) {
+        frame_add(frame, 0, "ADCO", NULL, meter->serial);
+        frame_add(frame, 0, "OPTARIF", NULL, "HC..");
+        snprintf(data, sizeof(data), "%02d", SUBSCRIBED_KVA * 5);
+        frame_add(frame, 0, "ISOUSC", NULL, data);
+        snprintf(data, sizeof(data), "%09ld", (long) meter->index[0]);
+        frame_add(frame, 0, "HCHC", NULL, data);
+        snprintf(data, sizeof(data), "%09ld", (long) meter->index[1]);
+        frame_add(frame, 0, "HCHP", NULL, data);
+        frame_add(frame, 0, "PTEC", NULL, off_peak ? "HC.." : "HP..");
+        snprintf(data, sizeof(data), "%03d", current);
+        frame_add(frame, 0, "IINST", NULL, data);
+        if (current > SUBSCRIBED_KVA * 5)
+            frame_add(frame, 0, "ADPS", NULL, data);
+        frame_add(frame, 0, "IMAX", NULL, "090");
+        snprintf(data, sizeof(data), "%05d", (int) (meter->power / 10 + 0.5) * 10);
+        frame_add(frame, 0, "PAPP", NULL, data);
+        frame_add(frame, 0, "HHPHC", NULL, "A");
+        frame_add(frame, 0, "MOTDETAT", NULL, "000000");
+    } else {
+        frame_add(frame, 1, "ADSC", NULL, meter->serial);
+        frame_add(frame, 1, "VTIC", NULL, "02");
+        format_horodate(horodate, t);
+        frame_add(frame, 1, "DATE", horodate, "");
+        frame_add(frame, 1, "NGTF", NULL, "H PLEINE/CREUSE ");
+        frame_add(frame, 1, "LTARF", NULL, off_peak ? "  HEURE  CREUSE " : "  HEURE  PLEINE ");
+        snprintf(data, sizeof(data), "%09ld", (long) (meter->index[0] + meter->index[1]));
+        frame_add(frame, 1, "EAST", NULL, data);
+        snprintf(data, sizeof(data), "%09ld", (long) meter->index[0]);
+        frame_add(frame, 1, "EASF01", NULL, data);
+        frame_add(frame, 1, "EASD01", NULL, data);
+        snprintf(data, sizeof(data), "%09ld", (long) meter->index[1]);
+        frame_add(frame, 1, "EASF02", NULL, data);
+        frame_add(frame, 1, "EASD02", NULL, data);
+        for (i = 0; standard_zeros[i] != NULL; i++)
+            frame_add(frame, 1, standard_zeros[i], NULL, "000000000");
+        snprintf(data, sizeof(data), "%03d", current);
+        frame_add(frame, 1, "IRMS1", NULL, data);
+        snprintf(data, sizeof(data), "%03d", (int) (meter->voltage + 0.5));
+        frame_add(frame, 1, "URMS1", NULL, data);
+        snprintf(data, sizeof(data), "%02d", SUBSCRIBED_KVA);
+        frame_add(frame, 1, "PREF", NULL, data);
+        frame_add(frame, 1, "PCOUP", NULL, data);
+        snprintf(data, sizeof(data), "%05d", (int) meter->power);
+        frame_add(frame, 1, "SINSTS", NULL, data);
+        format_horodate(horodate, meter->smax_time[0]);
+        snprintf(data, sizeof(data), "%05d", meter->smax[0]);
+        frame_add(frame, 1, "SMAXSN", horodate, data);
+        format_horodate(horodate, meter->smax_time[1]);
+        snprintf(data, sizeof(data), "%05d", meter->smax[1]);
+        frame_add(frame, 1, "SMAXSN-1", horodate, data);
+        format_horodate(horodate, meter->ccasn_time[0]);
+        snprintf(data, sizeof(data), "%05d", meter->ccasn[0]);
+        frame_add(frame, 1, "CCASN", horodate, data);
+        format_horodate(horodate, meter->ccasn_time[1]);
+        snprintf(data, sizeof(data), "%05d", meter->ccasn[1]);
+        frame_add(frame, 1, "CCASN-1", horodate, data);
+        format_horodate(horodate, meter->umoy_time);
+        snprintf(data, sizeof(data), "%03d", meter->umoy);
+        frame_add(frame, 1, "UMOY1", horodate, data);
+        frame_add(frame, 1, "STGE", NULL, off_peak ? "003A0001" : "003A4001");
+        frame_add(frame, 1, "MSG1", NULL, "PAS DE          MESSAGE         ");
+        frame_add(frame, 1, "PRM", NULL, "12345678901234");
+        frame_add(frame, 1, "RELAIS", NULL, "000");
+        frame_add(frame, 1, "NTARF", NULL, off_peak ? "01" : "02");
+        frame_add(frame, 1, "NJOURF", NULL, "00");
+        frame_add(frame, 1, "NJOURF+1", NULL, "00");
+        frame_add(frame, 1, "PJOURF+1", NULL,
+                  "00008001 06008002 22008001 NONUTILE NONUTILE NONUTILE NONUTILE NONUTILE NONUTILE NONUTILE NONUTILE");
+    }
+
+    frame->buf[frame->len++] = ETX;
+}
+
+/**
+ * @brief Inject errors in a frame.
+ * @param frame Frame.
+ * @param pcts Probability of each kind of error (%).
+ * @param counts Counters of injected errors.
+ */
+
+static void frame_inject(struct sim_frame *frame, const double *pcts, unsigned long *counts)
+{
+    int i;
+    int n;
+
+    if (rng_percent(pcts[ERROR_CHECKSUM]) && frame->groups > 0) {
+        i = frame->checksums[rng_next() % frame->groups];
+        frame->buf[i] = ' ' + ((frame->buf[i] - ' ' + 1 + rng_next() % 63) & 0x3f);
+        counts[ERROR_CHECKSUM]++;
+    }
+
+    if (rng_percent(pcts[ERROR_PARITY])) {
+        frame->buf[1 + rng_next() % (frame->len - 2)] = '\0';
+        counts[ERROR_PARITY]++;
+    }
+
+    if (rng_percent(pcts[ERROR_TRUNCATE])) {
+        frame->len = 1 + rng_next() % (frame->len - 2);
+        // Meters end an interrupted frame with EOT; a cut line does not.
+        if (rng_next() & 1)
+            frame->buf[frame->len++] = EOT;
+        counts[ERROR_TRUNCATE]++;
+    }
+
+    if (rng_percent(pcts[ERROR_NOISE])) {
+        for (n = 1 + rng_next() % NOISE_MAX; n > 0 && frame->len < (int) sizeof(frame->buf); n--)
+            frame->buf[frame->len++] = rng_next() & 0x7f;
+        counts[ERROR_NOISE]++;
+    }
+}
+
+/**
+ * @brief Create a pty and link its slave side.
+ * @param link Path of symbolic link.
+ * @param slave_fd Set to the slave side, kept open so that frames are buffered until a reader opens it.
+ * @return Master side, -1 on failure.
+ * @note An existing file at the link path is only replaced if it is a symbolic link.
+ */
+
+static int open_pty(const char *link, int *slave_fd)
+{
+    struct termios termios;
+    struct stat st;
+    const char *slave;
+    int fd;
+
+    fd = posix_openpt(O_RDWR | O_NOCTTY);
+    if (fd < 0 || grantpt(fd) < 0 || unlockpt(fd) < 0 || (slave = ptsname(fd)) == NULL)
+        return -1;
+
+    *slave_fd = open(slave, O_RDWR | O_NOCTTY);
+    if (*slave_fd < 0)
+        return -1;
+
+    /* Raw mode, until the reader sets its own. */
+    tcgetattr(*slave_fd, &termios);
+    cfmakeraw(&termios);
+    tcsetattr(*slave_fd, TCSANOW, &termios);
+
+    if (lstat(link, &st) == 0 && S_ISLNK(st.st_mode))
+        unlink(link);
+    if (symlink(slave, link) < 0)
+        return -1;
+
+    fprintf(stderr, "Pty %s linked to %s\n", slave, link);
+    return fd;
+}
+
+/**
+ * @brief Write all bytes, unless interrupted by a signal.
+ * @param fd File descriptor.
+ * @param buf Bytes.
+ * @param len Number of bytes.
+ * @return 0 on success, -1 on failure.
+ */
+
+static int write_all(int fd, const char *buf, int len)
+{
+    ssize_t n;
+
+    while (len > 0) {
+        n = write(fd, buf, len);
+        if (n < 0)
+            return -1;
+        buf += n;
+        len -= n;
+    }
+
+    return 0;
+}
+
+/**
+ * @brief Print counters.
+ * @param frames Frames written.
+ * @param bytes Bytes written.
+ * @param counts Counters of injected errors.
+ * @param elapsed Elapsed time (s).
+ */
+
+static void print_counters(unsigned long frames, unsigned long long bytes, const unsigned long *counts, double elapsed)
+{
+    int i;
+
+    fprintf(stderr, "%lu frames (%.1f/s), %llu bytes (%.0f bit/s)", frames, frames / elapsed, bytes,
+            bytes * BITS_PER_BYTE / elapsed);
+    for (i = 0; i < ERROR_COUNT; i++)
+        fprintf(stderr, ", %s %lu", error_names[i], counts[i]);
+    fprintf(stderr, "\n");
+}
+
+/**
+ * @brief Get monotonic time.
+ * @return Time (s).
+ */
+
+static double monotonic_seconds(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/**
+ * @brief Handle termination signals: stop after the current frame.
+ * @param signum Signal number.
+ */
+
+static void signal_handler(int signum)
+{
+    stop = 1;
+}
+
+/**
+ * @brief Print usage.
+ * @param progname Program name.
+ */
+
+static void usage(const char *progname)
+{
+    fprintf(stderr, "Usage: %s [-o] [-m legacy|standard] [-x speed] [-n frames] [-a serial] [-s seed] [-P pct] [-C pct] [-T pct] [-N pct] [-i interval] path\n", progname);
+}
+
+int main(int argc, char *argv[])
+{
+    struct sigaction sa = { .sa_handler = signal_handler };
+    struct sim_meter meter = { .serial = DEFAULT_SERIAL };
+    struct sim_frame frame;
+    struct timespec deadline;
+    double pcts[ERROR_COUNT] = { 0 };
+    unsigned long counts[ERROR_COUNT] = { 0 };
+    unsigned long frames = 0;
+    unsigned long max_frames = 0;
+    unsigned long long bytes = 0;
+    double speed = 1;
+    double interval = 10;
+    double start;
+    double last_print;
+    double dt;
+    const char *path;
+    int existing = 0;
+    int slave_fd = -1;
+    int baudrate;
+    int opt;
+    int fd;
+
+    while ((opt = getopt(argc, argv, "om:x:n:a:s:P:C:T:N:i:")) != -1) {
+        switch (opt) {
+        case 'o':
+            existing = 1;
+            break;
+
+        case 'm':
+            if (strcmp(optarg, "standard") == 0) {
+                meter.standard = 1;
+            } else if (strcmp(optarg, "legacy") != 0) {
+                usage(argv[0]);
+                exit(EXIT_FAILURE);
+            }
+            break;
+
+        case 'x':
+            speed = atof(optarg);
+            break;
+
+        case 'n':
+            max_frames = strtoul(optarg, NULL, 10);
+            break;
+
+        case 'a':
+            if (strlen(optarg) != 12) {
+                usage(argv[0]);
+                exit(EXIT_FAILURE);
+            }
+            meter.serial = optarg;
+            break;
+
+        case 's':
+            rng_state ^= strtoull(optarg, NULL, 10) * 0x9e3779b97f4a7c15ULL;
+            if (rng_state == 0)
+                rng_state = 1;
+            break;
+
+        case 'P':
+            pcts[ERROR_PARITY] = atof(optarg);
+            break;
+
+        case 'C':
+            pcts[ERROR_CHECKSUM] = atof(optarg);
+            break;
+
+        case 'T':
+            pcts[ERROR_TRUNCATE] = atof(optarg);
+            break;
+
+        case 'N':
+            pcts[ERROR_NOISE] = atof(optarg);
+            break;
+
+        case 'i':
+            interval = atof(optarg);
+            break;
+
+        default:
+            usage(argv[0]);
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    if (optind != argc - 1 || speed < 0) {
+        usage(argv[0]);
+        exit(EXIT_FAILURE);
+    }
+    path = argv[optind];
+
+    if (existing)
+        fd = open(path, O_WRONLY | O_NOCTTY);
+    else
+        fd = open_pty(path, &slave_fd);
+    if (fd < 0) {
+        perror(path);
+        exit(EXIT_FAILURE);
+    }
+
+    sigaction(SIGINT, &sa, NULL);
+    sigaction(SIGTERM, &sa, NULL);
+    signal(SIGPIPE, SIG_IGN);
+
+    baudrate = meter.standard ? STANDARD_BAUDRATE : LEGACY_BAUDRATE;
+    meter.now = time(NULL);
+    meter.power = profile[0];
+    meter.voltage = 230;
+    meter.index[0] = 12345678;
+    meter.index[1] = 23456789;
+    meter.day = -1;
+    meter_update(&meter, 0);
+    meter.smax_time[1] = meter.smax_time[0] - 86400;
+    meter.ccasn_time[1] = meter.ccasn_time[0] - 1800;
+
+    start = last_print = monotonic_seconds();
+    clock_gettime(CLOCK_MONOTONIC, &deadline);
+
+    while (!stop && (max_frames == 0 || frames < max_frames)) {
+        frame_build(&meter, &frame);
+        dt = (double) frame.len * BITS_PER_BYTE / baudrate;
+        frame_inject(&frame, pcts, counts);
+
+        if (write_all(fd, frame.buf, frame.len) < 0) {
+            if (errno != EINTR)
+                perror(path);
+            break;
+        }
+        frames++;
+        bytes += frame.len;
+
+        meter_update(&meter, dt);
+
+        if (speed > 0) {
+            deadline.tv_nsec += (long) (dt / speed * 1e9);
+            deadline.tv_sec += deadline.tv_nsec / 1000000000;
+            deadline.tv_nsec %= 1000000000;
+            while (!stop && clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &deadline, NULL) == EINTR)
+                ;
+        }
+
+        if (interval > 0 && monotonic_seconds() - last_print >= interval) {
+            last_print = monotonic_seconds();
+            print_counters(frames, bytes, counts, last_print - start);
+        }
+    }
+
+    print_counters(frames, bytes, counts, monotonic_seconds() - start);
+
+    if (!existing) {
+        unlink(path);
+        close(slave_fd);
+    }
+    close(fd);
+
+    return EXIT_SUCCESS;
+}
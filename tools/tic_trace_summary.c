@@ -0,0 +1,198 @@
+/*
+ * Summary of a trace file written by tic2mqtt -x.
+ *
+ * Usage: tic_trace_summary [-d] trace
+ *
+ * For each stage of the path of a frame, from reception of its STX to the
+ * acknowledgement of its last message, prints percentiles of the time spent.
+ * With -d, also dumps each record.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "tic_trace.h"
+
+#define BITS_PER_BYTE 10 /* Start bit, 7 data bits, parity, stop bit. */
+
+/* Stages of the path of a frame. */
+
+enum {
+    STAGE_SERIAL,    // STX to ETX.
+    STAGE_BUFFERING, // STX to ETX, minus transmission time at line speed. Negative if input is not a serial line.
+    STAGE_PARSE,     // ETX to end of parse, including wait in pipeline.
+    STAGE_PUBLISH,   // End of parse to handoff of last message.
+    STAGE_NETWORK,   // Handoff to acknowledgement of last message.
+    STAGE_AGE,       // ETX to acknowledgement, or handoff if not acknowledged.
+    STAGE_COUNT
+};
+
+static const char * const stage_names[STAGE_COUNT] = {
+    "serial (STX to ETX)",
+    "buffering (est.)",
+    "parse",
+    "publish",
+    "network (ack)",
+    "age (ETX to ack)"
+};
+
+/**
+ * @brief Time elapsed between two timestamps.
+ * @param from Start time (ns).
+ * @param to End time (ns).
+ * @return Elapsed time in ms, 0 if to is before from.
+ * @note With QoS 0, a message can be reported sent before its frame is marked enqueued.
+ */
+
+static double elapsed_ms(uint64_t from, uint64_t to)
+{
+    int64_t elapsed = (int64_t) (to - from);
+
+    return elapsed > 0 ? elapsed / 1e6 : 0;
+}
+
+/**
+ * @brief Compare samples, for qsort().
+ * @param a First sample.
+ * @param b Second sample.
+ * @return -1, 0 or 1.
+ */
+
+static int sample_cmp(const void *a, const void *b)
+{
+    double da = *(const double *) a;
+    double db = *(const double *) b;
+
+    return (da > db) - (da < db);
+}
+
+/**
+ * @brief Print percentiles of a stage.
+ * @param name Stage name.
+ * @param samples Samples, in ms. Sorted in place.
+ * @param count Number of samples.
+ */
+
+static void print_stage(const char *name, double *samples, int count)
+{
+    if (count == 0) {
+        printf("%-22s %8s\n", name, "-");
+        return;
+    }
+
+    qsort(samples, count, sizeof(*samples), sample_cmp);
+    printf("%-22s %8d %10.3f %10.3f %10.3f %10.3f\n", name, count,
+           samples[count / 2], samples[count * 9 / 10], samples[count * 99 / 100], samples[count - 1]);
+}
+
+/**
+ * @brief Print usage.
+ * @param progname Program name.
+ */
+
+static void usage(const char *progname)
+{
+    fprintf(stderr, "Usage: %s [-d] trace\n", progname);
+}
+
+int main(int argc, char *argv[])
+{
+    struct tic_trace_header header;
+    struct tic_trace_record *records;
+    const struct tic_trace_record *rec;
+    double *samples[STAGE_COUNT];
+    int counts[STAGE_COUNT] = { 0 };
+    uint64_t first;
+    uint64_t n;
+    uint64_t i;
+    int dump = 0;
+    int unacked = 0;
+    int opt;
+    int stage;
+    FILE *fp;
+
+    while ((opt = getopt(argc, argv, "d")) != -1) {
+        switch (opt) {
+        case 'd':
+            dump = 1;
+            break;
+
+        default:
+            usage(argv[0]);
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    if (optind != argc - 1) {
+        usage(argv[0]);
+        exit(EXIT_FAILURE);
+    }
+
+    fp = fopen(argv[optind], "r");
+    if (fp == NULL) {
+        perror(argv[optind]);
+        exit(EXIT_FAILURE);
+    }
+
+    if (fread(&header, sizeof(header), 1, fp) != 1 || header.magic != TIC_TRACE_MAGIC ||
+        header.version != TIC_TRACE_VERSION || header.record_size != sizeof(*rec) || header.capacity == 0) {
+        fprintf(stderr, "%s: not a trace file\n", argv[optind]);
+        exit(EXIT_FAILURE);
+    }
+
+    records = calloc(header.capacity, sizeof(*records));
+    for (stage = 0; stage < STAGE_COUNT; stage++)
+        samples[stage] = calloc(header.capacity, sizeof(double));
+    if (records == NULL || fread(records, sizeof(*records), header.capacity, fp) != header.capacity) {
+        fprintf(stderr, "%s: truncated trace file\n", argv[optind]);
+        exit(EXIT_FAILURE);
+    }
+    fclose(fp);
+
+    n = header.next < header.capacity ? header.next : header.capacity;
+    first = header.next - n;
+
+    if (dump)
+        printf("%8s %20s %6s %5s %10s %10s %10s %10s\n",
+               "seq", "stx_wall (ns)", "len", "baud", "serial ms", "parse ms", "publish ms", "network ms");
+
+    for (i = first; i < header.next; i++) {
+        double serial;
+        double line;
+
+        rec = &records[i % header.capacity];
+        if (rec->etx == 0 || rec->enqueued == 0)
+            continue;
+
+        serial = elapsed_ms(rec->stx, rec->etx);
+        line = rec->baudrate ? (rec->len + 2) * BITS_PER_BYTE * 1e3 / rec->baudrate : 0;
+
+        samples[STAGE_SERIAL][counts[STAGE_SERIAL]++] = serial;
+        samples[STAGE_BUFFERING][counts[STAGE_BUFFERING]++] = serial - line;
+        samples[STAGE_PARSE][counts[STAGE_PARSE]++] = elapsed_ms(rec->etx, rec->parsed);
+        samples[STAGE_PUBLISH][counts[STAGE_PUBLISH]++] = elapsed_ms(rec->parsed, rec->enqueued);
+        if (rec->acked != 0) {
+            samples[STAGE_NETWORK][counts[STAGE_NETWORK]++] = elapsed_ms(rec->enqueued, rec->acked);
+            samples[STAGE_AGE][counts[STAGE_AGE]++] = elapsed_ms(rec->etx, rec->acked);
+        } else {
+            samples[STAGE_AGE][counts[STAGE_AGE]++] = elapsed_ms(rec->etx, rec->enqueued);
+            unacked += rec->mid != 0;
+        }
+
+        if (dump)
+            printf("%8llu %20lld %6u %5u %10.3f %10.3f %10.3f %10.3f\n",
+                   (unsigned long long) rec->seq, (long long) rec->stx_wall, rec->len, rec->baudrate, serial,
+                   elapsed_ms(rec->etx, rec->parsed), elapsed_ms(rec->parsed, rec->enqueued),
+                   rec->acked ? elapsed_ms(rec->enqueued, rec->acked) : -1.0);
+    }
+
+    printf("%llu frames traced, %llu in file, %d not acknowledged\n\n",
+           (unsigned long long) header.next, (unsigned long long) n, unacked);
+    printf("%-22s %8s %10s %10s %10s %10s\n", "stage (ms)", "frames", "p50", "p90", "p99", "max");
+    for (stage = 0; stage < STAGE_COUNT; stage++)
+        print_stage(stage_names[stage], samples[stage], counts[stage]);
+
+    return EXIT_SUCCESS;
+}